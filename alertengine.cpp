@@ -0,0 +1,582 @@
+#include "alertengine.h"
+#include "favoriteslist.h"
+#include "metrics.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const int MaxStackDepth = 32;
+
+struct FieldInfo {
+    const char *name;
+    double defaultMargin;
+};
+
+// Same order as AlertEngine::Field; delta(x) maps to the *Change fields
+const FieldInfo Fields[AlertEngine::FieldCount] = {
+    { "temp", 1.0 },
+    { "feels_like", 1.0 },
+    { "humidity", 5.0 },
+    { "wind", 5.0 },
+    { "forecast_min", 1.0 },
+    { "forecast_max", 1.0 },
+    { "delta(temp)", 1.0 },
+    { "delta(feels_like)", 1.0 },
+    { "delta(humidity)", 5.0 },
+    { "delta(wind)", 5.0 },
+};
+
+bool sameValue(double a, double b)
+{
+    return a == b || (qIsNaN(a) && qIsNaN(b));
+}
+
+// Recursive descent over: expr := and ('or' and)*, and := primary
+// ('and' primary)*, primary := '(' expr ')' | field op number [unit]
+class RuleParser
+{
+public:
+    RuleParser(const QString &expression, double hysteresis)
+        : m_hysteresis(hysteresis)
+    {
+        static const QRegularExpression token(
+            R"(\s*(<=|>=|<|>|\(|\)|km/h|m/s|°C|%|[-+]?(?:\d+\.?\d*|\.\d+)|[A-Za-z_]+))");
+        int pos = 0;
+        while (pos < expression.size()) {
+            QRegularExpressionMatch match = token.match(expression, pos, QRegularExpression::NormalMatch,
+                                                        QRegularExpression::AnchorAtOffsetMatchOption);
+            if (!match.hasMatch() || match.capturedLength() == 0) {
+                if (expression.mid(pos).trimmed().isEmpty()) {
+                    break;
+                }
+                m_error = QString("Unexpected '%1'").arg(expression.mid(pos).trimmed().left(10));
+                return;
+            }
+            m_tokens.append(match.captured(1).toLower());
+            pos += match.capturedLength();
+        }
+    }
+
+    bool parse(QVector<AlertEngine::Instruction> *program, quint32 *fields, QString *error)
+    {
+        if (m_error.isEmpty()) {
+            parseOr();
+        }
+        if (m_error.isEmpty() && m_pos < m_tokens.size()) {
+            m_error = QString("Unexpected '%1'").arg(m_tokens.at(m_pos));
+        }
+        if (m_error.isEmpty() && m_program.isEmpty()) {
+            m_error = "Empty expression";
+        }
+        if (m_error.isEmpty() && m_maxDepth > MaxStackDepth) {
+            m_error = "Expression too deeply nested";
+        }
+        if (!m_error.isEmpty()) {
+            if (error) {
+                *error = m_error;
+            }
+            return false;
+        }
+        *program = m_program;
+        *fields = m_fields;
+        return true;
+    }
+
+private:
+    QStringList m_tokens;
+    int m_pos = 0;
+    double m_hysteresis;
+    QVector<AlertEngine::Instruction> m_program;
+    quint32 m_fields = 0;
+    int m_depth = 0;
+    int m_maxDepth = 0;
+    QString m_error;
+
+    QString peek() const { return m_tokens.value(m_pos); }
+    QString next() { return m_tokens.value(m_pos++); }
+
+    void emitOp(AlertEngine::Instruction::Op op)
+    {
+        AlertEngine::Instruction instruction;
+        instruction.op = op;
+        m_program.append(instruction);
+        --m_depth;
+    }
+
+    void parseOr()
+    {
+        parseAnd();
+        while (m_error.isEmpty() && peek() == "or") {
+            next();
+            parseAnd();
+            emitOp(AlertEngine::Instruction::Or);
+        }
+    }
+
+    void parseAnd()
+    {
+        parsePrimary();
+        while (m_error.isEmpty() && peek() == "and") {
+            next();
+            parsePrimary();
+            emitOp(AlertEngine::Instruction::And);
+        }
+    }
+
+    void parsePrimary()
+    {
+        if (peek() == "(") {
+            next();
+            parseOr();
+            if (m_error.isEmpty() && next() != ")") {
+                m_error = "Missing ')'";
+            }
+            return;
+        }
+        parseComparison();
+    }
+
+    void parseComparison()
+    {
+        QString name = next();
+        if (name == "delta") {
+            if (next() != "(") {
+                m_error = "Expected '(' after delta";
+                return;
+            }
+            name = "delta(" + next() + ")";
+            if (next() != ")") {
+                m_error = "Missing ')' after delta";
+                return;
+            }
+        } else if (name == "temperature") {
+            name = "temp";
+        }
+
+        int field = -1;
+        for (int i = 0; i < AlertEngine::FieldCount; ++i) {
+            if (name == QLatin1String(Fields[i].name)) {
+                field = i;
+                break;
+            }
+        }
+        if (field < 0) {
+            m_error = name.isEmpty() ? QString("Expected a field") : QString("Unknown field '%1'").arg(name);
+            return;
+        }
+
+        AlertEngine::Instruction instruction;
+        const QString op = next();
+        if (op == "<" || op == "<=") {
+            instruction.below = true;
+        } else if (op != ">" && op != ">=") {
+            m_error = QString("Expected a comparison after '%1'").arg(name);
+            return;
+        }
+        instruction.inclusive = op.endsWith('=');
+
+        bool ok = false;
+        instruction.threshold = next().toDouble(&ok);
+        if (!ok) {
+            m_error = QString("Expected a number after '%1 %2'").arg(name, op);
+            return;
+        }
+
+        // Units are optional; wind is compared in km/h
+        const bool wind = field == AlertEngine::WindSpeed || field == AlertEngine::WindSpeedChange;
+        const QString unit = peek();
+        if (unit == "m/s" && wind) {
+            instruction.threshold *= 3.6;
+            next();
+        } else if ((unit == "km/h" && wind) || unit == "°c" || unit == "c" || unit == "%") {
+            next();
+        }
+
+        instruction.op = AlertEngine::Instruction::Compare;
+        instruction.field = quint8(field);
+        instruction.margin = m_hysteresis >= 0 ? m_hysteresis : Fields[field].defaultMargin;
+        m_program.append(instruction);
+        m_fields |= 1u << field;
+        m_maxDepth = qMax(m_maxDepth, ++m_depth);
+    }
+};
+
+} // namespace
+
+AlertEngine::AlertEngine(QObject *parent)
+    : QObject(parent)
+    , m_indexDirty(false)
+    , m_nextId(1)
+    , m_ruleCount(0)
+    , m_epoch(0)
+    , m_evaluations(0)
+    , m_suppressed(0)
+{
+}
+
+bool AlertEngine::compile(const QString &expression, double hysteresis,
+                          QVector<Instruction> *program, quint32 *fields, QString *error)
+{
+    RuleParser parser(expression, hysteresis);
+    return parser.parse(program, fields, error);
+}
+
+int AlertEngine::addRule(const Rule &rule, QString *error)
+{
+    CompiledRule compiled;
+    if (!compile(rule.expression, rule.hysteresis, &compiled.program, &compiled.fields, error)) {
+        return 0;
+    }
+    compiled.id = m_nextId++;
+    compiled.rule = rule;
+    compiled.cityIndex = rule.city.trimmed().isEmpty() ? -1 : cityIndex(rule.city);
+    m_rules.append(compiled);
+    ++m_ruleCount;
+    m_indexDirty = true;
+    return compiled.id;
+}
+
+bool AlertEngine::removeRule(int ruleId)
+{
+    for (int i = 0; i < m_rules.size(); ++i) {
+        CompiledRule &rule = m_rules[i];
+        if (rule.id != ruleId || !rule.alive) {
+            continue;
+        }
+        rule.alive = false;
+        rule.program.clear();
+        for (CityState &city : m_cities) {
+            city.active.remove(i);
+            city.lastRaised.remove(i);
+        }
+        --m_ruleCount;
+        m_indexDirty = true;
+        return true;
+    }
+    return false;
+}
+
+QString AlertEngine::defaultRulesPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/alert_rules.json";
+}
+
+int AlertEngine::loadRules(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.exists()) {
+        qDebug() << "No alert rules file:" << filePath;
+        return 0;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open alert rules file:" << filePath << file.errorString();
+        return 0;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isArray()) {
+        qWarning() << "Alert rules file must contain a JSON array:" << filePath;
+        return 0;
+    }
+
+    int added = 0;
+    const QJsonArray rules = doc.array();
+    for (const QJsonValue &value : rules) {
+        QJsonObject json = value.toObject();
+        Rule rule;
+        rule.expression = json["expression"].toString();
+        rule.name = json["name"].toString(rule.expression);
+        rule.city = json["city"].toString();
+        rule.hysteresis = json["hysteresis"].toDouble(-1);
+        rule.cooldownSecs = qint64(json["cooldown_minutes"].toDouble(60) * 60);
+
+        QString error;
+        if (addRule(rule, &error)) {
+            ++added;
+        } else {
+            qWarning() << "Skipping alert rule" << rule.name << ":" << error;
+        }
+    }
+    return added;
+}
+
+int AlertEngine::cityIndex(const QString &city)
+{
+    const QString key = FavoritesList::key(city);
+    auto it = m_cityKeys.constFind(key);
+    if (it != m_cityKeys.constEnd()) {
+        return it.value();
+    }
+
+    CityState state;
+    state.name = city.trimmed();
+    std::fill(state.values, state.values + FieldCount, qQNaN());
+    m_cities.append(state);
+    m_cityKeys.insert(key, m_cities.size() - 1);
+    return m_cities.size() - 1;
+}
+
+void AlertEngine::rebuildIndex()
+{
+    for (FieldIndex &index : m_index) {
+        index = FieldIndex();
+    }
+    m_cityRules.clear();
+
+    for (int i = 0; i < m_rules.size(); ++i) {
+        const CompiledRule &rule = m_rules.at(i);
+        if (!rule.alive) {
+            continue;
+        }
+        if (rule.cityIndex >= 0) {
+            m_cityRules[rule.cityIndex].append(i);
+            continue;
+        }
+        if (rule.program.size() == 1) {
+            const Instruction &compare = rule.program.first();
+            FieldIndex &index = m_index[compare.field];
+            (compare.below ? index.below : index.above).append({ compare.threshold, i });
+            index.maxMargin = qMax(index.maxMargin, compare.margin);
+            continue;
+        }
+        for (int field = 0; field < FieldCount; ++field) {
+            if (rule.fields & (1u << field)) {
+                m_index[field].compound.append(i);
+            }
+        }
+    }
+
+    for (FieldIndex &index : m_index) {
+        std::sort(index.below.begin(), index.below.end());
+        std::sort(index.above.begin(), index.above.end());
+    }
+    m_seen.fill(0, m_rules.size());
+    m_epoch = 0;
+    m_indexDirty = false;
+}
+
+void AlertEngine::updateWeather(const QString &city, const WeatherData &data, qint64 now)
+{
+    int index = cityIndex(city);
+    const double *previous = m_cities.at(index).values;
+
+    double values[FieldCount];
+    values[Temperature] = data.temperature();
+    values[FeelsLike] = data.feelsLike();
+    values[Humidity] = data.humidity();
+    values[WindSpeed] = data.windSpeed() * 3.6;
+    values[TemperatureChange] = values[Temperature] - previous[Temperature];
+    values[FeelsLikeChange] = values[FeelsLike] - previous[FeelsLike];
+    values[HumidityChange] = values[Humidity] - previous[Humidity];
+    values[WindSpeedChange] = values[WindSpeed] - previous[WindSpeed];
+
+    const quint32 updated = (1u << Temperature) | (1u << FeelsLike) | (1u << Humidity) | (1u << WindSpeed)
+        | (1u << TemperatureChange) | (1u << FeelsLikeChange) | (1u << HumidityChange) | (1u << WindSpeedChange);
+    apply(index, values, updated, now);
+}
+
+void AlertEngine::updateForecast(const QString &city, const ForecastData &data, qint64 now)
+{
+    double low = qQNaN();
+    double high = qQNaN();
+    const QList<ForecastItem> items = data.items();
+    for (const ForecastItem &item : items) {
+        // Includes the 3 h slot already in progress
+        qint64 at = item.dateTime().toSecsSinceEpoch();
+        if (at < now - 3 * 3600 || at > now + 24 * 3600) {
+            continue;
+        }
+        low = qIsNaN(low) ? item.tempMin() : qMin(low, item.tempMin());
+        high = qIsNaN(high) ? item.tempMax() : qMax(high, item.tempMax());
+    }
+
+    double values[FieldCount];
+    values[ForecastMin] = low;
+    values[ForecastMax] = high;
+    apply(cityIndex(city), values, (1u << ForecastMin) | (1u << ForecastMax), now);
+}
+
+void AlertEngine::addCandidate(int rule)
+{
+    if (m_seen[rule] != m_epoch) {
+        m_seen[rule] = m_epoch;
+        m_candidates.append(rule);
+    }
+}
+
+void AlertEngine::addRange(const QVector<Threshold> &thresholds, double low, double high)
+{
+    auto first = std::lower_bound(thresholds.begin(), thresholds.end(), Threshold{ low, 0 });
+    for (auto it = first; it != thresholds.end() && it->value <= high; ++it) {
+        addCandidate(it->rule);
+    }
+}
+
+void AlertEngine::apply(int cityIndex, const double *values, quint32 updated, qint64 now)
+{
+    static LatencyHistogram *histogram = Metrics::histogram("alerts.update");
+    ScopedLatency timer(histogram);
+
+    if (m_indexDirty) {
+        rebuildIndex();
+    }
+    if (++m_epoch == 0) {
+        // Wrapped; stale marks could collide with the new epoch
+        m_seen.fill(0);
+        m_epoch = 1;
+    }
+    m_candidates.clear();
+
+    const double infinity = std::numeric_limits<double>::infinity();
+    CityState &city = m_cities[cityIndex];
+    quint32 changed = 0;
+
+    for (int field = 0; field < FieldCount; ++field) {
+        if (!(updated & (1u << field))) {
+            continue;
+        }
+        const double before = city.values[field];
+        const double after = values[field];
+        if (sameValue(before, after)) {
+            continue;
+        }
+        changed |= 1u << field;
+        city.values[field] = after;
+
+        const FieldIndex &index = m_index[field];
+        if (qIsNaN(after)) {
+            // Only rules that are active can change when a value goes away
+            for (auto it = city.active.constBegin(); it != city.active.constEnd(); ++it) {
+                if (m_rules.at(it.key()).fields & (1u << field)) {
+                    addCandidate(it.key());
+                }
+            }
+            continue;
+        }
+
+        // A single comparison can only flip if its threshold, or threshold
+        // plus margin, lies between the old and new value. With no old
+        // value every rule that is now true fires.
+        const bool fresh = qIsNaN(before);
+        const double low = (fresh ? after : qMin(before, after)) - index.maxMargin;
+        const double high = (fresh ? after : qMax(before, after)) + index.maxMargin;
+        addRange(index.below, low, fresh ? infinity : high);
+        addRange(index.above, fresh ? -infinity : low, high);
+        for (int rule : index.compound) {
+            addCandidate(rule);
+        }
+    }
+
+    if (changed) {
+        const QVector<int> cityRules = m_cityRules.value(cityIndex);
+        for (int rule : cityRules) {
+            if (m_rules.at(rule).fields & changed) {
+                addCandidate(rule);
+            }
+        }
+    }
+
+    for (int rule : std::as_const(m_candidates)) {
+        evaluate(rule, cityIndex, now);
+    }
+}
+
+bool AlertEngine::run(const QVector<Instruction> &program, const double *values, bool active)
+{
+    bool stack[MaxStackDepth];
+    int depth = 0;
+
+    for (const Instruction &instruction : program) {
+        switch (instruction.op) {
+        case Instruction::Compare: {
+            const double value = values[instruction.field];
+            // Active rules stay true until the value is back past the margin
+            const double margin = active ? instruction.margin : 0;
+            bool result;
+            if (instruction.below) {
+                const double limit = instruction.threshold + margin;
+                result = instruction.inclusive ? value <= limit : value < limit;
+            } else {
+                const double limit = instruction.threshold - margin;
+                result = instruction.inclusive ? value >= limit : value > limit;
+            }
+            stack[depth++] = result;   // NaN compares false
+            break;
+        }
+        case Instruction::And:
+            --depth;
+            stack[depth - 1] = stack[depth - 1] && stack[depth];
+            break;
+        case Instruction::Or:
+            --depth;
+            stack[depth - 1] = stack[depth - 1] || stack[depth];
+            break;
+        }
+    }
+    return depth == 1 && stack[0];
+}
+
+void AlertEngine::evaluate(int rule, int cityIndex, qint64 now)
+{
+    const CompiledRule &compiled = m_rules.at(rule);
+    CityState &city = m_cities[cityIndex];
+    if (!compiled.alive) {
+        return;
+    }
+
+    const bool wasActive = city.active.contains(rule);
+    const bool isActive = run(compiled.program, city.values, wasActive);
+    ++m_evaluations;
+    if (isActive == wasActive) {
+        return;
+    }
+
+    Alert alert;
+    alert.ruleId = compiled.id;
+    alert.rule = compiled.rule.name;
+    alert.city = city.name;
+
+    if (isActive) {
+        city.active.insert(rule, now);
+        alert.since = now;
+        auto last = city.lastRaised.constFind(rule);
+        if (last != city.lastRaised.constEnd() && now - last.value() < compiled.rule.cooldownSecs) {
+            // Flapping within the cooldown: track it, but stay quiet
+            ++m_suppressed;
+            return;
+        }
+        city.lastRaised.insert(rule, now);
+        emit alertRaised(alert);
+    } else {
+        alert.since = city.active.take(rule);
+        // Only clear what was announced
+        if (city.lastRaised.value(rule, -1) >= alert.since) {
+            emit alertCleared(alert);
+        }
+    }
+}
+
+QList<AlertEngine::Alert> AlertEngine::activeAlerts() const
+{
+    QList<Alert> alerts;
+    for (const CityState &city : m_cities) {
+        for (auto it = city.active.constBegin(); it != city.active.constEnd(); ++it) {
+            Alert alert;
+            alert.ruleId = m_rules.at(it.key()).id;
+            alert.rule = m_rules.at(it.key()).rule.name;
+            alert.city = city.name;
+            alert.since = it.value();
+            alerts.append(alert);
+        }
+    }
+    return alerts;
+}
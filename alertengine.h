@@ -0,0 +1,150 @@
+#ifndef ALERTENGINE_H
+#define ALERTENGINE_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QDateTime>
+#include "weatherdata.h"
+#include "forecastdata.h"
+
+// Threshold and trend alerts over weather and forecast fields, e.g.
+// "temp < 0", "wind > 60 km/h" or "delta(temp) < -5 and humidity > 90".
+//
+// Rules are compiled to a small postfix program. Single-comparison rules
+// are indexed by field and threshold, so an update only re-evaluates rules
+// whose threshold lies between the old and new value; compound rules are
+// re-evaluated when a field they read changes. An alert is raised once
+// when its rule becomes true, stays active until the values move back past
+// the hysteresis margin, and is not raised again for the same city within
+// the cooldown.
+class AlertEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Field {
+        Temperature,
+        FeelsLike,
+        Humidity,
+        WindSpeed,          // km/h
+        ForecastMin,        // lowest temperature over the next 24 h
+        ForecastMax,        // highest temperature over the next 24 h
+        TemperatureChange,  // since the previous observation
+        FeelsLikeChange,
+        HumidityChange,
+        WindSpeedChange,
+        FieldCount
+    };
+
+    struct Rule {
+        QString name;
+        QString expression;
+        QString city;               // display name, empty for every city
+        double hysteresis = -1;     // in the field's unit, < 0 uses the field default
+        qint64 cooldownSecs = 3600; // between notifications for one city
+    };
+
+    // One step of a compiled expression, evaluated on a small bool stack
+    struct Instruction {
+        enum Op : quint8 { Compare, And, Or };
+        Op op = Compare;
+        quint8 field = 0;
+        bool below = false;     // < or <=, otherwise > or >=
+        bool inclusive = false;
+        double threshold = 0;
+        double margin = 0;
+    };
+
+    struct Alert {
+        int ruleId = 0;
+        QString rule;
+        QString city;
+        qint64 since = 0;
+    };
+
+    explicit AlertEngine(QObject *parent = nullptr);
+
+    // Returns the rule ID, or 0 with a message if the expression is invalid
+    int addRule(const Rule &rule, QString *error = nullptr);
+    bool removeRule(int ruleId);
+    int ruleCount() const { return m_ruleCount; }
+
+    // JSON array of {name, expression, city, hysteresis, cooldown_minutes};
+    // returns the number of rules added
+    int loadRules(const QString &filePath);
+    static QString defaultRulesPath();
+
+    void updateWeather(const QString &city, const WeatherData &data,
+                       qint64 now = QDateTime::currentSecsSinceEpoch());
+    void updateForecast(const QString &city, const ForecastData &data,
+                        qint64 now = QDateTime::currentSecsSinceEpoch());
+
+    QList<Alert> activeAlerts() const;
+    quint64 evaluations() const { return m_evaluations; }
+    quint64 suppressed() const { return m_suppressed; }
+
+signals:
+    void alertRaised(const AlertEngine::Alert &alert);
+    void alertCleared(const AlertEngine::Alert &alert);
+
+private:
+    struct CompiledRule {
+        int id = 0;
+        Rule rule;
+        QVector<Instruction> program;
+        quint32 fields = 0;     // bit per Field read
+        int cityIndex = -1;
+        bool alive = true;
+    };
+
+    struct CityState {
+        QString name;
+        double values[FieldCount];
+        QHash<int, qint64> active;      // rule index -> since
+        QHash<int, qint64> lastRaised;  // rule index -> time of last notification
+    };
+
+    struct Threshold {
+        double value;
+        int rule;
+        bool operator<(const Threshold &other) const { return value < other.value; }
+    };
+
+    struct FieldIndex {
+        QVector<Threshold> below;   // fires when the value drops under the threshold
+        QVector<Threshold> above;   // fires when the value rises over the threshold
+        double maxMargin = 0;
+        QVector<int> compound;
+    };
+
+    QVector<CompiledRule> m_rules;
+    QVector<CityState> m_cities;
+    QHash<QString, int> m_cityKeys;
+    FieldIndex m_index[FieldCount];
+    QHash<int, QVector<int>> m_cityRules;   // city index -> rules for that city only
+    bool m_indexDirty;
+    int m_nextId;
+    int m_ruleCount;
+
+    // Dedupes candidates within one update
+    QVector<quint32> m_seen;
+    QVector<int> m_candidates;
+    quint32 m_epoch;
+
+    quint64 m_evaluations;
+    quint64 m_suppressed;
+
+    static bool compile(const QString &expression, double hysteresis,
+                        QVector<Instruction> *program, quint32 *fields, QString *error);
+    static bool run(const QVector<Instruction> &program, const double *values, bool active);
+
+    int cityIndex(const QString &city);
+    void rebuildIndex();
+    void apply(int cityIndex, const double *values, quint32 updated, qint64 now);
+    void addCandidate(int rule);
+    void addRange(const QVector<Threshold> &thresholds, double low, double high);
+    void evaluate(int rule, int cityIndex, qint64 now);
+};
+
+#endif // ALERTENGINE_H
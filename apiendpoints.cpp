@@ -0,0 +1,51 @@
+#include "apiendpoints.h"
+#include <QtGlobal>
+
+const char *ApiEndpoints::DefaultApiBaseUrl = "https://api.openweathermap.org";
+const char *ApiEndpoints::DefaultIconBaseUrl = "https://openweathermap.org";
+
+static QString withoutTrailingSlash(QString url)
+{
+    while (url.endsWith('/')) {
+        url.chop(1);
+    }
+    return url;
+}
+
+QString ApiEndpoints::apiBaseUrl()
+{
+    QString url = qEnvironmentVariable("OPENWEATHERMAP_BASE_URL");
+    return url.isEmpty() ? QString(DefaultApiBaseUrl) : withoutTrailingSlash(url);
+}
+
+QString ApiEndpoints::iconBaseUrl()
+{
+    QString url = qEnvironmentVariable("OPENWEATHERMAP_ICON_BASE_URL");
+    if (!url.isEmpty()) {
+        return withoutTrailingSlash(url);
+    }
+
+    // A proxy configured for the API serves icons as well
+    url = qEnvironmentVariable("OPENWEATHERMAP_BASE_URL");
+    return url.isEmpty() ? QString(DefaultIconBaseUrl) : withoutTrailingSlash(url);
+}
+
+QString ApiEndpoints::weatherUrl(const QString &baseUrl)
+{
+    return baseUrl + "/data/2.5/weather";
+}
+
+QString ApiEndpoints::forecastUrl(const QString &baseUrl)
+{
+    return baseUrl + "/data/2.5/forecast";
+}
+
+QString ApiEndpoints::geocodingUrl(const QString &baseUrl)
+{
+    return baseUrl + "/geo/1.0/direct";
+}
+
+QString ApiEndpoints::iconUrl(const QString &iconCode, const QString &baseUrl)
+{
+    return QString("%1/img/wn/%2@2x.png").arg(baseUrl, iconCode);
+}
@@ -0,0 +1,24 @@
+#ifndef APIENDPOINTS_H
+#define APIENDPOINTS_H
+
+#include <QString>
+
+// OpenWeatherMap endpoints. OPENWEATHERMAP_BASE_URL points the app at a
+// mirror or caching proxy; icons follow it unless
+// OPENWEATHERMAP_ICON_BASE_URL is set.
+class ApiEndpoints
+{
+public:
+    static QString apiBaseUrl();
+    static QString iconBaseUrl();
+
+    static QString weatherUrl(const QString &baseUrl = apiBaseUrl());
+    static QString forecastUrl(const QString &baseUrl = apiBaseUrl());
+    static QString geocodingUrl(const QString &baseUrl = apiBaseUrl());
+    static QString iconUrl(const QString &iconCode, const QString &baseUrl = iconBaseUrl());
+
+    static const char *DefaultApiBaseUrl;
+    static const char *DefaultIconBaseUrl;
+};
+
+#endif // APIENDPOINTS_H
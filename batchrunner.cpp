@@ -0,0 +1,328 @@
+#include "batchrunner.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QRegularExpression>
+#include <QDebug>
+#include <cstdio>
+#include <algorithm>
+
+namespace {
+
+QJsonObject weatherToJson(const WeatherData &data)
+{
+    QJsonObject json;
+    json["temperature"] = data.temperature();
+    json["feels_like"] = data.feelsLike();
+    json["humidity"] = data.humidity();
+    json["wind_speed"] = data.windSpeed();
+    json["description"] = data.description();
+    json["icon"] = data.iconCode();
+    return json;
+}
+
+QJsonArray forecastToJson(const ForecastData &data)
+{
+    QJsonArray items;
+    for (const ForecastItem &item : data.items()) {
+        QJsonObject json;
+        json["date"] = item.dateTime().toString(Qt::ISODate);
+        json["temp_min"] = item.tempMin();
+        json["temp_max"] = item.tempMax();
+        json["description"] = item.description();
+        json["icon"] = item.iconCode();
+        items.append(json);
+    }
+    return items;
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_service(new WeatherService(this))
+    , m_inputDone(false)
+    , m_finished(false)
+    , m_nextJobId(1)
+    , m_inFlight(0)
+    , m_tokens(0)
+    , m_rateTimer(new QTimer(this))
+    , m_locationsDone(0)
+    , m_locationsFailed(0)
+    , m_requestsSent(0)
+    , m_requestsFailed(0)
+{
+    m_options.concurrency = qMax(1, m_options.concurrency);
+
+    connect(m_service, &WeatherService::weatherReplyReady,
+            this, &BatchRunner::onWeatherReply);
+    connect(m_service, &WeatherService::forecastReplyReady,
+            this, &BatchRunner::onForecastReply);
+    connect(m_service, &WeatherService::requestFailed,
+            this, &BatchRunner::onRequestFailed);
+
+    m_rateTimer->setSingleShot(true);
+    connect(m_rateTimer, &QTimer::timeout, this, &BatchRunner::pump);
+}
+
+CityResult BatchRunner::parseLocation(const QString &line)
+{
+    static const QRegularExpression coordinates("^\\s*(-?\\d+(?:\\.\\d+)?)\\s*,\\s*(-?\\d+(?:\\.\\d+)?)\\s*$");
+    static const QRegularExpression cityId("^\\s*(\\d+)\\s*$");
+
+    CityResult location;
+    QRegularExpressionMatch match = coordinates.match(line);
+    if (match.hasMatch()) {
+        location.lat = match.captured(1).toDouble();
+        location.lon = match.captured(2).toDouble();
+        location.name = line.trimmed();
+        return location;
+    }
+
+    match = cityId.match(line);
+    if (match.hasMatch()) {
+        location.cityId = match.captured(1).toInt();
+        location.name = line.trimmed();
+        return location;
+    }
+
+    return CityResult::fromDisplayName(line.trimmed());
+}
+
+void BatchRunner::start()
+{
+    if (qgetenv("OPENWEATHERMAP_API_KEY").isEmpty()) {
+        qCritical() << "OPENWEATHERMAP_API_KEY environment variable is not set. See README.";
+        emit finished(1);
+        return;
+    }
+
+    bool opened = false;
+    if (m_options.inputPath == "-") {
+        opened = m_input.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+    } else {
+        m_input.setFileName(m_options.inputPath);
+        opened = m_input.open(QIODevice::ReadOnly | QIODevice::Text);
+    }
+    if (!opened) {
+        qCritical() << "Cannot read" << m_options.inputPath << ":" << m_input.errorString();
+        emit finished(1);
+        return;
+    }
+    m_inputStream.setDevice(&m_input);
+
+    if (!m_output.open(stdout, QIODevice::WriteOnly)) {
+        qCritical() << "Cannot write to stdout";
+        emit finished(1);
+        return;
+    }
+
+    m_tokens = qMax(1.0, m_options.rateLimit);
+    m_refillTimer.start();
+    m_runTimer.start();
+    pump();
+}
+
+bool BatchRunner::readNextJob()
+{
+    // Lines are read lazily so huge inputs never sit in memory
+    while (!m_inputStream.atEnd()) {
+        QString line = m_inputStream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        int jobId = m_nextJobId++;
+        Job &job = m_jobs[jobId];
+        job.input = line;
+        job.location = parseLocation(line);
+        job.timer.start();
+
+        m_queue.enqueue({jobId, false});
+        if (m_options.includeForecast) {
+            m_queue.enqueue({jobId, true});
+        }
+        return true;
+    }
+
+    m_inputDone = true;
+    return false;
+}
+
+bool BatchRunner::takeToken()
+{
+    if (m_options.rateLimit <= 0) {
+        return true;
+    }
+
+    // Refill at rateLimit tokens per second, bursting up to one second's worth
+    double elapsed = m_refillTimer.nsecsElapsed() / 1e9;
+    m_refillTimer.restart();
+    m_tokens = qMin(qMax(1.0, m_options.rateLimit), m_tokens + elapsed * m_options.rateLimit);
+
+    if (m_tokens >= 1.0) {
+        m_tokens -= 1.0;
+        return true;
+    }
+
+    if (!m_rateTimer->isActive()) {
+        int waitMs = qMax(1, int((1.0 - m_tokens) / m_options.rateLimit * 1000.0));
+        m_rateTimer->start(waitMs);
+    }
+    return false;
+}
+
+void BatchRunner::pump()
+{
+    while (m_inFlight < m_options.concurrency) {
+        if (m_queue.isEmpty() && (m_inputDone || !readNextJob())) {
+            break;
+        }
+        if (!takeToken()) {
+            return;
+        }
+
+        PendingRequest next = m_queue.dequeue();
+        Job &job = m_jobs[next.jobId];
+
+        quint64 requestId = next.forecast ? m_service->fetchForecast(job.location)
+                                          : m_service->fetchWeather(job.location);
+        if (requestId == 0) {
+            // Rejected before sending, e.g. an empty line after parsing.
+            // Not a request, so only the location counts as failed.
+            job.errors.append("Invalid location");
+            if (job.pendingRequests == 0 && !isQueued(next.jobId)) {
+                writeResult(job);
+                m_jobs.remove(next.jobId);
+            }
+            continue;
+        }
+        m_requestsSent++;
+        job.pendingRequests++;
+
+        m_requestJobs.insert(requestId, next.jobId);
+        m_inFlight++;
+    }
+
+    if (m_inFlight == 0 && m_queue.isEmpty() && m_inputDone && !m_finished) {
+        finish();
+    }
+}
+
+void BatchRunner::onWeatherReply(quint64 requestId, const WeatherData &data)
+{
+    auto it = m_requestJobs.constFind(requestId);
+    if (it != m_requestJobs.constEnd()) {
+        m_jobs[it.value()].weather = data;
+    }
+    completeRequest(requestId, QString());
+}
+
+void BatchRunner::onForecastReply(quint64 requestId, const ForecastData &data)
+{
+    auto it = m_requestJobs.constFind(requestId);
+    if (it != m_requestJobs.constEnd()) {
+        m_jobs[it.value()].forecast = data;
+    }
+    completeRequest(requestId, QString());
+}
+
+void BatchRunner::onRequestFailed(quint64 requestId, const QString &error)
+{
+    completeRequest(requestId, error);
+}
+
+void BatchRunner::completeRequest(quint64 requestId, const QString &error)
+{
+    auto it = m_requestJobs.find(requestId);
+    if (it == m_requestJobs.end()) {
+        return;
+    }
+
+    int jobId = it.value();
+    m_requestJobs.erase(it);
+    m_inFlight--;
+
+    Job &job = m_jobs[jobId];
+    job.pendingRequests--;
+    if (!error.isEmpty()) {
+        job.errors.append(error);
+        m_requestsFailed++;
+        m_failureReasons[QString(error).replace(QRegularExpression("\\d+"), "N")]++;
+    }
+
+    // A job is done once nothing for it is in flight or still queued
+    if (job.pendingRequests == 0 && !isQueued(jobId)) {
+        writeResult(job);
+        m_jobs.remove(jobId);
+    }
+
+    pump();
+}
+
+bool BatchRunner::isQueued(int jobId) const
+{
+    // Weather and forecast are queued back to back, so only the head matters
+    for (int i = 0; i < qMin(2, m_queue.size()); ++i) {
+        if (m_queue.at(i).jobId == jobId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BatchRunner::writeResult(const Job &job)
+{
+    QJsonObject json;
+    json["input"] = job.input;
+
+    if (job.weather.isValid()) {
+        json["city"] = job.weather.cityName();
+        json["country"] = job.weather.country();
+        json["id"] = job.weather.cityId();
+        json["lat"] = job.weather.lat();
+        json["lon"] = job.weather.lon();
+        json["weather"] = weatherToJson(job.weather);
+    }
+    if (m_options.includeForecast && job.forecast.count() > 0) {
+        json["forecast"] = forecastToJson(job.forecast);
+    }
+    if (!job.errors.isEmpty()) {
+        json["error"] = job.errors.join("; ");
+        m_locationsFailed++;
+    }
+    json["elapsed_ms"] = double(job.timer.elapsed());
+
+    m_locationsDone++;
+
+    // One line per location, flushed so consumers see it immediately
+    m_output.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    m_output.write("\n");
+    m_output.flush();
+}
+
+void BatchRunner::finish()
+{
+    m_finished = true;
+    double seconds = qMax(0.001, m_runTimer.nsecsElapsed() / 1e9);
+
+    fprintf(stderr, "batch: %d locations (%d failed), %d requests (%d failed) in %.2f s, "
+                    "%.1f locations/s, %.1f requests/s\n",
+            m_locationsDone, m_locationsFailed, m_requestsSent, m_requestsFailed, seconds,
+            m_locationsDone / seconds, m_requestsSent / seconds);
+
+    // Most common failure reasons first
+    QList<QPair<int, QString>> reasons;
+    for (auto it = m_failureReasons.constBegin(); it != m_failureReasons.constEnd(); ++it) {
+        reasons.append(qMakePair(it.value(), it.key()));
+    }
+    std::sort(reasons.begin(), reasons.end(), [](const QPair<int, QString> &a, const QPair<int, QString> &b) {
+        return a.first > b.first;
+    });
+    for (int i = 0; i < qMin(5, reasons.size()); ++i) {
+        fprintf(stderr, "batch: %6d x %s\n", reasons.at(i).first, qPrintable(reasons.at(i).second));
+    }
+
+    emit finished(m_locationsFailed > 0 ? 2 : 0);
+}
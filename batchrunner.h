@@ -0,0 +1,96 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTextStream>
+#include <QHash>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "weatherservice.h"
+
+// Headless bulk fetch: reads one location per line, fetches weather and
+// forecast with bounded concurrency and a request rate limit, and writes
+// one NDJSON line per location to stdout as soon as it completes.
+class BatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString inputPath;      // "-" reads stdin
+        int concurrency = 8;    // max requests in flight
+        double rateLimit = 0;   // requests per second, 0 = unlimited
+        bool includeForecast = true;
+    };
+
+    explicit BatchRunner(const Options &options, QObject *parent = nullptr);
+
+    // Parses "City, State, Country", "lat,lon" or a numeric city ID
+    static CityResult parseLocation(const QString &line);
+
+public slots:
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onWeatherReply(quint64 requestId, const WeatherData &data);
+    void onForecastReply(quint64 requestId, const ForecastData &data);
+    void onRequestFailed(quint64 requestId, const QString &error);
+    void pump();
+
+private:
+    struct Job {
+        QString input;
+        CityResult location;
+        WeatherData weather;
+        ForecastData forecast;
+        int pendingRequests = 0;
+        QStringList errors;
+        QElapsedTimer timer;
+    };
+
+    struct PendingRequest {
+        int jobId;
+        bool forecast;
+    };
+
+    Options m_options;
+    WeatherService *m_service;
+    QFile m_input;
+    QTextStream m_inputStream;
+    QFile m_output;
+    bool m_inputDone;
+    bool m_finished;
+
+    QHash<int, Job> m_jobs;
+    QHash<quint64, int> m_requestJobs;
+    QQueue<PendingRequest> m_queue;
+    int m_nextJobId;
+    int m_inFlight;
+
+    // Token bucket for the rate limit
+    double m_tokens;
+    QElapsedTimer m_refillTimer;
+    QTimer *m_rateTimer;
+
+    QElapsedTimer m_runTimer;
+    int m_locationsDone;
+    int m_locationsFailed;
+    int m_requestsSent;
+    int m_requestsFailed;
+    // Failure count by message, numbers masked so retry times group together
+    QHash<QString, int> m_failureReasons;
+
+    bool readNextJob();
+    bool takeToken();
+    bool isQueued(int jobId) const;
+    void completeRequest(quint64 requestId, const QString &error);
+    void writeResult(const Job &job);
+    void finish();
+};
+
+#endif // BATCHRUNNER_H
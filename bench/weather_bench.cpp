@@ -0,0 +1,408 @@
+// Microbenchmarks for the weather_core library.
+//
+// Prints one JSON document with ns/op statistics per case, so results
+// can be stored and compared between releases:
+//   weather_bench [--filter parse] [--min-time 500] [--output results.json]
+
+#include "weatherparser.h"
+#include "forecaststream.h"
+#include "favoriteswriter.h"
+#include "favoriteslist.h"
+#include "locationmanager.h"
+#include "spatialindex.h"
+#include "alertengine.h"
+#include "rollingstats.h"
+#include "tracer.h"
+#include "weatherfutures.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QTextStream>
+#include <QLoggingCategory>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    QString filter;
+    qint64 minTimeMs = 500;
+};
+
+class BenchRunner
+{
+public:
+    explicit BenchRunner(const BenchOptions &options) : m_options(options) {}
+
+    // fn runs one operation; fast cases are batched so each sample is
+    // long enough for the clock
+    void run(const QString &name, const std::function<void()> &fn)
+    {
+        if (!m_options.filter.isEmpty() && !name.contains(m_options.filter)) {
+            return;
+        }
+
+        // Warm up and calibrate the batch size to ~50 us per sample
+        qint64 batch = 1;
+        QElapsedTimer timer;
+        for (;;) {
+            timer.start();
+            for (qint64 i = 0; i < batch; ++i) {
+                fn();
+            }
+            if (timer.nsecsElapsed() >= 50000 || batch >= (1 << 20)) {
+                break;
+            }
+            batch *= 2;
+        }
+
+        std::vector<double> samples;
+        QElapsedTimer total;
+        total.start();
+        while (total.elapsed() < m_options.minTimeMs || samples.size() < 10) {
+            timer.start();
+            for (qint64 i = 0; i < batch; ++i) {
+                fn();
+            }
+            samples.push_back(double(timer.nsecsElapsed()) / double(batch));
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double sample : samples) {
+            sum += sample;
+        }
+
+        QJsonObject nsPerOp;
+        nsPerOp["mean"] = sum / samples.size();
+        nsPerOp["median"] = samples[samples.size() / 2];
+        nsPerOp["p90"] = samples[qMin(samples.size() - 1, samples.size() * 9 / 10)];
+        nsPerOp["min"] = samples.front();
+
+        QJsonObject result;
+        result["name"] = name;
+        result["iterations"] = double(qint64(samples.size()) * batch);
+        result["ns_per_op"] = nsPerOp;
+        m_results.append(result);
+
+        QTextStream(stderr) << QString("%1 %2 ns/op\n").arg(name, -32).arg(samples[samples.size() / 2], 0, 'f', 0);
+    }
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    BenchOptions m_options;
+    QJsonArray m_results;
+};
+
+QByteArray readFixture(const QString &dir, const QString &name)
+{
+    QFile file(dir + "/" + name);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qFatal("Missing fixture %s", qPrintable(file.fileName()));
+    }
+    return file.readAll();
+}
+
+// Runs the event loop until future finishes, as the GUI would. False
+// if it takes longer than a second.
+template<typename T>
+bool waitFor(const QFuture<T> &future)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!future.isFinished() && timer.elapsed() < 1000) {
+        QCoreApplication::processEvents();
+    }
+    return future.isFinished();
+}
+
+// Behaviour the futures benchmark relies on: values flow through chain()
+// and whenBoth(), and canceling a chain cancels the step it is waiting on
+bool checkFutures()
+{
+    QFuture<QString> chained = Futures::chain(Futures::ready(2), [](int value) {
+        return Futures::ready(QString::number(value * 21));
+    });
+    QString text;
+    if (!waitFor(chained) || !Futures::takeResult(chained, &text) || text != "42") {
+        return false;
+    }
+
+    auto both = Futures::whenBoth(Futures::ready(1), Futures::ready(QString("a")));
+    QPair<int, QString> pair;
+    if (!waitFor(both) || !Futures::takeResult(both, &pair) || pair != qMakePair(1, QString("a"))) {
+        return false;
+    }
+
+    QFutureInterface<int> pending;
+    pending.reportStarted();
+    QFuture<int> canceled = Futures::chain(pending.future(), [](int value) {
+        return Futures::ready(value);
+    });
+    canceled.cancel();
+    WeatherError error(QString{});
+    int value = 0;
+    const bool ok = waitFor(canceled) && !Futures::takeResult(canceled, &value, &error)
+        && error.isCanceled() && pending.isCanceled();
+    pending.reportFinished();
+    return ok;
+}
+
+QList<CityResult> syntheticFavorites(int count)
+{
+    QList<CityResult> cities;
+    cities.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        CityResult city;
+        city.name = QString("City %1").arg(i);
+        city.state = QString("State %1").arg(i % 50);
+        city.country = "BR";
+        city.lat = -30.0 + (i % 600) * 0.1;
+        city.lon = -51.0 + (i / 600) * 0.1;
+        city.cityId = 3000000 + i;
+        cities.append(city);
+    }
+    return cities;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("weather_bench");
+
+    // Keep per-call qDebug output out of the measurements
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("weather_core microbenchmarks");
+    parser.addHelpOption();
+    QCommandLineOption filterOption("filter", "Only run cases whose name contains <text>.", "text");
+    QCommandLineOption minTimeOption("min-time", "Minimum time per case in ms.", "ms", "500");
+    QCommandLineOption fixturesOption("fixtures", "Directory with recorded responses.", "dir", WEATHER_BENCH_FIXTURES);
+    QCommandLineOption outputOption("output", "Write JSON results to <file> instead of stdout.", "file");
+    parser.addOptions({filterOption, minTimeOption, fixturesOption, outputOption});
+    parser.process(app);
+
+    BenchOptions options;
+    options.filter = parser.value(filterOption);
+    options.minTimeMs = parser.value(minTimeOption).toLongLong();
+    BenchRunner bench(options);
+
+    // Parsers on recorded responses
+    QString fixtures = parser.value(fixturesOption);
+    const QByteArray weatherJson = readFixture(fixtures, "weather.json");
+    const QByteArray forecastJson = readFixture(fixtures, "forecast.json");
+    const QByteArray geocodingJson = readFixture(fixtures, "geocoding.json");
+
+    bench.run("parse.weather", [&]() {
+        WeatherData data = WeatherParser::parseWeatherData(weatherJson);
+        Q_UNUSED(data);
+    });
+    bench.run("parse.forecast", [&]() {
+        ForecastData data = WeatherParser::parseForecastData(forecastJson);
+        Q_UNUSED(data);
+    });
+    // Same response in TCP-segment-sized chunks, as it arrives from the network
+    bench.run("parse.forecast.stream", [&]() {
+        ForecastStream stream;
+        for (int offset = 0; offset < forecastJson.size(); offset += 1460) {
+            stream.feed(forecastJson.mid(offset, 1460));
+        }
+        Q_UNUSED(stream.forecast());
+    });
+    bench.run("parse.geocoding", [&]() {
+        QList<CityResult> results = WeatherParser::parseGeocodingResults(geocodingJson);
+        Q_UNUSED(results);
+    });
+
+    // Favorites persistence and index
+    QTemporaryDir tempDir;
+    const int sizes[] = { 10, 1000, 10000, 100000 };
+    for (int size : sizes) {
+        const QList<CityResult> cities = syntheticFavorites(size);
+        const QString filePath = tempDir.filePath(QString("favorites-%1.json").arg(size));
+
+        FavoritesWriter writer(filePath);
+        bench.run(QString("favorites.save/%1").arg(size), [&]() {
+            writer.writeFile(cities);
+        });
+
+        writer.writeFile(cities);
+        LocationManager manager(filePath);
+        bench.run(QString("favorites.load/%1").arg(size), [&]() {
+            manager.loadFavorites();
+        });
+
+        bench.run(QString("favorites.index_build/%1").arg(size), [&]() {
+            FavoritesList list;
+            list.reset(cities);
+        });
+
+        FavoritesList list;
+        list.reset(cities);
+        int probe = 0;
+        bench.run(QString("favorites.lookup/%1").arg(size), [&]() {
+            bool found = list.contains(cities.at(probe).displayName());
+            Q_UNUSED(found);
+            probe = (probe + 7919) % size;
+        });
+    }
+
+    // Spatial index over uniformly spread points
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> latitude(-90, 90);
+    std::uniform_real_distribution<double> longitude(-180, 180);
+    QVector<SpatialIndex::Point> points;
+    const int pointCount = 200000;
+    points.reserve(pointCount);
+    for (int i = 0; i < pointCount; ++i) {
+        points.append({latitude(rng), longitude(rng), i});
+    }
+
+    bench.run(QString("spatial.build/%1").arg(pointCount), [&]() {
+        SpatialIndex index;
+        index.build(points);
+    });
+
+    SpatialIndex index;
+    index.build(points);
+    bench.run("spatial.nearest/k8", [&]() {
+        QVector<SpatialIndex::Neighbor> neighbors = index.nearest(latitude(rng), longitude(rng), 8);
+        Q_UNUSED(neighbors);
+    });
+    bench.run("spatial.radius/100km", [&]() {
+        QVector<SpatialIndex::Neighbor> neighbors = index.withinRadius(latitude(rng), longitude(rng), 100);
+        Q_UNUSED(neighbors);
+    });
+
+    // Alert rules: one refresh cycle over every city, with small drifts
+    // like consecutive observations
+    {
+        AlertEngine alerts;
+        std::uniform_real_distribution<double> threshold(-20, 40);
+        std::uniform_real_distribution<double> drift(-0.5, 0.5);
+        const int ruleCount = 10000;
+        const int cityCount = 2000;
+        for (int i = 0; i < ruleCount; ++i) {
+            AlertEngine::Rule rule;
+            rule.name = QString("rule %1").arg(i);
+            if (i % 5 == 4) {
+                rule.expression = QString("temp < %1 and wind > %2").arg(threshold(rng)).arg(20 + i % 60);
+            } else if (i % 2) {
+                rule.expression = QString("temp > %1").arg(threshold(rng));
+            } else {
+                rule.expression = QString("wind > %1 km/h").arg(10 + i % 90);
+            }
+            alerts.addRule(rule);
+        }
+
+        QVector<QString> cityNames;
+        QVector<WeatherData> cityWeather;
+        for (int i = 0; i < cityCount; ++i) {
+            WeatherData data;
+            data.setCityName(QString("City %1").arg(i));
+            data.setTemperature(threshold(rng));
+            data.setFeelsLike(data.temperature());
+            data.setHumidity(60);
+            data.setWindSpeed(5 + i % 15);
+            cityNames.append(data.cityName() + ", BR");
+            cityWeather.append(data);
+            alerts.updateWeather(cityNames.last(), data);
+        }
+
+        bench.run(QString("alerts.cycle/%1rules/%2cities").arg(ruleCount).arg(cityCount), [&]() {
+            for (int i = 0; i < cityCount; ++i) {
+                WeatherData &data = cityWeather[i];
+                data.setTemperature(data.temperature() + drift(rng));
+                alerts.updateWeather(cityNames.at(i), data);
+            }
+        });
+    }
+
+    {
+        RollingStats stats;
+        std::mt19937 rng(7);
+        std::normal_distribution<double> noise(0, 0.3);
+        const int cityCount = 200;
+        QVector<QString> cityNames;
+        for (int i = 0; i < cityCount; ++i) {
+            cityNames.append(QString("City %1, BR").arg(i));
+        }
+
+        // A week of 10-minute observations first, so every window is full
+        qint64 now = 1700000000;
+        RollingStats::Sample sample;
+        sample.humidity = 70;
+        sample.pressure = 1013;
+        for (qint64 t = now - RollingStats::HistorySecs; t < now; t += 600) {
+            sample.time = t;
+            for (int i = 0; i < cityCount; ++i) {
+                sample.temperature = 15 + noise(rng);
+                stats.add(cityNames.at(i), sample);
+            }
+        }
+
+        bench.run(QString("rollingstats.add/%1cities").arg(cityCount), [&]() {
+            now += 60;
+            sample.time = now;
+            for (int i = 0; i < cityCount; ++i) {
+                sample.temperature = 15 + noise(rng);
+                stats.add(cityNames.at(i), sample);
+            }
+        });
+    }
+
+    // A span while tracing is off must cost no more than its branch
+    bench.run("trace.span/disabled", []() {
+        TraceSpan traceSpan("bench");
+    });
+    Tracer::setEnabled(true);
+    bench.run("trace.span/enabled", []() {
+        TraceSpan traceSpan("bench", 1);
+    });
+    Tracer::setEnabled(false);
+
+    // A dependent request pair, as a city lookup followed by its weather
+    if (!checkFutures()) {
+        qCritical("Futures::chain, whenBoth or cancellation misbehaved");
+        return 1;
+    }
+    bench.run("futures.chain", []() {
+        QFuture<int> future = Futures::chain(Futures::ready(1), [](int value) {
+            return Futures::ready(value + 1);
+        });
+        waitFor(future);
+    });
+
+    QJsonObject root;
+    root["benchmark"] = "weather_bench";
+    root["qt_version"] = QString::fromLatin1(qVersion());
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["results"] = bench.results();
+    QByteArray json = QJsonDocument(root).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical("Cannot write %s", qPrintable(file.fileName()));
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,614 @@
+// Load and soak generator for the refresh pipeline.
+//
+// Loads a synthetic favorites list into LocationManager and refreshes it
+// through WeatherService as fast as the concurrency limit allows. By
+// default it talks to an in-process stub of the OpenWeatherMap endpoints
+// with configurable latency and failure rates. Prints one JSON line per
+// report interval and a summary at the end:
+//   weather_loadgen --cities 50000 --concurrency 32 --duration 14400
+//   weather_loadgen --latency lognormal:120:0.8 --error-rate 0.02
+//   weather_loadgen --target http://127.0.0.1:8080   (e.g. a --serve proxy)
+//
+// Exits with status 1 if network replies are still alive after the drain.
+
+#include "weatherservice.h"
+#include "locationmanager.h"
+#include "favoriteswriter.h"
+#include "latencyhistogram.h"
+#include "memoryaccountant.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QPointer>
+#include <QUrlQuery>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QLoggingCategory>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+
+namespace {
+
+QByteArray readFixture(const QString &dir, const QString &name)
+{
+    QFile file(dir + "/" + name);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qFatal("Missing fixture %s", qPrintable(file.fileName()));
+    }
+    return file.readAll();
+}
+
+// Response delay of the stub, in ms. Specs look like "fixed:50",
+// "uniform:20:200", "exp:50" (mean) or "lognormal:80:0.6" (median, sigma).
+class LatencyModel
+{
+public:
+    bool parse(const QString &spec)
+    {
+        const QStringList parts = spec.split(':');
+        bool ok = false;
+        m_kind = parts.value(0);
+        m_a = parts.value(1).toDouble(&ok);
+        m_b = parts.size() > 2 ? parts.at(2).toDouble() : 0;
+        if (!ok || m_a < 0) {
+            return false;
+        }
+        return m_kind == "fixed" || m_kind == "exp"
+            || (m_kind == "uniform" && m_b >= m_a)
+            || (m_kind == "lognormal" && m_b >= 0);
+    }
+
+    int sample(std::mt19937 &rng) const
+    {
+        double ms = m_a;
+        if (m_kind == "uniform") {
+            ms = std::uniform_real_distribution<double>(m_a, m_b)(rng);
+        } else if (m_kind == "exp" && m_a > 0) {
+            ms = std::exponential_distribution<double>(1.0 / m_a)(rng);
+        } else if (m_kind == "lognormal" && m_a > 0) {
+            ms = std::lognormal_distribution<double>(std::log(m_a), m_b)(rng);
+        }
+        // Cap the tail so one sample cannot stall a connection for minutes
+        return int(qBound(0.0, ms, 60000.0));
+    }
+
+private:
+    QString m_kind = "fixed";
+    double m_a = 0;
+    double m_b = 0;
+};
+
+// Minimal HTTP/1.1 stand-in for the weather and forecast endpoints. Runs
+// on its own thread so its work does not show up as client loop lag.
+class StubServer : public QObject
+{
+public:
+    struct Options {
+        LatencyModel latency;
+        double errorRate = 0;
+        double dropRate = 0;
+    };
+
+    StubServer(const Options &options, const QString &fixtures)
+        : m_options(options)
+        , m_server(new QTcpServer(this))
+        , m_rng(1234)
+    {
+        m_weather = QJsonDocument::fromJson(readFixture(fixtures, "weather.json")).object();
+        m_forecast = readFixture(fixtures, "forecast.json");
+        connect(m_server, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+                socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+
+    quint16 listen()
+    {
+        return m_server->listen(QHostAddress::LocalHost, 0) ? m_server->serverPort() : 0;
+    }
+
+    QJsonObject stats() const
+    {
+        QJsonObject json;
+        json["requests"] = double(m_requests.load());
+        json["errors"] = double(m_errors.load());
+        json["dropped"] = double(m_dropped.load());
+        return json;
+    }
+
+private:
+    Options m_options;
+    QTcpServer *m_server;
+    std::mt19937 m_rng;
+    QJsonObject m_weather;
+    QByteArray m_forecast;
+    std::atomic<quint64> m_requests{0};
+    std::atomic<quint64> m_errors{0};
+    std::atomic<quint64> m_dropped{0};
+
+    void onReadyRead(QTcpSocket *socket)
+    {
+        // The client sends one request per connection at a time, so a
+        // complete header block is a complete request
+        QByteArray buffer = socket->property("buffer").toByteArray() + socket->readAll();
+        int headerEnd;
+        while ((headerEnd = buffer.indexOf("\r\n\r\n")) >= 0) {
+            QByteArray requestLine = buffer.left(buffer.indexOf("\r\n"));
+            buffer.remove(0, headerEnd + 4);
+            handleRequest(socket, QUrl(QString::fromLatin1(requestLine.split(' ').value(1))));
+        }
+        socket->setProperty("buffer", buffer);
+    }
+
+    void handleRequest(QTcpSocket *socket, const QUrl &url)
+    {
+        ++m_requests;
+        std::uniform_real_distribution<double> roll(0, 1);
+        double outcome = roll(m_rng);
+        int status = 200;
+        QByteArray body;
+
+        if (outcome < m_options.dropRate) {
+            ++m_dropped;
+            socket->abort();
+            return;
+        } else if (outcome < m_options.dropRate + m_options.errorRate) {
+            ++m_errors;
+            status = 500;
+            body = R"({"cod":"500","message":"stub failure"})";
+        } else if (url.path() == "/data/2.5/weather") {
+            body = weatherBody(QUrlQuery(url));
+        } else if (url.path() == "/data/2.5/forecast") {
+            body = m_forecast;
+        } else {
+            status = 404;
+            body = R"({"cod":"404","message":"not found"})";
+        }
+
+        QByteArray response = "HTTP/1.1 " + QByteArray::number(status)
+            + (status == 200 ? " OK" : " Error") + "\r\n"
+            + "Content-Type: application/json\r\n"
+            + "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            + "Connection: keep-alive\r\n\r\n" + body;
+
+        QPointer<QTcpSocket> target(socket);
+        QTimer::singleShot(m_options.latency.sample(m_rng), this, [target, response]() {
+            if (target) {
+                target->write(response);
+            }
+        });
+    }
+
+    // Echoes the coordinates and derives a stable city ID from them, so
+    // the client backfills its favorites the way it would in production
+    QByteArray weatherBody(const QUrlQuery &query)
+    {
+        QJsonObject json = m_weather;
+        double lat = query.queryItemValue("lat").toDouble();
+        double lon = query.queryItemValue("lon").toDouble();
+        int cityId = query.queryItemValue("id").toInt();
+        if (cityId <= 0) {
+            cityId = 1000000 + int(qHash(query.queryItemValue("lat") + "," + query.queryItemValue("lon")) % 8000000);
+        }
+        QJsonObject coord;
+        coord["lat"] = lat;
+        coord["lon"] = lon;
+        json["coord"] = coord;
+        json["id"] = cityId;
+        return QJsonDocument(json).toJson(QJsonDocument::Compact);
+    }
+};
+
+QList<CityResult> syntheticCities(int count)
+{
+    // Coordinates only, like migrated favorites that still need an ID
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> latitude(-60, 70);
+    std::uniform_real_distribution<double> longitude(-180, 180);
+    QList<CityResult> cities;
+    cities.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        CityResult city;
+        city.name = QString("City %1").arg(i);
+        city.country = "ZZ";
+        city.lat = latitude(rng);
+        city.lon = longitude(rng);
+        cities.append(city);
+    }
+    return cities;
+}
+
+qint64 residentKb()
+{
+    // Linux only; -1 elsewhere
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+}
+
+QJsonObject percentilesMs(const LatencyHistogram &histogram)
+{
+    QJsonObject json;
+    json["p50"] = histogram.percentile(50) / 1000.0;
+    json["p95"] = histogram.percentile(95) / 1000.0;
+    json["p99"] = histogram.percentile(99) / 1000.0;
+    json["max"] = histogram.max() / 1000.0;
+    return json;
+}
+
+struct LoadOptions {
+    int concurrency = 16;
+    qint64 durationMs = 60000;
+    int reportIntervalMs = 10000;
+    double forecastRatio = 0.1;
+};
+
+// Closed-loop driver: keeps `concurrency` requests in flight and samples
+// client health every report interval
+class LoadDriver : public QObject
+{
+public:
+    LoadDriver(const LoadOptions &options, const QString &baseUrl, LocationManager *locations)
+        : m_options(options)
+        , m_locations(locations)
+        , m_service(new WeatherService(this))
+        , m_rng(7)
+    {
+        m_service->setBaseUrl(baseUrl);
+        connect(m_service, &WeatherService::weatherReplyReady, this,
+                [this](quint64 requestId, const WeatherData &data) {
+                    // Backfill the ID so LocationManager schedules writes under load
+                    CityResult city = m_locations->favoriteAt(m_pending.value(requestId).index);
+                    if (city.isValid() && data.cityId() > 0 && city.cityId != data.cityId()) {
+                        city.cityId = data.cityId();
+                        m_locations->updateLocation(city);
+                    }
+                    complete(requestId, true);
+                });
+        connect(m_service, &WeatherService::forecastReplyReady, this,
+                [this](quint64 requestId, const ForecastData &) {
+                    complete(requestId, true);
+                });
+        connect(m_service, &WeatherService::requestRejected, this,
+                [this](quint64 requestId, const QString &) {
+                    reject(requestId);
+                });
+        connect(m_service, &WeatherService::requestFailed, this,
+                [this](quint64 requestId, const QString &) {
+                    complete(requestId, false);
+                });
+
+        m_backoffTimer.setSingleShot(true);
+        m_backoffTimer.setInterval(RejectBackoffMs);
+        connect(&m_backoffTimer, &QTimer::timeout, this, [this]() { pump(); });
+
+        m_lagTimer.setTimerType(Qt::PreciseTimer);
+        m_lagTimer.setInterval(LagProbeMs);
+        connect(&m_lagTimer, &QTimer::timeout, this, [this]() {
+            qint64 now = m_clock.nsecsElapsed();
+            qint64 lagUs = (now - m_lastProbeNs) / 1000 - LagProbeMs * 1000;
+            m_lastProbeNs = now;
+            m_intervalLag.record(qMax<qint64>(0, lagUs));
+            m_totalLag.record(qMax<qint64>(0, lagUs));
+        });
+
+        m_reportTimer.setInterval(m_options.reportIntervalMs);
+        connect(&m_reportTimer, &QTimer::timeout, this, [this]() { report(false); });
+    }
+
+    void start()
+    {
+        m_clock.start();
+        m_lastProbeNs = 0;
+        m_baselineRssKb = residentKb();
+        m_lagTimer.start();
+        m_reportTimer.start();
+        QTimer::singleShot(m_options.durationMs, this, [this]() { drain(); });
+        pump();
+    }
+
+    int exitCode() const { return m_exitCode; }
+
+    std::function<QJsonObject()> serverStats;
+
+private:
+    static const int LagProbeMs = 50;
+    static const int DrainTimeoutMs = 30000;
+    // Pause before refilling slots freed by rejected requests
+    static const int RejectBackoffMs = 100;
+
+    struct Pending {
+        int index = -1;
+        qint64 startNs = 0;
+    };
+
+    LoadOptions m_options;
+    LocationManager *m_locations;
+    WeatherService *m_service;
+    std::mt19937 m_rng;
+    QHash<quint64, Pending> m_pending;
+    int m_next = 0;
+    bool m_draining = false;
+    int m_exitCode = 0;
+
+    QElapsedTimer m_clock;
+    QTimer m_lagTimer;
+    QTimer m_reportTimer;
+    QTimer m_backoffTimer;
+    qint64 m_lastProbeNs = 0;
+    qint64 m_baselineRssKb = -1;
+    qint64 m_lastReportNs = 0;
+
+    quint64 m_intervalCompleted = 0;
+    quint64 m_intervalErrors = 0;
+    quint64 m_totalCompleted = 0;
+    quint64 m_totalErrors = 0;
+    quint64 m_intervalRejected = 0;
+    quint64 m_totalRejected = 0;
+    LatencyHistogram m_intervalLatency;
+    LatencyHistogram m_totalLatency;
+    LatencyHistogram m_intervalLag;
+    LatencyHistogram m_totalLag;
+
+    void pump()
+    {
+        std::uniform_real_distribution<double> roll(0, 1);
+        while (!m_draining && m_pending.size() < m_options.concurrency && m_locations->count() > 0) {
+            int index = m_next;
+            m_next = (m_next + 1) % m_locations->count();
+            const CityResult city = m_locations->favoriteAt(index);
+
+            bool forecast = roll(m_rng) < m_options.forecastRatio;
+            quint64 requestId = forecast ? m_service->fetchForecast(city) : m_service->fetchWeather(city);
+            if (requestId == 0) {
+                ++m_intervalErrors;
+                ++m_totalErrors;
+                continue;
+            }
+            m_pending.insert(requestId, { index, m_clock.nsecsElapsed() });
+        }
+    }
+
+    // Failed without network I/O. Kept out of the latency and throughput
+    // figures, and the slot is refilled after a pause, not at once, so an
+    // open circuit does not spin the driver.
+    void reject(quint64 requestId)
+    {
+        if (m_pending.remove(requestId) == 0) {
+            return;
+        }
+        ++m_intervalRejected;
+        ++m_totalRejected;
+
+        if (m_draining) {
+            if (m_pending.isEmpty()) {
+                finish();
+            }
+            return;
+        }
+        if (!m_backoffTimer.isActive()) {
+            m_backoffTimer.start();
+        }
+    }
+
+    void complete(quint64 requestId, bool ok)
+    {
+        auto it = m_pending.find(requestId);
+        if (it == m_pending.end()) {
+            return;
+        }
+        qint64 latencyUs = (m_clock.nsecsElapsed() - it->startNs) / 1000;
+        m_pending.erase(it);
+
+        m_intervalLatency.record(latencyUs);
+        m_totalLatency.record(latencyUs);
+        ++m_intervalCompleted;
+        ++m_totalCompleted;
+        if (!ok) {
+            ++m_intervalErrors;
+            ++m_totalErrors;
+        }
+
+        if (m_draining) {
+            if (m_pending.isEmpty()) {
+                finish();
+            }
+            return;
+        }
+        pump();
+    }
+
+    int liveReplies() const
+    {
+        // Replies are children of the service's network manager until deleted
+        return m_service->findChildren<QNetworkReply *>().size();
+    }
+
+    QJsonObject snapshot(quint64 completed, quint64 errors, quint64 rejected, const LatencyHistogram &latency,
+                         const LatencyHistogram &lag, double seconds) const
+    {
+        int live = liveReplies();
+        qint64 rss = residentKb();
+
+        QJsonObject json;
+        json["elapsed_s"] = m_clock.elapsed() / 1000.0;
+        json["completed"] = double(completed);
+        json["errors"] = double(errors);
+        json["rejected"] = double(rejected);
+        json["throughput_rps"] = seconds > 0 ? completed / seconds : 0;
+        json["latency_ms"] = percentilesMs(latency);
+        json["loop_lag_ms"] = percentilesMs(lag);
+        json["in_flight"] = int(m_pending.size());
+        json["live_replies"] = live;
+        json["leaked_replies"] = qMax(0, live - int(m_pending.size()));
+        json["rss_kb"] = double(rss);
+        json["rss_growth_kb"] = rss >= 0 && m_baselineRssKb >= 0 ? double(rss - m_baselineRssKb) : 0.0;
+        json["accounted_bytes"] = double(MemoryAccountant::instance()->usage());
+        return json;
+    }
+
+    void report(bool final)
+    {
+        QJsonObject json;
+        if (final) {
+            json = snapshot(m_totalCompleted, m_totalErrors, m_totalRejected, m_totalLatency, m_totalLag,
+                            m_clock.elapsed() / 1000.0);
+            json["summary"] = true;
+            if (serverStats) {
+                json["stub"] = serverStats();
+            }
+        } else {
+            qint64 now = m_clock.nsecsElapsed();
+            json = snapshot(m_intervalCompleted, m_intervalErrors, m_intervalRejected, m_intervalLatency, m_intervalLag,
+                            (now - m_lastReportNs) / 1e9);
+            m_lastReportNs = now;
+            m_intervalCompleted = 0;
+            m_intervalErrors = 0;
+            m_intervalRejected = 0;
+            m_intervalLatency.reset();
+            m_intervalLag.reset();
+        }
+        QTextStream(stdout) << QJsonDocument(json).toJson(QJsonDocument::Compact) << "\n";
+    }
+
+    void drain()
+    {
+        m_draining = true;
+        m_reportTimer.stop();
+        if (m_pending.isEmpty()) {
+            finish();
+            return;
+        }
+        QTimer::singleShot(DrainTimeoutMs, this, [this]() {
+            qWarning("Drain timed out with %d requests in flight", int(m_pending.size()));
+            finish();
+        });
+    }
+
+    void finish()
+    {
+        if (!m_lagTimer.isActive()) {
+            return;
+        }
+        m_lagTimer.stop();
+        m_locations->flush();
+
+        // Let deleteLater() run before counting what is left
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        report(true);
+        if (liveReplies() > 0) {
+            qWarning("%d network replies still alive after the drain", liveReplies());
+            m_exitCode = 1;
+        }
+        QCoreApplication::exit(m_exitCode);
+    }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("weather_loadgen");
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load and soak generator for the weather refresh pipeline");
+    parser.addHelpOption();
+    QCommandLineOption citiesOption("cities", "Number of synthetic favorites.", "n", "1000");
+    QCommandLineOption concurrencyOption("concurrency", "Requests kept in flight.", "n", "16");
+    QCommandLineOption durationOption("duration", "Run time in seconds.", "s", "60");
+    QCommandLineOption intervalOption("report-interval", "Seconds between report lines.", "s", "10");
+    QCommandLineOption forecastOption("forecast-ratio", "Share of refreshes that fetch the forecast.", "ratio", "0.1");
+    QCommandLineOption targetOption("target", "API base URL to load instead of the built-in stub.", "url");
+    QCommandLineOption latencyOption("latency", "Stub delay: fixed:MS, uniform:MIN:MAX, exp:MEAN or lognormal:MEDIAN:SIGMA.", "spec", "lognormal:80:0.5");
+    QCommandLineOption errorOption("error-rate", "Share of stub responses that are HTTP 500.", "ratio", "0.01");
+    QCommandLineOption dropOption("drop-rate", "Share of stub requests answered by closing the connection.", "ratio", "0.001");
+    QCommandLineOption fixturesOption("fixtures", "Directory with recorded responses.", "dir", WEATHER_BENCH_FIXTURES);
+    parser.addOptions({citiesOption, concurrencyOption, durationOption, intervalOption, forecastOption,
+                       targetOption, latencyOption, errorOption, dropOption, fixturesOption});
+    parser.process(app);
+
+    LoadOptions options;
+    options.concurrency = qMax(1, parser.value(concurrencyOption).toInt());
+    options.durationMs = qMax<qint64>(1, parser.value(durationOption).toLongLong()) * 1000;
+    options.reportIntervalMs = qMax(1, parser.value(intervalOption).toInt()) * 1000;
+    options.forecastRatio = parser.value(forecastOption).toDouble();
+
+    StubServer::Options stubOptions;
+    if (!stubOptions.latency.parse(parser.value(latencyOption))) {
+        qCritical("Invalid latency spec: %s", qPrintable(parser.value(latencyOption)));
+        return 2;
+    }
+    stubOptions.errorRate = parser.value(errorOption).toDouble();
+    stubOptions.dropRate = parser.value(dropOption).toDouble();
+
+    QThread stubThread;
+    std::unique_ptr<StubServer> stub;
+    QString baseUrl = parser.value(targetOption);
+    if (baseUrl.isEmpty()) {
+        stub.reset(new StubServer(stubOptions, parser.value(fixturesOption)));
+        stub->moveToThread(&stubThread);
+        stubThread.start();
+        quint16 port = 0;
+        QMetaObject::invokeMethod(stub.get(), [&stub]() { return stub->listen(); },
+                                  Qt::BlockingQueuedConnection, &port);
+        if (port == 0) {
+            qCritical("Stub server failed to listen");
+            return 2;
+        }
+        baseUrl = QString("http://127.0.0.1:%1").arg(port);
+        if (qEnvironmentVariableIsEmpty("OPENWEATHERMAP_API_KEY")) {
+            qputenv("OPENWEATHERMAP_API_KEY", "loadgen");
+        }
+    }
+
+    // Favorites go through the same file and write-behind path as the app
+    QTemporaryDir dataDir;
+    const QString favoritesPath = dataDir.filePath("favorites.json");
+    FavoritesWriter(favoritesPath).writeFile(syntheticCities(qMax(1, parser.value(citiesOption).toInt())));
+    LocationManager locations(favoritesPath);
+    locations.loadFavorites();
+
+    LoadDriver driver(options, baseUrl, &locations);
+    if (stub) {
+        StubServer *server = stub.get();
+        driver.serverStats = [server]() { return server->stats(); };
+    }
+    QTextStream(stderr) << "Loading " << baseUrl << " with " << locations.count()
+                        << " cities, concurrency " << options.concurrency << "\n";
+    driver.start();
+
+    int result = app.exec();
+
+    if (stub) {
+        // The server and its sockets must be destroyed on their own thread
+        StubServer *server = stub.release();
+        QObject::connect(&stubThread, &QThread::finished, server, &QObject::deleteLater);
+        stubThread.quit();
+        stubThread.wait();
+    }
+    return result;
+}
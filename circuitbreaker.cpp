@@ -0,0 +1,128 @@
+#include "circuitbreaker.h"
+#include <QMutexLocker>
+#include <QNetworkReply>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QUrl>
+#include <QDebug>
+
+QMutex CircuitBreaker::s_mutex;
+QHash<QString, CircuitBreaker::Breaker> CircuitBreaker::s_breakers;
+QElapsedTimer CircuitBreaker::s_clock;
+
+qint64 CircuitBreaker::nowMs()
+{
+    if (!s_clock.isValid()) {
+        s_clock.start();
+    }
+    return s_clock.elapsed();
+}
+
+QString CircuitBreaker::endpointKey(const QUrl &url)
+{
+    return url.host() + url.path();
+}
+
+bool CircuitBreaker::isEndpointFailure(int networkError, int httpStatus)
+{
+    if (httpStatus == 429 || httpStatus >= 500) {
+        return true;
+    }
+    if (httpStatus >= 400) {
+        return false;
+    }
+    // No HTTP status: connection, DNS, TLS or timeout. Aborts are ours.
+    return networkError != QNetworkReply::NoError
+        && networkError != QNetworkReply::OperationCanceledError;
+}
+
+bool CircuitBreaker::allow(const QString &endpoint, qint64 *retryInMs)
+{
+    QMutexLocker locker(&s_mutex);
+    auto it = s_breakers.find(endpoint);
+    if (it == s_breakers.end() || it->state == Closed) {
+        return true;
+    }
+
+    Breaker &breaker = *it;
+    const qint64 now = nowMs();
+    if (breaker.state == Open && now >= breaker.openUntilMs) {
+        breaker.state = HalfOpen;
+        breaker.probeInFlight = false;
+    }
+    if (breaker.state == HalfOpen && (!breaker.probeInFlight || now >= breaker.openUntilMs)) {
+        // One probe at a time decides whether to close again
+        breaker.probeInFlight = true;
+        breaker.openUntilMs = now + ProbeTimeoutMs;
+        return true;
+    }
+
+    ++breaker.rejected;
+    if (retryInMs) {
+        *retryInMs = qMax<qint64>(0, breaker.openUntilMs - now);
+    }
+    return false;
+}
+
+void CircuitBreaker::recordSuccess(const QString &endpoint)
+{
+    QMutexLocker locker(&s_mutex);
+    auto it = s_breakers.find(endpoint);
+    if (it == s_breakers.end()) {
+        return;
+    }
+    if (it->state != Closed) {
+        qDebug() << "Circuit closed for" << endpoint;
+    }
+    // Healthy endpoints are not kept around
+    s_breakers.erase(it);
+}
+
+void CircuitBreaker::recordFailure(const QString &endpoint)
+{
+    QMutexLocker locker(&s_mutex);
+    Breaker &breaker = s_breakers[endpoint];
+    breaker.probeInFlight = false;
+
+    if (breaker.state == HalfOpen) {
+        openUnlocked(endpoint, breaker);
+    } else if (breaker.state == Closed && ++breaker.failures >= FailureThreshold) {
+        openUnlocked(endpoint, breaker);
+    }
+}
+
+void CircuitBreaker::openUnlocked(const QString &endpoint, Breaker &breaker)
+{
+    // Exponential backoff with jitter, so clients do not retry in step
+    const qint64 backoff = qMin<qint64>(MaxBackoffMs, qint64(BaseBackoffMs) << qMin(breaker.level, 20));
+    const qint64 delay = backoff / 2 + QRandomGenerator::global()->bounded(backoff / 2 + 1);
+    breaker.state = Open;
+    breaker.openUntilMs = nowMs() + delay;
+    ++breaker.level;
+    qWarning() << "Circuit open for" << endpoint << "retrying in" << delay << "ms";
+}
+
+CircuitBreaker::State CircuitBreaker::state(const QString &endpoint)
+{
+    QMutexLocker locker(&s_mutex);
+    return s_breakers.value(endpoint).state;
+}
+
+QJsonArray CircuitBreaker::toJson()
+{
+    QMutexLocker locker(&s_mutex);
+    static const char *names[] = { "closed", "open", "half_open" };
+    const qint64 now = nowMs();
+
+    QJsonArray array;
+    for (auto it = s_breakers.constBegin(); it != s_breakers.constEnd(); ++it) {
+        QJsonObject json;
+        json["endpoint"] = it.key();
+        json["state"] = names[it->state];
+        json["failures"] = it->failures;
+        json["rejected"] = double(it->rejected);
+        json["retry_in_ms"] = double(qMax<qint64>(0, it->openUntilMs - now));
+        array.append(json);
+    }
+    return array;
+}
@@ -0,0 +1,61 @@
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonArray>
+
+class QUrl;
+
+// Per-endpoint circuit breakers shared by every client in the process.
+// After FailureThreshold consecutive failures (network errors, timeouts,
+// 429 and 5xx) an endpoint opens and requests fail fast. After a backoff
+// that doubles on every failed probe, with jitter, one probe request is
+// let through; success closes the breaker again.
+class CircuitBreaker
+{
+public:
+    enum State { Closed, Open, HalfOpen };
+
+    // "host/path" of a request URL, without the query
+    static QString endpointKey(const QUrl &url);
+
+    // False while the endpoint is open; *retryInMs tells when to try again
+    static bool allow(const QString &endpoint, qint64 *retryInMs = nullptr);
+    static void recordSuccess(const QString &endpoint);
+    static void recordFailure(const QString &endpoint);
+
+    // True for failures that say the endpoint is unhealthy, as opposed to
+    // a bad request
+    static bool isEndpointFailure(int networkError, int httpStatus);
+
+    static State state(const QString &endpoint);
+    static QJsonArray toJson();
+
+    static constexpr int FailureThreshold = 5;
+    static constexpr int BaseBackoffMs = 1000;
+    static constexpr int MaxBackoffMs = 5 * 60 * 1000;
+    // A probe that never reports back stops blocking after this
+    static constexpr int ProbeTimeoutMs = 30000;
+
+private:
+    struct Breaker {
+        State state = Closed;
+        int failures = 0;
+        int level = 0;          // doublings of the backoff so far
+        qint64 openUntilMs = 0;
+        bool probeInFlight = false;
+        quint64 rejected = 0;
+    };
+
+    static QMutex s_mutex;
+    static QHash<QString, Breaker> s_breakers;
+    static QElapsedTimer s_clock;
+
+    static qint64 nowMs();
+    static void openUnlocked(const QString &endpoint, Breaker &breaker);
+};
+
+#endif // CIRCUITBREAKER_H
@@ -0,0 +1,53 @@
+#include "cityresult.h"
+#include <QStringList>
+
+QJsonObject CityResult::toJson() const
+{
+    QJsonObject json;
+    json["name"] = name;
+    if (!state.isEmpty()) {
+        json["state"] = state;
+    }
+    json["country"] = country;
+    if (hasCoordinates()) {
+        json["lat"] = lat;
+        json["lon"] = lon;
+    }
+    if (cityId > 0) {
+        json["id"] = cityId;
+    }
+    return json;
+}
+
+CityResult CityResult::fromJson(const QJsonObject &json)
+{
+    CityResult result;
+    result.name = json["name"].toString();
+    result.state = json["state"].toString();
+    result.country = json["country"].toString();
+    if (json["lat"].isDouble() && json["lon"].isDouble()) {
+        result.lat = json["lat"].toDouble();
+        result.lon = json["lon"].toDouble();
+    }
+    result.cityId = json["id"].toInt();
+    return result;
+}
+
+CityResult CityResult::fromDisplayName(const QString &displayName)
+{
+    CityResult result;
+    QStringList parts = displayName.split(",");
+    for (QString &part : parts) {
+        part = part.trimmed();
+    }
+
+    // "Name", "Name, Country" or "Name, State, Country"
+    result.name = parts.value(0);
+    if (parts.size() == 2) {
+        result.country = parts.value(1);
+    } else if (parts.size() >= 3) {
+        result.state = parts.mid(1, parts.size() - 2).join(", ");
+        result.country = parts.last();
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef CITYRESULT_H
+#define CITYRESULT_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QtMath>
+
+struct CityResult {
+    QString name;
+    QString state;
+    QString country;
+    double lat = qQNaN();
+    double lon = qQNaN();
+    int cityId = 0; // OpenWeatherMap city ID, 0 when unknown
+
+    QString displayName() const {
+        QString display = name;
+        if (!state.isEmpty()) {
+            display += ", " + state;
+        }
+        display += ", " + country;
+        return display;
+    }
+
+    QString fullName() const {
+        return displayName();
+    }
+
+    bool isValid() const { return !name.isEmpty(); }
+    bool hasCoordinates() const { return !qIsNaN(lat) && !qIsNaN(lon); }
+    bool isResolved() const { return cityId > 0 || hasCoordinates(); }
+
+    // Approximate heap footprint, for memory accounting
+    qint64 memoryCost() const {
+        return qint64(sizeof(CityResult)) + (name.size() + state.size() + country.size()) * qint64(sizeof(QChar));
+    }
+
+    QJsonObject toJson() const;
+    static CityResult fromJson(const QJsonObject &json);
+
+    // Parses legacy "City, State, Country" display strings
+    static CityResult fromDisplayName(const QString &displayName);
+};
+
+#endif // CITYRESULT_H
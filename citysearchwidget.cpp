@@ -1,22 +1,19 @@
 #include "citysearchwidget.h"
-#include <QNetworkRequest>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QUrlQuery>
-
-QString CitySearchWidget::apiKey() const
-{
-    return QString::fromUtf8(qgetenv("OPENWEATHERMAP_API_KEY").constData());
-}
+#include "memoryaccountant.h"
+#include "weatherservice.h"
+#include "weatherfutures.h"
+#include "tracer.h"
+#include <QPointer>
 
 CitySearchWidget::CitySearchWidget(QWidget *parent)
     : QWidget(parent)
     , m_lineEdit(new QLineEdit(this))
     , m_suggestionsList(new QListWidget(this))
-    , m_networkManager(new QNetworkAccessManager(this))
+    , m_service(new WeatherService(this))
     , m_searchTimer(new QTimer(this))
+    , m_searchId(0)
     , m_ignoreTextChange(false)
+    , m_resultsCacheId(0)
 {
     // Setup layout
     QVBoxLayout *layout = new QVBoxLayout(this);
@@ -41,10 +38,33 @@ CitySearchWidget::CitySearchWidget(QWidget *parent)
             this, &CitySearchWidget::onTextChanged);
     connect(m_searchTimer, &QTimer::timeout,
             this, &CitySearchWidget::onSearchTimeout);
-    connect(m_networkManager, &QNetworkAccessManager::finished,
-            this, &CitySearchWidget::onSearchFinished);
     connect(m_suggestionsList, &QListWidget::itemClicked,
             this, &CitySearchWidget::onSuggestionClicked);
+
+    // Results only live while the popup is open, so they are never evicted
+    m_resultsCacheId = MemoryAccountant::instance()->registerCache(
+        "search.results", 1.0,
+        [this](const QString &) {
+            qint64 cost = 0;
+            for (const CityResult &result : m_results) {
+                cost += result.memoryCost();
+            }
+            return cost;
+        },
+        [](const QString &) {
+            return false;
+        });
+}
+
+CitySearchWidget::~CitySearchWidget()
+{
+    m_search.cancel();
+    MemoryAccountant::instance()->unregisterCache(m_resultsCacheId);
+}
+
+void CitySearchWidget::prewarm()
+{
+    m_service->prewarm();
 }
 
 QString CitySearchWidget::text() const
@@ -77,6 +97,7 @@ void CitySearchWidget::onTextChanged(const QString &text)
     m_searchTimer->stop();
 
     if (text.trimmed().length() < 3) {
+        m_search.cancel();
         hideSuggestions();
         return;
     }
@@ -94,55 +115,35 @@ void CitySearchWidget::onSearchTimeout()
 
 void CitySearchWidget::searchCities(const QString &query)
 {
-    QString key = apiKey();
-    if (key.isEmpty()) {
-        hideSuggestions();
-        return;
-    }
-    QUrl url(GEO_URL);
-    QUrlQuery urlQuery;
-    urlQuery.addQueryItem("q", query);
-    urlQuery.addQueryItem("limit", "5");
-    urlQuery.addQueryItem("appid", key);
-    url.setQuery(urlQuery);
-
-    QNetworkRequest request(url);
-    m_networkManager->get(request);
+    // Only the latest query's results are shown; the one it replaces is
+    // aborted if still in flight
+    m_search.cancel();
+    const quint64 searchId = ++m_searchId;
+
+    // Names that found nothing recently, or a geocoder that is down, fail
+    // without a request
+    m_search = m_service->geocode(query);
+    QPointer<CitySearchWidget> guard(this);
+    Futures::onFinished(m_search, [guard, searchId](QFuture<QList<CityResult>> finished) {
+        if (!guard || searchId != guard->m_searchId) {
+            return;
+        }
+        QList<CityResult> results;
+        if (Futures::takeResult(finished, &results)) {
+            guard->showResults(results);
+        } else {
+            guard->hideSuggestions();
+        }
+    });
 }
 
-void CitySearchWidget::onSearchFinished(QNetworkReply *reply)
+void CitySearchWidget::showResults(const QList<CityResult> &results)
 {
-    if (reply->error() != QNetworkReply::NoError) {
-        hideSuggestions();
-        reply->deleteLater();
-        return;
-    }
-
-    QByteArray data = reply->readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-
-    if (!doc.isArray()) {
-        hideSuggestions();
-        reply->deleteLater();
-        return;
-    }
-
-    QJsonArray array = doc.array();
-    m_results.clear();
+    m_results = results;
+    MemoryAccountant::instance()->charge(m_resultsCacheId, "results");
     m_suggestionsList->clear();
 
-    for (const QJsonValue &value : array) {
-        if (!value.isObject()) continue;
-
-        QJsonObject obj = value.toObject();
-        CityResult result;
-        result.name = obj["name"].toString();
-        result.state = obj["state"].toString();
-        result.country = obj["country"].toString();
-        result.lat = obj["lat"].toDouble();
-        result.lon = obj["lon"].toDouble();
-
-        m_results.append(result);
+    for (const CityResult &result : m_results) {
         m_suggestionsList->addItem(result.displayName());
     }
 
@@ -151,8 +152,6 @@ void CitySearchWidget::onSearchFinished(QNetworkReply *reply)
     } else {
         hideSuggestions();
     }
-
-    reply->deleteLater();
 }
 
 void CitySearchWidget::onSuggestionClicked(QListWidgetItem *item)
@@ -165,6 +164,10 @@ void CitySearchWidget::onSuggestionClicked(QListWidgetItem *item)
         setText(result.displayName());
 
         hideSuggestions();
+
+        // The click starts a flow that its requests, parsing and repaint join
+        TraceFlowScope flowScope(Tracer::newFlow());
+        TraceSpan traceSpan("city click");
         emit citySelected(result.name, result.lat, result.lon);
     }
 }
@@ -174,4 +177,5 @@ void CitySearchWidget::hideSuggestions()
     m_suggestionsList->hide();
     m_suggestionsList->clear();
     m_results.clear();
+    MemoryAccountant::instance()->releaseAll(m_resultsCacheId);
 }
@@ -5,30 +5,11 @@
 #include <QLineEdit>
 #include <QListWidget>
 #include <QVBoxLayout>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <QTimer>
+#include <QFuture>
+#include "cityresult.h"
 
-struct CityResult {
-    QString name;
-    QString state;
-    QString country;
-    double lat;
-    double lon;
-
-    QString displayName() const {
-        QString display = name;
-        if (!state.isEmpty()) {
-            display += ", " + state;
-        }
-        display += ", " + country;
-        return display;
-    }
-
-    QString fullName() const {
-        return displayName();
-    }
-};
+class WeatherService;
 
 class CitySearchWidget : public QWidget
 {
@@ -36,34 +17,39 @@ class CitySearchWidget : public QWidget
 
 public:
     explicit CitySearchWidget(QWidget *parent = nullptr);
+    ~CitySearchWidget();
     QString text() const;
     void setText(const QString &text);
     void clear();
     CityResult selectedCity() const { return m_selectedCity; }
 
+    // Opens the geocoder connection ahead of the first search
+    void prewarm();
+
 signals:
     void citySelected(const QString &cityName, double lat, double lon);
 
 private slots:
     void onTextChanged(const QString &text);
     void onSearchTimeout();
-    void onSearchFinished(QNetworkReply *reply);
     void onSuggestionClicked(QListWidgetItem *item);
 
 private:
     QLineEdit *m_lineEdit;
     QListWidget *m_suggestionsList;
-    QNetworkAccessManager *m_networkManager;
+    WeatherService *m_service;
     QTimer *m_searchTimer;
+    QFuture<QList<CityResult>> m_search;
+    quint64 m_searchId;
     QList<CityResult> m_results;
     CityResult m_selectedCity;
     bool m_ignoreTextChange;
+    int m_resultsCacheId;
 
     void searchCities(const QString &query);
+    void showResults(const QList<CityResult> &results);
     void hideSuggestions();
-    QString apiKey() const;
 
-    const QString GEO_URL = "https://api.openweathermap.org/geo/1.0/direct";
 };
 
 #endif // CITYSEARCHWIDGET_H
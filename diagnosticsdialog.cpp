@@ -0,0 +1,178 @@
+#include "diagnosticsdialog.h"
+#include "metrics.h"
+#include "memoryaccountant.h"
+#include "stallwatchdog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QFileDialog>
+#include <QSaveFile>
+
+DiagnosticsDialog::DiagnosticsDialog(QWidget *parent)
+    : QDialog(parent)
+    , m_latencyTable(new QTableWidget(this))
+    , m_memoryLabel(new QLabel(this))
+    , m_stallLabel(new QLabel(this))
+    , m_memoryTable(new QTableWidget(this))
+    , m_refreshTimer(new QTimer(this))
+{
+    setWindowTitle("Diagnostics");
+    resize(640, 560);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+
+    // Latency table
+    m_latencyTable->setColumnCount(6);
+    m_latencyTable->setHorizontalHeaderLabels({"Stage", "Count", "p50", "p90", "p99", "Max"});
+    m_latencyTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_latencyTable->verticalHeader()->setVisible(false);
+    m_latencyTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    layout->addWidget(m_latencyTable, 2);
+
+    // Memory table
+    layout->addWidget(m_memoryLabel);
+    m_memoryTable->setColumnCount(4);
+    m_memoryTable->setHorizontalHeaderLabels({"Cache", "Entries", "Size", "Evictions"});
+    m_memoryTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_memoryTable->verticalHeader()->setVisible(false);
+    m_memoryTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    layout->addWidget(m_memoryTable, 1);
+    layout->addWidget(m_stallLabel);
+
+    // Buttons
+    QHBoxLayout *buttons = new QHBoxLayout();
+    QPushButton *exportButton = new QPushButton("Export...", this);
+    QPushButton *closeButton = new QPushButton("Close", this);
+    buttons->addStretch();
+    buttons->addWidget(exportButton);
+    buttons->addWidget(closeButton);
+    layout->addLayout(buttons);
+
+    connect(exportButton, &QPushButton::clicked,
+            this, &DiagnosticsDialog::onExportClicked);
+    connect(closeButton, &QPushButton::clicked,
+            this, &QDialog::hide);
+
+    // Only refreshes while visible
+    m_refreshTimer->setInterval(1000);
+    connect(m_refreshTimer, &QTimer::timeout,
+            this, &DiagnosticsDialog::refresh);
+}
+
+void DiagnosticsDialog::showEvent(QShowEvent *event)
+{
+    QDialog::showEvent(event);
+    refresh();
+    m_refreshTimer->start();
+}
+
+void DiagnosticsDialog::hideEvent(QHideEvent *event)
+{
+    m_refreshTimer->stop();
+    QDialog::hideEvent(event);
+}
+
+void DiagnosticsDialog::refresh()
+{
+    const QStringList names = Metrics::names();
+    m_latencyTable->setRowCount(names.size());
+
+    int row = 0;
+    for (const QString &name : names) {
+        LatencyHistogram *h = Metrics::histogram(name);
+        setCell(m_latencyTable, row, 0, name);
+        setCell(m_latencyTable, row, 1, QString::number(h->count()));
+        setCell(m_latencyTable, row, 2, formatMicros(h->percentile(50)));
+        setCell(m_latencyTable, row, 3, formatMicros(h->percentile(90)));
+        setCell(m_latencyTable, row, 4, formatMicros(h->percentile(99)));
+        setCell(m_latencyTable, row, 5, formatMicros(h->max()));
+        row++;
+    }
+
+    MemoryAccountant *accountant = MemoryAccountant::instance();
+    m_memoryLabel->setText(QString("Memory: %1 of %2%3")
+                               .arg(formatBytes(accountant->usage()),
+                                    formatBytes(accountant->budget()),
+                                    accountant->underPressure() ? " (low memory, budget halved)" : ""));
+
+    // Worst GUI stall so far; the full list is in the JSON export
+    const QList<StallWatchdog::Stall> stalls = StallWatchdog::worstStalls();
+    if (!StallWatchdog::isActive()) {
+        m_stallLabel->setText("Stall watchdog: off");
+    } else if (stalls.isEmpty()) {
+        m_stallLabel->setText("GUI stalls: none");
+    } else {
+        m_stallLabel->setText(QString("GUI stalls: %1, worst %2 ms in %3")
+                                  .arg(StallWatchdog::stallCount())
+                                  .arg(stalls.first().durationMs)
+                                  .arg(stalls.first().scope));
+    }
+
+    const QList<MemoryAccountant::CacheStats> caches = accountant->stats();
+    m_memoryTable->setRowCount(caches.size());
+    row = 0;
+    for (const MemoryAccountant::CacheStats &cache : caches) {
+        setCell(m_memoryTable, row, 0, cache.name);
+        setCell(m_memoryTable, row, 1, QString::number(cache.entries));
+        setCell(m_memoryTable, row, 2, formatBytes(cache.bytes));
+        setCell(m_memoryTable, row, 3, QString::number(cache.evictions));
+        row++;
+    }
+}
+
+void DiagnosticsDialog::setCell(QTableWidget *table, int row, int column, const QString &text)
+{
+    // Reuse items so a refresh doesn't reallocate the whole table
+    QTableWidgetItem *item = table->item(row, column);
+    if (!item) {
+        item = new QTableWidgetItem();
+        if (column > 0) {
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        }
+        table->setItem(row, column, item);
+    }
+    if (item->text() != text) {
+        item->setText(text);
+    }
+}
+
+QString DiagnosticsDialog::formatMicros(qint64 micros)
+{
+    if (micros < 1000) {
+        return QString("%1 us").arg(micros);
+    }
+    if (micros < 1000000) {
+        return QString("%1 ms").arg(micros / 1000.0, 0, 'f', 1);
+    }
+    return QString("%1 s").arg(micros / 1e6, 0, 'f', 2);
+}
+
+QString DiagnosticsDialog::formatBytes(qint64 bytes)
+{
+    if (bytes < 1024) {
+        return QString("%1 B").arg(bytes);
+    }
+    if (bytes < 1024 * 1024) {
+        return QString("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+    return QString("%1 MiB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+void DiagnosticsDialog::onExportClicked()
+{
+    QString filePath = QFileDialog::getSaveFileName(this, "Export Metrics", "metrics.json",
+                                                    "JSON (*.json);;Prometheus (*.prom)");
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    QByteArray data = filePath.endsWith(".json", Qt::CaseInsensitive)
+                          ? Metrics::toJson()
+                          : Metrics::toPrometheus();
+
+    QSaveFile file(filePath);
+    if (file.open(QIODevice::WriteOnly) && file.write(data) != -1) {
+        file.commit();
+    }
+}
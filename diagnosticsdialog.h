@@ -0,0 +1,38 @@
+#ifndef DIAGNOSTICSDIALOG_H
+#define DIAGNOSTICSDIALOG_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QTimer>
+#include <QLabel>
+
+// Hidden diagnostics panel (Ctrl+Shift+D) with live latency percentiles
+// and per-cache memory usage and GUI stalls
+class DiagnosticsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDialog(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+    void onExportClicked();
+
+private:
+    QTableWidget *m_latencyTable;
+    QLabel *m_memoryLabel;
+    QLabel *m_stallLabel;
+    QTableWidget *m_memoryTable;
+    QTimer *m_refreshTimer;
+
+    void setCell(QTableWidget *table, int row, int column, const QString &text);
+    static QString formatMicros(qint64 micros);
+    static QString formatBytes(qint64 bytes);
+};
+
+#endif // DIAGNOSTICSDIALOG_H
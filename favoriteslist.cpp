@@ -0,0 +1,109 @@
+#include "favoriteslist.h"
+
+FavoritesList::FavoritesList()
+    : m_dirtyFrom(0)
+{
+}
+
+QString FavoritesList::key(const QString &displayName)
+{
+    return displayName.trimmed().toCaseFolded();
+}
+
+bool FavoritesList::contains(const QString &displayName) const
+{
+    return m_index.contains(key(displayName));
+}
+
+int FavoritesList::indexOf(const QString &displayName) const
+{
+    auto it = m_index.constFind(key(displayName));
+    if (it == m_index.constEnd()) {
+        return -1;
+    }
+
+    // Positions before m_dirtyFrom are still exact
+    if (it.value() < m_dirtyFrom) {
+        return it.value();
+    }
+
+    reindex();
+    return m_index.value(key(displayName), -1);
+}
+
+bool FavoritesList::append(const CityResult &city)
+{
+    QString cityKey = key(city);
+    if (!city.isValid() || m_index.contains(cityKey)) {
+        return false;
+    }
+
+    // Appending never shifts existing positions
+    bool clean = m_dirtyFrom >= m_items.count();
+    m_index.insert(cityKey, m_items.count());
+    m_items.append(city);
+    if (clean) {
+        m_dirtyFrom = m_items.count();
+    }
+    return true;
+}
+
+void FavoritesList::replace(int index, const CityResult &city)
+{
+    if (index < 0 || index >= m_items.count()) {
+        return;
+    }
+
+    // Only the record changes; the key must stay the same
+    if (key(city) != key(m_items.at(index))) {
+        return;
+    }
+
+    m_items[index] = city;
+}
+
+void FavoritesList::removeAt(int index)
+{
+    if (index < 0 || index >= m_items.count()) {
+        return;
+    }
+
+    m_index.remove(key(m_items.at(index)));
+    m_items.removeAt(index);
+    markDirty(index);
+}
+
+void FavoritesList::move(int from, int to)
+{
+    if (from < 0 || from >= m_items.count() || to < 0 || to >= m_items.count() || from == to) {
+        return;
+    }
+
+    m_items.move(from, to);
+    markDirty(qMin(from, to));
+}
+
+void FavoritesList::reset(const QList<CityResult> &cities)
+{
+    m_items.clear();
+    m_index.clear();
+    m_index.reserve(cities.count());
+    m_dirtyFrom = 0;
+
+    for (const CityResult &city : cities) {
+        append(city);
+    }
+}
+
+void FavoritesList::markDirty(int from)
+{
+    m_dirtyFrom = qMin(m_dirtyFrom, from);
+}
+
+void FavoritesList::reindex() const
+{
+    for (int i = m_dirtyFrom; i < m_items.count(); ++i) {
+        m_index[key(m_items.at(i))] = i;
+    }
+    m_dirtyFrom = m_items.count();
+}
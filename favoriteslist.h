@@ -0,0 +1,43 @@
+#ifndef FAVORITESLIST_H
+#define FAVORITESLIST_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include "cityresult.h"
+
+// Ordered favorites with a hash index on the case-folded display name.
+// Lookups are O(1); positions after a removal or move are re-indexed
+// lazily on the next indexOf().
+class FavoritesList
+{
+public:
+    FavoritesList();
+
+    int count() const { return m_items.count(); }
+    bool isEmpty() const { return m_items.isEmpty(); }
+    const CityResult &at(int index) const { return m_items.at(index); }
+    QList<CityResult> toList() const { return m_items; }
+
+    bool contains(const QString &displayName) const;
+    int indexOf(const QString &displayName) const;
+
+    bool append(const CityResult &city);
+    void replace(int index, const CityResult &city);
+    void removeAt(int index);
+    void move(int from, int to);
+    void reset(const QList<CityResult> &cities);
+
+    static QString key(const QString &displayName);
+    static QString key(const CityResult &city) { return key(city.displayName()); }
+
+private:
+    QList<CityResult> m_items;
+    mutable QHash<QString, int> m_index;
+    mutable int m_dirtyFrom;
+
+    void markDirty(int from);
+    void reindex() const;
+};
+
+#endif // FAVORITESLIST_H
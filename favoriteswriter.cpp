@@ -0,0 +1,116 @@
+#include "favoriteswriter.h"
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QDebug>
+
+FavoritesWriter::FavoritesWriter(const QString &filePath, int delayMs)
+    : QObject(nullptr)
+    , m_filePath(filePath)
+    , m_timer(new QTimer(this))
+    , m_dirty(false)
+    , m_armed(false)
+{
+    // Window starts at the first mutation and is not restarted, so a
+    // continuous stream of changes still hits the disk every delayMs
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(delayMs);
+
+    connect(m_timer, &QTimer::timeout,
+            this, &FavoritesWriter::writePending);
+}
+
+void FavoritesWriter::schedule(const QList<CityResult> &favorites)
+{
+    bool needsArm = false;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_pending = favorites;
+        m_dirty = true;
+        if (!m_armed) {
+            m_armed = true;
+            needsArm = true;
+        }
+    }
+
+    // Timer belongs to the worker thread
+    if (needsArm) {
+        QMetaObject::invokeMethod(this, "armTimer", Qt::QueuedConnection);
+    }
+}
+
+void FavoritesWriter::flush()
+{
+    writePending();
+}
+
+void FavoritesWriter::armTimer()
+{
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+void FavoritesWriter::writePending()
+{
+    // Serializes the worker and a shutdown flush from the GUI thread
+    QMutexLocker writeLocker(&m_writeMutex);
+
+    QList<CityResult> snapshot;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_armed = false;
+        if (!m_dirty) {
+            return;
+        }
+        snapshot = m_pending;
+        m_pending.clear();
+        m_dirty = false;
+    }
+
+    writeUnlocked(snapshot);
+}
+
+bool FavoritesWriter::writeFile(const QList<CityResult> &favorites)
+{
+    QMutexLocker writeLocker(&m_writeMutex);
+    return writeUnlocked(favorites);
+}
+
+bool FavoritesWriter::writeUnlocked(const QList<CityResult> &favorites)
+{
+    QJsonArray jsonArray;
+    for (const CityResult &city : favorites) {
+        jsonArray.append(city.toJson());
+    }
+
+    QJsonObject root;
+    root["version"] = FormatVersion;
+    root["favorites"] = jsonArray;
+
+    QJsonDocument doc(root);
+    QSaveFile file(m_filePath);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open file for writing:" << m_filePath;
+        qWarning() << "Error:" << file.errorString();
+        return false;
+    }
+
+    if (file.write(doc.toJson()) == -1) {
+        qWarning() << "Failed to write favorites to file";
+        file.cancelWriting();
+        return false;
+    }
+
+    // Replaces the old file only once everything is on disk
+    if (!file.commit()) {
+        qWarning() << "Failed to commit favorites file:" << file.errorString();
+        return false;
+    }
+
+    qDebug() << "Favorites saved successfully:" << favorites.count() << "cities";
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef FAVORITESWRITER_H
+#define FAVORITESWRITER_H
+
+#include <QObject>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include "cityresult.h"
+
+// Write-behind persistence for the favorites file.
+// Lives on a worker thread: schedule() coalesces snapshots over a short
+// window and the latest one is written atomically with QSaveFile.
+class FavoritesWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FavoritesWriter(const QString &filePath, int delayMs = 250);
+
+    // Bumped whenever the on-disk layout changes
+    static const int FormatVersion = 2;
+
+    // Thread-safe, called from the GUI thread
+    void schedule(const QList<CityResult> &favorites);
+    void flush();
+
+    // Synchronous write on the calling thread
+    bool writeFile(const QList<CityResult> &favorites);
+
+private slots:
+    void armTimer();
+    void writePending();
+
+private:
+    QString m_filePath;
+    QTimer *m_timer;
+
+    QMutex m_pendingMutex;
+    QList<CityResult> m_pending;
+    bool m_dirty;
+    bool m_armed;
+
+    QMutex m_writeMutex;
+
+    bool writeUnlocked(const QList<CityResult> &favorites);
+};
+
+#endif // FAVORITESWRITER_H
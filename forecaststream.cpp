@@ -0,0 +1,175 @@
+#include "forecaststream.h"
+#include "weatherparser.h"
+#include <QJsonDocument>
+#include <QElapsedTimer>
+
+ForecastStream::ForecastStream()
+    : m_depth(0)
+    , m_inString(false)
+    , m_escape(false)
+    , m_inList(false)
+    , m_complete(false)
+    , m_keepBody(false)
+    , m_peakBuffered(0)
+    , m_parseNanos(0)
+{
+}
+
+bool ForecastStream::feed(const QByteArray &chunk)
+{
+    if (hasError()) {
+        return false;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    if (m_keepBody) {
+        m_body += chunk;
+    }
+
+    for (char c : chunk) {
+        if (m_complete) {
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return fail("Invalid JSON response from API");
+            }
+            continue;
+        }
+
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+            }
+            if (!capture(c)) {
+                return false;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '{':
+        case '[':
+            if (m_depth == 0) {
+                if (c != '{') {
+                    return fail("Invalid JSON response from API");
+                }
+                m_depth = 1;
+                break;
+            }
+            // "list": [ switches to buffering one element at a time
+            if (m_depth == 1 && c == '[' && QByteArray(m_buffer).replace(' ', "").trimmed() == "\"list\":") {
+                m_buffer.clear();
+                m_inList = true;
+                m_depth = 2;
+                break;
+            }
+            m_depth++;
+            if (!capture(c)) {
+                return false;
+            }
+            break;
+        case '}':
+        case ']':
+            m_depth--;
+            if (m_depth == 0) {
+                if (!finishMember()) {
+                    return false;
+                }
+                m_complete = true;
+            } else if (m_inList && m_depth == 1) {
+                m_inList = false;
+                m_buffer.clear();
+            } else {
+                if (!capture(c)) {
+                    return false;
+                }
+                if (m_inList && m_depth == 2 && !finishElement()) {
+                    return false;
+                }
+            }
+            break;
+        case ',':
+            if (m_depth == 1) {
+                if (!finishMember()) {
+                    return false;
+                }
+            } else if (!(m_inList && m_depth == 2) && !capture(c)) {
+                return false;
+            }
+            break;
+        case '"':
+            m_inString = true;
+            if (!capture(c)) {
+                return false;
+            }
+            break;
+        default:
+            // Whitespace between list elements
+            if (!(m_inList && m_depth == 2) && m_depth > 0 && !capture(c)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    m_parseNanos += timer.nsecsElapsed();
+    return true;
+}
+
+bool ForecastStream::capture(char c)
+{
+    // Once the forecast is full the remaining elements are only scanned
+    if (m_inList && m_forecast.count() >= WeatherParser::MaxForecastDays) {
+        return true;
+    }
+    m_buffer += c;
+    m_peakBuffered = qMax(m_peakBuffered, int(m_buffer.size()));
+    if (m_buffer.size() > MaxBufferBytes) {
+        return fail("Forecast response element too large");
+    }
+    return true;
+}
+
+bool ForecastStream::finishMember()
+{
+    const QByteArray member = m_buffer.trimmed();
+    m_buffer.clear();
+    if (member.isEmpty()) {
+        return true;
+    }
+    QJsonDocument doc = QJsonDocument::fromJson("{" + member + "}");
+    if (!doc.isObject()) {
+        return fail("Invalid JSON response from API");
+    }
+    const QJsonObject json = doc.object();
+    for (auto it = json.constBegin(); it != json.constEnd(); ++it) {
+        m_envelope.insert(it.key(), it.value());
+    }
+    return true;
+}
+
+bool ForecastStream::finishElement()
+{
+    if (m_buffer.isEmpty()) {
+        return true;
+    }
+    QJsonDocument doc = QJsonDocument::fromJson(m_buffer);
+    m_buffer.clear();
+    if (!doc.isObject()) {
+        return fail("Invalid JSON response from API");
+    }
+    ForecastItem item;
+    if (WeatherParser::parseForecastItem(doc.object(), &m_processedDates, &item)) {
+        m_forecast.addItem(item);
+    }
+    return true;
+}
+
+bool ForecastStream::fail(const QString &error)
+{
+    m_error = error;
+    m_buffer.clear();
+    return false;
+}
@@ -0,0 +1,64 @@
+#ifndef FORECASTSTREAM_H
+#define FORECASTSTREAM_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+#include "forecastdata.h"
+
+// Resumable parser for a forecast response, fed as the bytes arrive.
+// Only the member or "list" element being read is buffered; each list
+// element is parsed as soon as its closing brace arrives, so parsing
+// overlaps the download. Items are selected as in
+// WeatherParser::parseForecastObject().
+class ForecastStream
+{
+public:
+    ForecastStream();
+
+    // False once the input is known to be malformed
+    bool feed(const QByteArray &chunk);
+
+    // The root object has been closed
+    bool isComplete() const { return m_complete; }
+    bool hasError() const { return !m_error.isEmpty(); }
+    QString error() const { return m_error; }
+
+    const ForecastData &forecast() const { return m_forecast; }
+    // Top-level members other than "list", e.g. cod and message
+    QJsonObject envelope() const { return m_envelope; }
+
+    // Also keep the whole body, e.g. for the shared cache
+    void setKeepBody(bool keep) { m_keepBody = keep; }
+    QByteArray body() const { return m_body; }
+
+    int peakBufferedBytes() const { return m_peakBuffered; }
+    qint64 parseMicros() const { return m_parseNanos / 1000; }
+
+    // A single member or list element larger than this is an error
+    static const int MaxBufferBytes = 64 * 1024;
+
+private:
+    QByteArray m_buffer;
+    QByteArray m_body;
+    QJsonObject m_envelope;
+    ForecastData m_forecast;
+    QSet<QString> m_processedDates;
+    QString m_error;
+    int m_depth;
+    bool m_inString;
+    bool m_escape;
+    bool m_inList;
+    bool m_complete;
+    bool m_keepBody;
+    int m_peakBuffered;
+    qint64 m_parseNanos;
+
+    bool capture(char c);
+    bool finishMember();
+    bool finishElement();
+    bool fail(const QString &error);
+};
+
+#endif // FORECASTSTREAM_H
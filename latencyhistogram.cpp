@@ -0,0 +1,90 @@
+#include "latencyhistogram.h"
+#include <QtAlgorithms>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::atomic<quint64> &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketIndex(quint64 value)
+{
+    // Values below SubBucketCount get one bucket each; above that every
+    // power of two is split into HalfBucketCount linear buckets
+    if (value < quint64(SubBucketCount)) {
+        return int(value);
+    }
+
+    int msb = 63 - qCountLeadingZeroBits(value);
+    int shift = msb - (PrecisionBits - 1);
+    int top = int(value >> shift);
+    int index = SubBucketCount + (shift - 1) * HalfBucketCount + (top - HalfBucketCount);
+    return qMin(index, BucketCount - 1);
+}
+
+quint64 LatencyHistogram::bucketMidpoint(int index)
+{
+    if (index < SubBucketCount) {
+        return quint64(index);
+    }
+
+    int offset = index - SubBucketCount;
+    int shift = offset / HalfBucketCount + 1;
+    quint64 top = quint64(offset % HalfBucketCount + HalfBucketCount);
+    quint64 low = top << shift;
+    quint64 high = ((top + 1) << shift) - 1;
+    return low + (high - low) / 2;
+}
+
+void LatencyHistogram::record(qint64 micros)
+{
+    quint64 value = micros > 0 ? quint64(micros) : 0;
+
+    m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    quint64 currentMax = m_max.load(std::memory_order_relaxed);
+    while (value > currentMax
+           && !m_max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const
+{
+    quint64 total = count();
+    if (total == 0) {
+        return 0.0;
+    }
+    return double(m_sum.load(std::memory_order_relaxed)) / double(total);
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    quint64 total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    quint64 target = quint64(std::ceil(qBound(0.0, percent, 100.0) / 100.0 * double(total)));
+    target = qMax<quint64>(target, 1);
+
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return qMin(qint64(bucketMidpoint(i)), max());
+        }
+    }
+    return max();
+}
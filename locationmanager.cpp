@@ -1,116 +1,178 @@
 #include "locationmanager.h"
+#include "favoriteswriter.h"
+#include "memoryaccountant.h"
+#include "stallwatchdog.h"
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
+#include <QJsonObject>
 #include <QStandardPaths>
 #include <QDir>
+#include <QFileInfo>
 #include <QDebug>
 
 LocationManager::LocationManager(QObject *parent)
+    : LocationManager(getFavoritesFilePath(), parent)
+{
+}
+
+LocationManager::LocationManager(const QString &filePath, QObject *parent)
     : QObject(parent)
+    , m_filePath(filePath)
+    , m_writerThread(new QThread(this))
+    , m_writer(new FavoritesWriter(m_filePath))
+    , m_cacheId(0)
+    , m_readOnly(false)
 {
-    loadFavorites();
+    // Disk writes happen off the GUI thread
+    m_writer->moveToThread(m_writerThread);
+    connect(m_writerThread, &QThread::finished,
+            m_writer, &QObject::deleteLater);
+    m_writerThread->start();
+
+    // User data counts against the budget but is never evicted. Sized per
+    // entry rather than by walking the list, so large lists stay cheap.
+    m_cacheId = MemoryAccountant::instance()->registerCache(
+        "favorites", 1.0,
+        [this](const QString &) {
+            CityResult typical;
+            typical.name = QString(16, QChar(' '));
+            typical.country = QString(2, QChar(' '));
+            return m_favorites.count() * (typical.memoryCost() + qint64(sizeof(void *)) * 4);
+        },
+        [](const QString &) {
+            return false;
+        });
 }
 
-void LocationManager::addLocation(const QString &city)
+LocationManager::~LocationManager()
 {
-    QString normalizedCity = city.trimmed();
+    // Write anything still pending before the thread goes away
+    flush();
+    m_writerThread->quit();
+    m_writerThread->wait();
+    MemoryAccountant::instance()->unregisterCache(m_cacheId);
+}
 
-    if (normalizedCity.isEmpty()) {
+void LocationManager::addLocation(const CityResult &city)
+{
+    CityResult normalizedCity = city;
+    normalizedCity.name = city.name.trimmed();
+    normalizedCity.state = city.state.trimmed();
+    normalizedCity.country = city.country.trimmed();
+
+    if (normalizedCity.name.isEmpty()) {
         qWarning() << "Cannot add empty city name";
         return;
     }
 
-    if (m_favorites.contains(normalizedCity, Qt::CaseInsensitive)) {
-        qWarning() << "City already in favorites:" << normalizedCity;
+    if (!m_favorites.append(normalizedCity)) {
+        qWarning() << "City already in favorites:" << normalizedCity.displayName();
         return;
     }
 
-    m_favorites.append(normalizedCity);
     saveFavorites();
-    emit locationAdded(normalizedCity);
-    emit favoritesChanged();
+    emit locationInserted(m_favorites.count() - 1, normalizedCity);
 }
 
-void LocationManager::removeLocation(const QString &city)
+void LocationManager::updateLocation(const CityResult &city)
 {
-    QString normalizedCity = city.trimmed();
-
-    // Remove case-insensitive
-    for (int i = 0; i < m_favorites.size(); ++i) {
-        if (m_favorites[i].compare(normalizedCity, Qt::CaseInsensitive) == 0) {
-            m_favorites.removeAt(i);
-            saveFavorites();
-            emit locationRemoved(normalizedCity);
-            emit favoritesChanged();
-            return;
-        }
+    int index = m_favorites.indexOf(city.displayName());
+    if (index < 0) {
+        return;
+    }
+
+    // Backfills coordinates and ID of migrated entries
+    const CityResult &current = m_favorites.at(index);
+    if (current.cityId == city.cityId
+        && current.hasCoordinates() == city.hasCoordinates()
+        && (!city.hasCoordinates() || (current.lat == city.lat && current.lon == city.lon))) {
+        return;
     }
 
-    qWarning() << "City not found in favorites:" << normalizedCity;
+    m_favorites.replace(index, city);
+    saveFavorites();
 }
 
-void LocationManager::reorderLocations(const QStringList &newOrder)
+void LocationManager::removeLocation(const QString &displayName)
 {
-    m_favorites = newOrder;
+    int index = m_favorites.indexOf(displayName);
+
+    if (index < 0) {
+        qWarning() << "City not found in favorites:" << displayName.trimmed();
+        return;
+    }
+
+    CityResult removedCity = m_favorites.at(index);
+    m_favorites.removeAt(index);
     saveFavorites();
-    emit favoritesChanged();
+    emit locationRemoved(index, removedCity);
 }
 
-bool LocationManager::isFavorite(const QString &city) const
+void LocationManager::moveLocation(int from, int to)
 {
-    return m_favorites.contains(city.trimmed(), Qt::CaseInsensitive);
+    if (from < 0 || from >= m_favorites.count() || to < 0 || to >= m_favorites.count() || from == to) {
+        return;
+    }
+
+    m_favorites.move(from, to);
+    saveFavorites();
+    emit locationMoved(from, to);
 }
 
-QStringList LocationManager::getFavorites() const
+bool LocationManager::isFavorite(const QString &displayName) const
 {
-    return m_favorites;
+    return m_favorites.contains(displayName);
 }
 
-QString LocationManager::getFavoritesFilePath() const
+QList<CityResult> LocationManager::getFavorites() const
 {
-    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    QDir dir(dataPath);
+    return m_favorites.toList();
+}
 
-    if (!dir.exists()) {
-        if (!dir.mkpath(".")) {
-            qWarning() << "Failed to create data directory:" << dataPath;
-        }
+CityResult LocationManager::favoriteAt(int index) const
+{
+    if (index < 0 || index >= m_favorites.count()) {
+        return CityResult();
     }
+    return m_favorites.at(index);
+}
 
+QString LocationManager::getFavoritesFilePath()
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     return dataPath + "/favorites.json";
 }
 
 void LocationManager::saveFavorites()
 {
-    QJsonArray jsonArray;
-    for (const QString &city : m_favorites) {
-        jsonArray.append(city);
-    }
-
-    QJsonDocument doc(jsonArray);
-    QString filePath = getFavoritesFilePath();
-    QFile file(filePath);
-
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning() << "Failed to open file for writing:" << filePath;
-        qWarning() << "Error:" << file.errorString();
+    MemoryAccountant::instance()->charge(m_cacheId, "list");
+    if (m_readOnly) {
         return;
     }
+    StallScope stallScope("persist");
+    // QList is implicitly shared, so the snapshot is cheap
+    m_writer->schedule(m_favorites.toList());
+}
 
-    qint64 bytesWritten = file.write(doc.toJson());
-    file.close();
-
-    if (bytesWritten == -1) {
-        qWarning() << "Failed to write favorites to file";
-    } else {
-        qDebug() << "Favorites saved successfully:" << m_favorites.count() << "cities";
-    }
+void LocationManager::flush()
+{
+    m_writer->flush();
 }
 
 void LocationManager::loadFavorites()
 {
-    QString filePath = getFavoritesFilePath();
+    StallScope stallScope("persist");
+    QString filePath = m_filePath;
+
+    // Created here so constructing the manager does no disk I/O
+    QDir dir = QFileInfo(filePath).absoluteDir();
+    if (!dir.exists()) {
+        if (!dir.mkpath(".")) {
+            qWarning() << "Failed to create data directory:" << dir.path();
+        }
+    }
+
     QFile file(filePath);
 
     if (!file.exists()) {
@@ -129,18 +191,53 @@ void LocationManager::loadFavorites()
 
     QJsonDocument doc = QJsonDocument::fromJson(data);
 
-    if (doc.isNull() || !doc.isArray()) {
+    if (doc.isNull() || (!doc.isArray() && !doc.isObject())) {
         qWarning() << "Invalid JSON in favorites file";
         return;
     }
 
-    QJsonArray jsonArray = doc.array();
-    m_favorites.clear();
+    QList<CityResult> cities;
+    bool migrated = false;
 
-    for (const QJsonValue &value : jsonArray) {
-        if (value.isString()) {
-            m_favorites.append(value.toString());
+    if (doc.isArray()) {
+        // Version 1: plain display strings, resolved on first fetch
+        QJsonArray jsonArray = doc.array();
+        cities.reserve(jsonArray.size());
+
+        for (const QJsonValue &value : jsonArray) {
+            if (value.isString()) {
+                cities.append(CityResult::fromDisplayName(value.toString().trimmed()));
+            }
+        }
+        migrated = true;
+    } else {
+        QJsonObject root = doc.object();
+        int version = root["version"].toInt();
+        // Saving would rewrite it in this version's format and drop what
+        // the newer one added, so changes stay in memory this session
+        m_readOnly = version > FavoritesWriter::FormatVersion;
+        if (m_readOnly) {
+            qWarning() << "Favorites file version" << version
+                       << "is newer than supported; changes will not be saved";
         }
+
+        QJsonArray jsonArray = root["favorites"].toArray();
+        cities.reserve(jsonArray.size());
+
+        for (const QJsonValue &value : jsonArray) {
+            if (value.isObject()) {
+                cities.append(CityResult::fromJson(value.toObject()));
+            }
+        }
+    }
+
+    m_favorites.reset(cities);
+    MemoryAccountant::instance()->charge(m_cacheId, "list");
+    emit favoritesReset();
+
+    if (migrated) {
+        qDebug() << "Migrating favorites file to version" << FavoritesWriter::FormatVersion;
+        saveFavorites();
     }
 
     qDebug() << "Favorites loaded successfully:" << m_favorites.count() << "cities";
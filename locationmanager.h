@@ -2,7 +2,11 @@
 #define LOCATIONMANAGER_H
 
 #include <QObject>
-#include <QStringList>
+#include <QList>
+#include <QThread>
+#include "favoriteslist.h"
+
+class FavoritesWriter;
 
 class LocationManager : public QObject
 {
@@ -10,25 +14,40 @@ class LocationManager : public QObject
 
 public:
     explicit LocationManager(QObject *parent = nullptr);
-
-    void addLocation(const QString &city);
-    void removeLocation(const QString &city);
-    bool isFavorite(const QString &city) const;
-    QStringList getFavorites() const;
+    explicit LocationManager(const QString &filePath, QObject *parent = nullptr);
+    ~LocationManager();
+
+    void addLocation(const CityResult &city);
+    void updateLocation(const CityResult &city);
+    void removeLocation(const QString &displayName);
+    bool isFavorite(const QString &displayName) const;
+    QList<CityResult> getFavorites() const;
+    CityResult favoriteAt(int index) const;
     int count() const { return m_favorites.count(); }
-    void reorderLocations(const QStringList &newOrder);
+    void moveLocation(int from, int to);
 
     void saveFavorites();
     void loadFavorites();
+    void flush();
+    // Set when the file was written by a newer version; nothing is saved
+    // for the rest of the session, so its extra fields survive
+    bool isReadOnly() const { return m_readOnly; }
 
 signals:
-    void favoritesChanged();
-    void locationAdded(const QString &city);
-    void locationRemoved(const QString &city);
+    // Granular notifications so views only touch the affected rows
+    void locationInserted(int index, const CityResult &city);
+    void locationRemoved(int index, const CityResult &city);
+    void locationMoved(int from, int to);
+    void favoritesReset();
 
 private:
-    QStringList m_favorites;
-    QString getFavoritesFilePath() const;
+    FavoritesList m_favorites;
+    QString m_filePath;
+    QThread *m_writerThread;
+    FavoritesWriter *m_writer;
+    int m_cacheId;
+    bool m_readOnly;
+    static QString getFavoritesFilePath();
 };
 
 #endif // LOCATIONMANAGER_H
@@ -1,10 +1,131 @@
 #include "mainwindow.h"
+#include "startuptrace.h"
+#include "metrics.h"
+#include "batchrunner.h"
+#include "proxyserver.h"
+#include "apiendpoints.h"
+#include "networkwarmup.h"
+#include "stallwatchdog.h"
+#include "tracer.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QHostAddress>
+#include <QDebug>
+#include <cstring>
+
+static bool hasArgument(int argc, char *argv[], const char *name)
+{
+    // Matches "--name value" and "--name=value"
+    size_t length = std::strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], name, length) == 0
+            && (argv[i][length] == '\0' || argv[i][length] == '=')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Headless mode for cron jobs and pipelines, no display needed
+static int runBatch(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qt-weather-dashboard");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fetch weather for many locations and print NDJSON");
+    parser.addHelpOption();
+    QCommandLineOption batchOption("batch", "Read locations from <file>, one per line (- for stdin).", "file");
+    QCommandLineOption concurrencyOption("concurrency", "Maximum requests in flight.", "n", "8");
+    QCommandLineOption rateOption("rate", "Maximum requests per second (0 = unlimited).", "rps", "0");
+    QCommandLineOption noForecastOption("no-forecast", "Only fetch current weather.");
+    parser.addOptions({batchOption, concurrencyOption, rateOption, noForecastOption});
+    parser.process(app);
+    Tracer::enableFromEnvironment();
+
+    BatchRunner::Options options;
+    options.inputPath = parser.value(batchOption);
+    options.concurrency = parser.value(concurrencyOption).toInt();
+    options.rateLimit = parser.value(rateOption).toDouble();
+    options.includeForecast = !parser.isSet(noForecastOption);
+
+    MetricsExporter metricsExporter;
+    metricsExporter.startFromEnvironment();
+
+    BatchRunner runner(options);
+    QObject::connect(&runner, &BatchRunner::finished, &app, [&](int exitCode) {
+        metricsExporter.writeNow();
+        QCoreApplication::exit(exitCode);
+    });
+    QTimer::singleShot(0, &runner, &BatchRunner::start);
+
+    return app.exec();
+}
+
+// Caching proxy for a LAN of dashboards sharing one API key
+static int runServer(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qt-weather-dashboard");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Serve cached OpenWeatherMap responses to dashboards on the LAN");
+    parser.addHelpOption();
+    QCommandLineOption serveOption("serve", "Listen on <port>.", "port", "8080");
+    QCommandLineOption listenOption("listen", "Address to bind.", "address", "0.0.0.0");
+    QCommandLineOption upstreamOption("upstream", "Upstream API root.", "url", ApiEndpoints::DefaultApiBaseUrl);
+    QCommandLineOption maxEntriesOption("max-entries", "Maximum cached responses.", "n", "10000");
+    parser.addOptions({serveOption, listenOption, upstreamOption, maxEntriesOption});
+    parser.process(app);
+
+    ProxyServer::Options options;
+    options.address = QHostAddress(parser.value(listenOption));
+    options.port = quint16(parser.value(serveOption).toUInt());
+    options.upstreamUrl = parser.value(upstreamOption);
+    // Chained proxies serve icons too
+    options.iconUpstreamUrl = parser.isSet(upstreamOption) ? options.upstreamUrl
+                                                           : QString(ApiEndpoints::DefaultIconBaseUrl);
+    options.maxEntries = parser.value(maxEntriesOption).toInt();
+
+    MetricsExporter metricsExporter;
+    metricsExporter.startFromEnvironment();
+
+    ProxyServer server(options);
+    if (!server.listen()) {
+        qCritical() << "Could not start proxy:" << server.errorString();
+        return 1;
+    }
+
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    if (hasArgument(argc, argv, "--batch")) {
+        return runBatch(argc, argv);
+    }
+    if (hasArgument(argc, argv, "--serve")) {
+        return runServer(argc, argv);
+    }
+
+    StartupTrace::begin();
+
     QApplication a(argc, argv);
+    StartupTrace::mark("QApplication init");
+
+    // DNS runs on Qt's lookup threads while the window is set up
+    NetworkWarmup::loadSessions();
+    NetworkWarmup::resolveHosts();
+
+    StallWatchdog::start();
+    Tracer::enableFromEnvironment();
+
+    MetricsExporter metricsExporter;
+    metricsExporter.startFromEnvironment();
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -6,15 +6,119 @@
 #include <QTableWidgetItem>
 #include <QListWidgetItem>
 #include <QDebug>
+#include <QBuffer>
+#include <QTimer>
+#include "weathersnapshot.h"
+#include "startuptrace.h"
+#include "metrics.h"
+#include "diagnosticsdialog.h"
+#include "apiendpoints.h"
+#include "memoryaccountant.h"
+#include "networkwarmup.h"
+#include "viewupdater.h"
+#include "temperaturemapwidget.h"
+#include "stallwatchdog.h"
+#include "sharedcache.h"
+#include "tracer.h"
+#include "refreshscheduler.h"
+#include <QShortcut>
+#include <QDockWidget>
+#include <QGuiApplication>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_weatherService(new WeatherService(this))
     , m_locationManager(new LocationManager(this))
-    , m_iconManager(new QNetworkAccessManager(this))
+    , m_iconManager(nullptr)
+    , m_iconCacheId(0)
+    , m_viewUpdater(nullptr)
+    , m_alertEngine(new AlertEngine(this))
+    , m_statsLabel(nullptr)
+    , m_weatherRequestId(0)
+    , m_forecastRequestId(0)
+    , m_repaintFlow(0)
+    , m_refreshTaskId(0)
+    , m_nearbyList(nullptr)
+    , m_temperatureMap(nullptr)
+    , m_staleLabel(new QLabel(this))
+    , m_errorLabel(new QLabel(this))
+    , m_diagnosticsDialog(nullptr)
+    , m_syncingFavorites(false)
+    , m_snapshotRestored(false)
+    , m_startupScheduled(false)
+    , m_firstPaintDone(false)
+    , m_firstResponseLogged(false)
 {
+    // The whole form is built here. The forecast table is in the first
+    // frame, since the snapshot paints into it, and the favorites list is
+    // built empty; what is deferred is filling them, in finishStartup().
     ui->setupUi(this);
+    StartupTrace::mark("setupUi");
+
+    // All panel updates go through one per-frame, diffing updater
+    ViewUpdater::WeatherPanel panel;
+    panel.city = ui->cityLabel;
+    panel.temperature = ui->temperatureLabel;
+    panel.description = ui->descriptionLabel;
+    panel.feelsLike = ui->feelsLikeLabel;
+    panel.humidity = ui->humidityLabel;
+    panel.wind = ui->windLabel;
+    m_viewUpdater = new ViewUpdater(panel, ui->forecastTableWidget, this);
+    connect(m_viewUpdater, &ViewUpdater::forecastIconChanged,
+            this, [this](int row, const QString &iconCode) {
+                downloadForecastIcon(iconCode, row);
+            });
+    connect(m_viewUpdater, &ViewUpdater::rendered,
+            this, [this](quint64 flow) {
+                m_repaintFlow = flow;
+            });
+
+    // User-defined alert rules, checked on every refresh
+    int alertRules = m_alertEngine->loadRules(AlertEngine::defaultRulesPath());
+    if (alertRules > 0) {
+        qDebug() << "Loaded" << alertRules << "alert rules";
+    }
+    connect(m_alertEngine, &AlertEngine::alertRaised,
+            this, [this](const AlertEngine::Alert &alert) {
+                qWarning().noquote() << "Alert:" << alert.rule << "in" << alert.city;
+                setStatusMessage(QString("Alert: %1 in %2").arg(alert.rule, alert.city));
+            });
+    connect(m_alertEngine, &AlertEngine::alertCleared,
+            this, [](const AlertEngine::Alert &alert) {
+                qDebug().noquote() << "Alert cleared:" << alert.rule << "in" << alert.city;
+            });
+
+    // The current city is refreshed about as often as the API updates,
+    // and not at all while nobody can see it
+    bool refreshOk = false;
+    int refreshMinutes = qEnvironmentVariable("WEATHER_REFRESH_MINUTES").toInt(&refreshOk);
+    if (!refreshOk) {
+        refreshMinutes = 10;
+    }
+    if (refreshMinutes > 0) {
+        m_refreshTaskId = RefreshScheduler::instance()->addTask(
+            "weather.refresh", refreshMinutes * 60 * 1000, RefreshScheduler::Pause,
+            [this]() {
+                if (m_currentLocation.isValid()) {
+                    fetchLocation(m_currentLocation);
+                }
+            });
+    }
+    connect(qApp, &QGuiApplication::applicationStateChanged,
+            this, &MainWindow::updateSchedulerState);
+
+    // Icons can be fetched again, so they give way to other caches first
+    m_iconCacheId = MemoryAccountant::instance()->registerCache(
+        "icons", 0.5,
+        [this](const QString &code) {
+            QPixmap pixmap = m_forecastIcons.value(code);
+            return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+        },
+        [this](const QString &code) {
+            m_forecastIcons.remove(code);
+            return true;
+        });
 
     // Create and setup city search widget
     m_citySearchWidget = new CitySearchWidget(this);
@@ -29,12 +133,32 @@ MainWindow::MainWindow(QWidget *parent)
     }
 
     // Connect weather service signals
-    connect(m_weatherService, &WeatherService::weatherDataReady,
-            this, &MainWindow::onWeatherDataReady);
-    connect(m_weatherService, &WeatherService::forecastDataReady,
-            this, &MainWindow::onForecastDataReady);
-    connect(m_weatherService, &WeatherService::errorOccurred,
-            this, &MainWindow::onWeatherError);
+    // Replies for a city that is no longer selected are dropped, so they
+    // never update or persist the current location
+    connect(m_weatherService, &WeatherService::weatherReplyReady,
+            this, [this](quint64 requestId, const WeatherData &data) {
+                if (requestId == m_weatherRequestId) {
+                    onWeatherDataReady(data);
+                }
+            });
+    connect(m_weatherService, &WeatherService::forecastReplyReady,
+            this, [this](quint64 requestId, const ForecastData &data) {
+                if (requestId == m_forecastRequestId) {
+                    onForecastDataReady(data);
+                }
+            });
+    connect(m_weatherService, &WeatherService::forecastItemReady,
+            this, &MainWindow::onForecastItemReady);
+    // Errors are scoped the same way: only the current weather request
+    // may show the error label or the nearby fallback
+    connect(m_weatherService, &WeatherService::requestFailed,
+            this, [this](quint64 requestId, const QString &error) {
+                if (requestId == m_weatherRequestId) {
+                    onWeatherError(error);
+                } else if (requestId == m_forecastRequestId) {
+                    setStatusMessage("Error loading forecast: " + error);
+                }
+            });
 
     // Connect city search widget
     connect(m_citySearchWidget, &CitySearchWidget::citySelected,
@@ -57,15 +181,118 @@ MainWindow::MainWindow(QWidget *parent)
             this, &MainWindow::onLoadFirstFavoriteClicked);
 
     // Connect location manager
-    connect(m_locationManager, &LocationManager::favoritesChanged,
-            this, &MainWindow::onFavoritesChanged);
+    connect(m_locationManager, &LocationManager::locationInserted,
+            this, &MainWindow::onFavoriteInserted);
+    connect(m_locationManager, &LocationManager::locationRemoved,
+            this, &MainWindow::onFavoriteRemoved);
+    connect(m_locationManager, &LocationManager::locationMoved,
+            this, &MainWindow::onFavoriteMoved);
+    connect(m_locationManager, &LocationManager::favoritesReset,
+            this, &MainWindow::onFavoritesReset);
     connect(ui->favoritesListWidget->model(), &QAbstractItemModel::rowsMoved,
             this, &MainWindow::onFavoritesReordered);
 
-    // Connect icon download manager
-    connect(m_iconManager, &QNetworkAccessManager::finished,
-            this, &MainWindow::onIconDownloaded);
+    // Hidden diagnostics panel
+    QShortcut *diagnosticsShortcut = new QShortcut(QKeySequence("Ctrl+Shift+D"), this);
+    connect(diagnosticsShortcut, &QShortcut::activated,
+            this, &MainWindow::onDiagnosticsRequested);
+    QShortcut *traceShortcut = new QShortcut(QKeySequence("Ctrl+Shift+T"), this);
+    connect(traceShortcut, &QShortcut::activated,
+            this, &MainWindow::onTraceRequested);
+
+    setupNearbyPanel();
+
+    // Age of the saved snapshot while it is on screen
+    m_staleLabel->hide();
+    statusBar()->addPermanentWidget(m_staleLabel);
+
+    // Last lookup error, until the next success
+    m_errorLabel->setStyleSheet("color: #c0392b;");
+    m_errorLabel->hide();
+    statusBar()->addPermanentWidget(m_errorLabel);
+
+    // Paint the last session immediately; the rest waits until the window is shown
+    m_snapshotRestored = restoreSnapshot();
+    StartupTrace::mark("snapshot render");
+}
+
+bool MainWindow::event(QEvent *event)
+{
+    // The first repaint after an update closes that update's flow
+    if (event->type() == QEvent::UpdateRequest && m_repaintFlow != 0) {
+        TraceSpan traceSpan("repaint", m_repaintFlow);
+        m_repaintFlow = 0;
+        return QMainWindow::event(event);
+    }
+
+    bool result = QMainWindow::event(event);
+
+    if (event->type() == QEvent::Show || event->type() == QEvent::Hide
+        || event->type() == QEvent::WindowStateChange) {
+        updateSchedulerState();
+    }
+
+    // Deferred phase. Started on show, not on the first paint, so a window
+    // that starts minimized or is never exposed still loads and fetches.
+    // The update request posted by show() is handled before the timer, so
+    // a visible window still paints first.
+    if (event->type() == QEvent::Show && !m_startupScheduled) {
+        m_startupScheduled = true;
+        QTimer::singleShot(0, this, &MainWindow::finishStartup);
+    }
+
+    if (event->type() == QEvent::Paint && !m_firstPaintDone) {
+        m_firstPaintDone = true;
+        StartupTrace::mark("first paint");
+    }
+
+    return result;
+}
+
+void MainWindow::finishStartup()
+{
+    // The network managers are created here, after the window is shown, and
+    // their handshakes run while the rest of startup finishes
+    if (NetworkWarmup::isEnabled()) {
+        m_weatherService->prewarm();
+        m_citySearchWidget->prewarm();
+        NetworkWarmup::prewarm(iconManager(), ApiEndpoints::iconBaseUrl());
+        StartupTrace::mark("network prewarm");
+    }
 
+    setupForecastTable();
+    if (m_currentForecast.count() > 0) {
+        updateForecastDisplay(m_currentForecast);
+    }
+    StartupTrace::mark("forecast table");
+
+    // Load favorites list
+    m_locationManager->loadFavorites();
+    if (m_locationManager->isReadOnly()) {
+        setStatusMessage("Favorites were saved by a newer version; changes will not be saved");
+    }
+    StartupTrace::mark("favorites load");
+
+    // Rolling statistics carry on from the saved history
+    const QString historyPath = RollingStats::defaultHistoryPath();
+    m_rollingStats.load(historyPath);
+    m_rollingStats.setHistoryPath(historyPath);
+    refreshStats();
+    StartupTrace::mark("history load");
+
+    // Refresh the snapshot in the background, or load the first favorite
+    if (m_snapshotRestored) {
+        fetchLocation(m_currentLocation);
+    } else {
+        loadFirstFavorite();
+    }
+    StartupTrace::mark("network start");
+
+    StartupTrace::finish();
+}
+
+void MainWindow::setupForecastTable()
+{
     // Configure forecast table
     ui->forecastTableWidget->horizontalHeader()->setStretchLastSection(true);
     ui->forecastTableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -75,60 +302,403 @@ MainWindow::MainWindow(QWidget *parent)
     // Icon size
     ui->forecastTableWidget->setIconSize(QSize(64, 64));
     ui->forecastTableWidget->horizontalHeader()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+}
 
-    // Load favorites list
-    updateFavoritesList();
-
-    // Load first favorite city automatically
-    loadFirstFavorite();
+QNetworkAccessManager *MainWindow::iconManager()
+{
+    // Created by the startup prewarm, or on the first icon download
+    if (!m_iconManager) {
+        m_iconManager = new QNetworkAccessManager(this);
+        connect(m_iconManager, &QNetworkAccessManager::finished,
+                this, &MainWindow::onIconDownloaded);
+    }
+    return m_iconManager;
 }
 
 MainWindow::~MainWindow()
 {
+    saveSnapshot();
+    NetworkWarmup::saveSessions();
+    MemoryAccountant::instance()->unregisterCache(m_iconCacheId);
+    RefreshScheduler::instance()->removeTask(m_refreshTaskId);
     delete ui;
 }
 
-void MainWindow::onCitySelected(const QString &cityName, double lat, double lon)
+bool MainWindow::restoreSnapshot()
 {
-    Q_UNUSED(lat);
-    Q_UNUSED(lon);
+    StallScope stallScope("persist");
+    WeatherSnapshot snapshot;
+    if (!snapshot.load(WeatherSnapshot::defaultFilePath()) || !snapshot.isValid()) {
+        return false;
+    }
+
+    // Icons first so the forecast rows pick them from the cache
+    for (auto it = snapshot.icons.constBegin(); it != snapshot.icons.constEnd(); ++it) {
+        QPixmap pixmap;
+        if (pixmap.loadFromData(it.value(), "PNG")) {
+            cacheIcon(it.key(), pixmap);
+        }
+    }
+
+    m_currentLocation = snapshot.location;
+    if (!m_currentLocation.isValid()) {
+        m_currentLocation.name = snapshot.weather.cityName();
+        m_currentLocation.country = snapshot.weather.country();
+    }
+    m_currentCity = m_currentLocation.name;
+    m_currentCityFull = snapshot.displayName;
+    m_currentWeather = snapshot.weather;
+    m_citySearchWidget->setText(m_currentCityFull);
+
+    updateWeatherDisplay(snapshot.weather);
+    m_viewUpdater->flush();
+    QPixmap icon = cachedIcon(snapshot.weather.iconCode());
+    if (!icon.isNull()) {
+        ui->weatherIconLabel->setPixmap(icon);
+    }
 
+    // Forecast rows are filled in once the table is set up
+    m_currentForecast = snapshot.forecast;
+    ui->addFavoritesPushButton->setEnabled(true);
+
+    QString age = WeatherSnapshot::formatAge(snapshot.ageSeconds());
+    m_staleLabel->setText("Saved " + age);
+    m_staleLabel->show();
+    setStatusMessage("Showing saved weather from " + age + ", refreshing...");
+    return true;
+}
+
+void MainWindow::saveSnapshot()
+{
+    StallScope stallScope("persist");
+    if (!m_currentWeather.isValid()) {
+        return;
+    }
+
+    WeatherSnapshot snapshot;
+    snapshot.location = m_currentLocation;
+    snapshot.displayName = m_currentCityFull;
+    snapshot.weather = m_currentWeather;
+    snapshot.forecast = m_currentForecast;
+    snapshot.savedAt = QDateTime::currentDateTimeUtc();
+
+    // Only the icons needed to repaint this state
+    QStringList iconCodes;
+    iconCodes.append(m_currentWeather.iconCode());
+    for (const ForecastItem &item : m_currentForecast.items()) {
+        iconCodes.append(item.iconCode());
+    }
+
+    for (const QString &code : iconCodes) {
+        if (code.isEmpty() || snapshot.icons.contains(code) || !m_forecastIcons.contains(code)) {
+            continue;
+        }
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        if (m_forecastIcons[code].save(&buffer, "PNG")) {
+            snapshot.icons.insert(code, png);
+        }
+    }
+
+    snapshot.save(WeatherSnapshot::defaultFilePath());
+}
+
+void MainWindow::onCitySelected(const QString &cityName, double lat, double lon)
+{
     m_currentCity = cityName;
 
     // Save city
     CityResult selectedCity = m_citySearchWidget->selectedCity();
+    selectedCity.lat = lat;
+    selectedCity.lon = lon;
     m_currentCityFull = selectedCity.fullName();
 
     setStatusMessage("Searching weather for " + cityName + "...");
 
     // Fetch both current weather and forecast
-    m_weatherService->fetchWeather(cityName);
-    m_weatherService->fetchForecast(cityName);
+    fetchLocation(selectedCity);
+}
+
+void MainWindow::setupNearbyPanel()
+{
+    // Known cities around the current one, closest first
+    m_nearbyList = new QListWidget(this);
+    QDockWidget *dock = new QDockWidget("Nearby", this);
+    dock->setObjectName("nearbyDock");
+    dock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable);
+    dock->setWidget(m_nearbyList);
+    addDockWidget(Qt::RightDockWidgetArea, dock);
+
+    connect(m_nearbyList, &QListWidget::itemActivated,
+            this, &MainWindow::onNearbyActivated);
+
+    // Temperature map of every tracked location, tabbed with Nearby
+    m_temperatureMap = new TemperatureMapWidget(this);
+    QDockWidget *mapDock = new QDockWidget("Map", this);
+    mapDock->setObjectName("mapDock");
+    mapDock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable);
+    mapDock->setWidget(m_temperatureMap);
+    tabifyDockWidget(dock, mapDock);
+
+    // Rolling statistics for the current city
+    m_statsLabel = new QLabel(this);
+    m_statsLabel->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+    m_statsLabel->setMargin(8);
+    QDockWidget *statsDock = new QDockWidget("Trends", this);
+    statsDock->setObjectName("statsDock");
+    statsDock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable);
+    statsDock->setWidget(m_statsLabel);
+    tabifyDockWidget(dock, statsDock);
+    dock->raise();
+}
+
+void MainWindow::refreshStats()
+{
+    const RollingStats::Summary summary = m_rollingStats.summary(m_currentLocation.displayName());
+    if (!m_currentLocation.isValid() || !summary.isValid()) {
+        m_statsLabel->setText("No observations yet");
+        return;
+    }
+
+    auto range = [](const QString &label, const RollingStats::Range &range) {
+        if (range.count == 0) {
+            return label + ": -";
+        }
+        return QString("%1: %2 to %3 °C, mean %4 (%5 readings)")
+            .arg(label)
+            .arg(range.min, 0, 'f', 1)
+            .arg(range.max, 0, 'f', 1)
+            .arg(range.mean, 0, 'f', 1)
+            .arg(range.count);
+    };
+    auto trend = [](const QString &label, double perHour, const QString &unit) {
+        if (qIsNaN(perHour)) {
+            return label + ": -";
+        }
+        QString direction = qAbs(perHour) < 0.1 ? "steady" : (perHour > 0 ? "rising" : "falling");
+        return QString("%1: %2 (%3%4 %5/h)")
+            .arg(label, direction, QString(perHour > 0 ? "+" : ""))
+            .arg(perHour, 0, 'f', 1)
+            .arg(unit);
+    };
+
+    QStringList lines;
+    lines << range("Last hour", summary.hour)
+          << range("Last 24 h", summary.day)
+          << range("Last 7 days", summary.week)
+          << QString("Smoothed: %1 °C").arg(summary.smoothed, 0, 'f', 1)
+          << trend("Pressure", summary.pressureTrend, "hPa")
+          << trend("Humidity", summary.humidityTrend, "%");
+    m_statsLabel->setText(lines.join('\n'));
+}
+
+void MainWindow::refreshNearby()
+{
+    m_nearbyList->clear();
+
+    const QVector<ObservationStore::Nearby> neighbors = m_observations.nearby(m_currentLocation, 8, 1000);
+    for (const ObservationStore::Nearby &neighbor : neighbors) {
+        const ObservationStore::Observation &observation = neighbor.observation;
+        QString text = QString("%1  (%2 km)")
+                           .arg(observation.location.displayName())
+                           .arg(qRound(neighbor.distanceKm));
+        if (observation.hasWeather()) {
+            text += QString("  %1°C").arg(observation.weather.temperature(), 0, 'f', 1);
+        }
+        QListWidgetItem *item = new QListWidgetItem(text, m_nearbyList);
+        item->setData(Qt::UserRole, observation.location.toJson());
+    }
+}
+
+void MainWindow::refreshMap()
+{
+    QVector<TemperatureMapWidget::MapPoint> points;
+    for (const ObservationStore::Observation &observation : m_observations.observations()) {
+        if (!observation.hasWeather()) {
+            continue;
+        }
+        TemperatureMapWidget::MapPoint point;
+        point.key = observation.location.displayName();
+        point.label = observation.location.name;
+        point.lat = observation.location.lat;
+        point.lon = observation.location.lon;
+        point.temperature = float(observation.weather.temperature());
+        points.append(point);
+    }
+    m_temperatureMap->setObservations(points);
+
+    // Follow the selected city, but leave the user's panning alone otherwise
+    if (m_currentLocation.hasCoordinates() && m_currentLocation.displayName() != m_mapCenteredOn) {
+        m_mapCenteredOn = m_currentLocation.displayName();
+        m_temperatureMap->centerOn(m_currentLocation.lat, m_currentLocation.lon);
+    }
+}
+
+void MainWindow::onNearbyActivated(QListWidgetItem *item)
+{
+    CityResult city = CityResult::fromJson(item->data(Qt::UserRole).toJsonObject());
+    if (!city.isValid()) {
+        return;
+    }
+
+    m_citySearchWidget->setText(city.displayName());
+    m_currentCity = city.name;
+    m_currentCityFull = city.displayName();
+
+    setStatusMessage("Searching weather for " + city.name + "...");
+    fetchLocation(city);
+}
+
+bool MainWindow::showNearbyFallback()
+{
+    // Only when this city has nothing recent of its own
+    ObservationStore::Observation own = m_observations.observation(m_currentLocation);
+    if (own.hasWeather() && own.observedAt.secsTo(QDateTime::currentDateTimeUtc()) < 3600) {
+        return false;
+    }
+
+    ObservationStore::Nearby neighbor;
+    if (!m_observations.nearestObservation(m_currentLocation, 50, 3 * 3600, &neighbor)) {
+        return false;
+    }
+
+    // Titled with the neighbor, so its readings are not taken for this city's
+    const ObservationStore::Observation &observation = neighbor.observation;
+    m_viewUpdater->setWeather(observation.weather, QString("Nearby: %1 (%2 km)")
+                                                       .arg(observation.location.displayName())
+                                                       .arg(qRound(neighbor.distanceKm)));
+    m_staleLabel->setText(QString("From %1, %2 km away, %3")
+                              .arg(observation.location.name)
+                              .arg(qRound(neighbor.distanceKm))
+                              .arg(WeatherSnapshot::formatAge(observation.observedAt.secsTo(QDateTime::currentDateTimeUtc()))));
+    m_staleLabel->show();
+    return true;
+}
+
+void MainWindow::fetchLocation(const CityResult &location)
+{
+    m_currentLocation = location;
+
+    // The periodic refresh counts from the last fetch, whatever caused it
+    RefreshScheduler::instance()->restartTask(m_refreshTaskId);
+
+    // Weather and forecast belong to the action that asked for them
+    TraceFlowScope flowScope(Tracer::currentOrNewFlow());
+
+    // Nothing can be sent (no API key, no name), so there is no request
+    // whose failure would report it
+    const QString error = m_weatherService->checkLocation(location);
+    if (!error.isEmpty()) {
+        m_weatherRequestId = 0;
+        m_forecastRequestId = 0;
+        onWeatherError(error);
+        return;
+    }
+
+    // Resolved locations skip server-side geocoding
+    m_weatherRequestId = m_weatherService->fetchWeather(location);
+    m_forecastRequestId = m_weatherService->fetchForecast(location);
 }
 
 void MainWindow::onWeatherDataReady(const WeatherData &data)
 {
+    TraceSpan traceSpan("show weather");
     m_currentWeather = data;
+
+    // Cold-start cost, compare runs with WEATHER_NO_PREWARM=1
+    if (!m_firstResponseLogged) {
+        m_firstResponseLogged = true;
+        qint64 elapsedMs = StartupTrace::elapsedMs();
+        Metrics::record("startup.first_weather", elapsedMs * 1000);
+        qDebug().noquote() << QString("[startup] first weather response: %1 ms (%2)")
+                                  .arg(elapsedMs)
+                                  .arg(NetworkWarmup::isEnabled() ? "prewarmed" : "cold");
+    }
+
+    // Remember the resolved ID and coordinates for favorites
+    if (m_currentLocation.isValid()) {
+        if (data.cityId() > 0) {
+            m_currentLocation.cityId = data.cityId();
+        }
+        if (!m_currentLocation.hasCoordinates() && !qIsNaN(data.lat())) {
+            m_currentLocation.lat = data.lat();
+            m_currentLocation.lon = data.lon();
+        }
+        m_locationManager->updateLocation(m_currentLocation);
+        m_observations.record(m_currentLocation, data);
+
+        // Stamped with when the station measured it, so a cached or
+        // repeated reply does not count as a new sample
+        if (data.observedAt() > 0) {
+            RollingStats::Sample sample;
+            sample.time = data.observedAt();
+            sample.temperature = data.temperature();
+            sample.humidity = data.humidity();
+            sample.pressure = data.pressure();
+            StallScope stallScope("persist");
+            m_rollingStats.add(m_currentLocation.displayName(), sample);
+        }
+
+        refreshNearby();
+        refreshMap();
+        refreshStats();
+    }
+
     updateWeatherDisplay(data);
     ui->addFavoritesPushButton->setEnabled(true);
+    m_staleLabel->hide();
+    m_errorLabel->hide();
 
     setStatusMessage("Weather data loaded successfully");
 
+    // After the status message so a raised alert stays visible
+    if (m_currentLocation.isValid()) {
+        m_alertEngine->updateWeather(m_currentLocation.displayName(), data);
+    }
+
     // Weather icon
     if (!data.iconCode().isEmpty()) {
         downloadWeatherIcon(data.iconCode());
     }
 }
 
+void MainWindow::onForecastItemReady(quint64 requestId, int index, const ForecastItem &item)
+{
+    // Rows fill in while the rest of the forecast downloads
+    if (requestId != m_forecastRequestId) {
+        return;
+    }
+    if (index == 0) {
+        m_streamedForecast.clear();
+    }
+    if (index == m_streamedForecast.count()) {
+        m_streamedForecast.addItem(item);
+        updateForecastDisplay(m_streamedForecast);
+    }
+}
+
 void MainWindow::onForecastDataReady(const ForecastData &data)
 {
+    TraceSpan traceSpan("show forecast");
+    m_currentForecast = data;
     updateForecastDisplay(data);
+    if (m_currentLocation.isValid()) {
+        m_alertEngine->updateForecast(m_currentLocation.displayName(), data);
+    }
 }
 
 void MainWindow::onWeatherError(const QString &error)
 {
-    QMessageBox::critical(this, "Weather Error",
-                          "Failed to fetch weather data:\n" + error);
+    if (showNearbyFallback()) {
+        setStatusMessage("Error: " + error + " (showing a nearby city)");
+        return;
+    }
+    // No modal dialog: during an outage every refresh fails, and a dialog
+    // per failure would block the window
+    m_errorLabel->setText(error);
+    m_errorLabel->setToolTip("Failed to fetch weather data:\n" + error);
+    m_errorLabel->show();
     setStatusMessage("Error: " + error);
 }
 
@@ -144,82 +714,13 @@ void MainWindow::updateWeatherDisplay(const WeatherData &data)
                           .arg(data.country());
     }
 
-    ui->cityLabel->setText(displayName);
-
-    // Temperature
-    ui->temperatureLabel->setText(QString("%1°C")
-                                      .arg(data.temperature(), 0, 'f', 1));
-
-    // Description
-    QString description = data.description();
-    if (!description.isEmpty()) {
-        description[0] = description[0].toUpper();
-    }
-    ui->descriptionLabel->setText(description);
-
-    // Feels like
-    ui->feelsLikeLabel->setText(QString("%1°C")
-                                    .arg(data.feelsLike(), 0, 'f', 1));
-
-    // Humidity
-    ui->humidityLabel->setText(QString("%1%")
-                                   .arg(data.humidity()));
-
-    // Wind speed
-    double windKmh = data.windSpeed() * 3.6;
-    ui->windLabel->setText(QString("%1 km/h")
-                               .arg(windKmh, 0, 'f', 1));
+    m_viewUpdater->setWeather(data, displayName);
 }
 
 void MainWindow::updateForecastDisplay(const ForecastData &data)
 {
-    // Clear table
-    ui->forecastTableWidget->setRowCount(0);
-
-    // Populate table with forecast data
-    int row = 0;
-    for (const ForecastItem &item : data.items()) {
-        if (row >= 5) break; // Limit to 5 days
-
-        ui->forecastTableWidget->insertRow(row);
-
-        // Date
-        QString dateStr = item.dateTime().toString("ddd, MMM dd");
-        QTableWidgetItem *dateItem = new QTableWidgetItem(dateStr);
-        dateItem->setTextAlignment(Qt::AlignCenter);
-        ui->forecastTableWidget->setItem(row, 0, dateItem);
-
-        // Icon
-        QTableWidgetItem *iconItem = new QTableWidgetItem();
-        iconItem->setTextAlignment(Qt::AlignCenter);
-        iconItem->setData(Qt::UserRole, item.iconCode());
-        ui->forecastTableWidget->setItem(row, 1, iconItem);
-
-        downloadForecastIcon(item.iconCode(), row);
-
-        // Temperature range
-        QString tempStr = QString("%1° / %2°")
-                              .arg(qRound(item.tempMin()))
-                              .arg(qRound(item.tempMax()));
-        QTableWidgetItem *tempItem = new QTableWidgetItem(tempStr);
-        tempItem->setTextAlignment(Qt::AlignCenter);
-        ui->forecastTableWidget->setItem(row, 2, tempItem);
-
-        // Description
-        QString desc = item.description();
-        if (!desc.isEmpty()) {
-            desc[0] = desc[0].toUpper();
-        }
-        QTableWidgetItem *descItem = new QTableWidgetItem(desc);
-        ui->forecastTableWidget->setItem(row, 3, descItem);
-
-        row++;
-    }
-
-    // Adjust row heights
-    for (int i = 0; i < ui->forecastTableWidget->rowCount(); ++i) {
-        ui->forecastTableWidget->setRowHeight(i, 40);
-    }
+    // Rows are diffed in place; icons are requested for changed rows only
+    m_viewUpdater->setForecast(data);
 }
 
 void MainWindow::downloadWeatherIcon(const QString &iconCode)
@@ -228,11 +729,20 @@ void MainWindow::downloadWeatherIcon(const QString &iconCode)
         return;
     }
 
-    QString iconUrl = QString("https://openweathermap.org/img/wn/%1@2x.png").arg(iconCode);
+    QPixmap icon = cachedIcon(iconCode);
+    if (!icon.isNull()) {
+        ui->weatherIconLabel->setPixmap(icon);
+        return;
+    }
+
+    QString iconUrl = ApiEndpoints::iconUrl(iconCode);
 
     QNetworkRequest request(iconUrl);
     request.setAttribute(QNetworkRequest::User, "current");
-    m_iconManager->get(request);
+    request.setAttribute(QNetworkRequest::UserMax, iconCode);
+    QNetworkReply *reply = NetworkWarmup::get(iconManager(), request);
+    RequestTimer::attach(reply, "icon");
+    Tracer::traceReply(reply, "icon request");
 }
 
 void MainWindow::downloadForecastIcon(const QString &iconCode, int row)
@@ -242,20 +752,47 @@ void MainWindow::downloadForecastIcon(const QString &iconCode, int row)
     }
 
     // Icon
-    if (m_forecastIcons.contains(iconCode)) {
+    QPixmap icon = cachedIcon(iconCode);
+    if (!icon.isNull()) {
         QTableWidgetItem *item = ui->forecastTableWidget->item(row, 1);
         if (item) {
-            item->setIcon(QIcon(m_forecastIcons[iconCode]));
+            item->setIcon(QIcon(icon));
         }
         return;
     }
 
-    QString iconUrl = QString("https://openweathermap.org/img/wn/%1@2x.png").arg(iconCode);
+    QString iconUrl = ApiEndpoints::iconUrl(iconCode);
 
     QNetworkRequest request(iconUrl);
     request.setAttribute(QNetworkRequest::User, QString("forecast_%1").arg(row));
     request.setAttribute(QNetworkRequest::UserMax, iconCode);
-    m_iconManager->get(request);
+    QNetworkReply *reply = NetworkWarmup::get(iconManager(), request);
+    RequestTimer::attach(reply, "icon");
+    Tracer::traceReply(reply, "icon request");
+}
+
+void MainWindow::cacheIcon(const QString &iconCode, const QPixmap &pixmap)
+{
+    m_forecastIcons[iconCode] = pixmap;
+    MemoryAccountant::instance()->charge(m_iconCacheId, iconCode);
+}
+
+QPixmap MainWindow::cachedIcon(const QString &iconCode)
+{
+    auto it = m_forecastIcons.constFind(iconCode);
+    if (it == m_forecastIcons.constEnd()) {
+        // Icons never change, so any copy another process saved will do
+        QByteArray imageData;
+        QPixmap pixmap;
+        if (SharedCache::get("icon:" + iconCode, &imageData, 7 * 24 * 3600)
+            && pixmap.loadFromData(imageData)) {
+            pixmap = pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            cacheIcon(iconCode, pixmap);
+        }
+        return pixmap;
+    }
+    MemoryAccountant::instance()->touch(m_iconCacheId, iconCode);
+    return *it;
 }
 
 void MainWindow::onIconDownloaded(QNetworkReply *reply)
@@ -263,13 +800,18 @@ void MainWindow::onIconDownloaded(QNetworkReply *reply)
     if (!reply) {
         return;
     }
+    TraceFlowScope flowScope(Tracer::endReply(reply));
 
     if (reply->error() == QNetworkReply::NoError) {
         QByteArray imageData = reply->readAll();
+        StallScope stallScope("image decode");
+        TraceSpan traceSpan("icon decode");
+        ScopedLatency decodeTimer("icon.decode");
 
         QPixmap pixmap;
         if (pixmap.loadFromData(imageData)) {
             QString requestType = reply->request().attribute(QNetworkRequest::User).toString();
+            SharedCache::put("icon:" + reply->request().attribute(QNetworkRequest::UserMax).toString(), imageData);
 
             if (requestType == "current") {
                 // Current weather icon
@@ -277,8 +819,12 @@ void MainWindow::onIconDownloaded(QNetworkReply *reply)
                                                      Qt::KeepAspectRatio,
                                                      Qt::SmoothTransformation);
 
+                QString iconCode = reply->request().attribute(QNetworkRequest::UserMax).toString();
+                cacheIcon(iconCode, scaledPixmap);
+
                 ui->weatherIconLabel->setPixmap(scaledPixmap);
                 ui->weatherIconLabel->setScaledContents(false);
+                m_repaintFlow = Tracer::currentFlow();
             }
             else if (requestType.startsWith("forecast_")) {
                 // Forecast icon
@@ -289,12 +835,14 @@ void MainWindow::onIconDownloaded(QNetworkReply *reply)
                                                      Qt::KeepAspectRatio,
                                                      Qt::SmoothTransformation);
 
-                m_forecastIcons[iconCode] = scaledPixmap;
+                cacheIcon(iconCode, scaledPixmap);
 
+                // The row may show another day by the time the icon arrives
                 QTableWidgetItem *item = ui->forecastTableWidget->item(row, 1);
-                if (item) {
+                if (item && item->data(Qt::UserRole).toString() == iconCode) {
                     item->setIcon(QIcon(scaledPixmap));
                     item->setText("");
+                    m_repaintFlow = Tracer::currentFlow();
                 }
             }
         }
@@ -311,18 +859,30 @@ void MainWindow::onAddFavoritesClicked()
         return;
     }
 
-    QString fullCityName = m_currentCityFull;
+    CityResult location = m_currentLocation;
 
     // Fallback 1
-    if (fullCityName.isEmpty()) {
-        CityResult selectedCity = m_citySearchWidget->selectedCity();
-        fullCityName = selectedCity.fullName();
+    if (!location.isValid()) {
+        location = m_citySearchWidget->selectedCity();
     }
 
     // Fallback 2
-    if (fullCityName.isEmpty() || fullCityName.trimmed() == ",") {
-        fullCityName = m_currentWeather.cityName() + ", " + m_currentWeather.country();
+    if (!location.isValid()) {
+        location = CityResult();
+        location.name = m_currentWeather.cityName();
+        location.country = m_currentWeather.country();
+    }
+
+    // Store what the API resolved so favorites load without geocoding
+    if (location.cityId <= 0) {
+        location.cityId = m_currentWeather.cityId();
     }
+    if (!location.hasCoordinates() && !qIsNaN(m_currentWeather.lat())) {
+        location.lat = m_currentWeather.lat();
+        location.lon = m_currentWeather.lon();
+    }
+
+    QString fullCityName = location.displayName();
 
     if (m_locationManager->isFavorite(fullCityName)) {
         QMessageBox::information(this, "Already Favorite",
@@ -330,7 +890,7 @@ void MainWindow::onAddFavoritesClicked()
         return;
     }
 
-    m_locationManager->addLocation(fullCityName);
+    m_locationManager->addLocation(location);
     setStatusMessage(fullCityName + " added to favorites");
 }
 
@@ -344,18 +904,20 @@ void MainWindow::onLoadFavoriteClicked()
         return;
     }
 
-    QString fullCity = item->text();
+    CityResult favorite = m_locationManager->favoriteAt(ui->favoritesListWidget->row(item));
+    if (!favorite.isValid()) {
+        return;
+    }
 
-    // Extract city name
-    QString cityName = fullCity.split(",").first().trimmed();
+    QString fullCity = favorite.displayName();
+    QString cityName = favorite.name;
 
     m_citySearchWidget->setText(fullCity);
     m_currentCity = cityName;
     m_currentCityFull = fullCity;
 
     setStatusMessage("Searching weather for " + cityName + "...");
-    m_weatherService->fetchWeather(cityName);
-    m_weatherService->fetchForecast(cityName);
+    fetchLocation(favorite);
 }
 
 void MainWindow::onRemoveFavoriteClicked()
@@ -390,6 +952,7 @@ void MainWindow::onClearClicked()
     // Reset current city
     m_currentCity.clear();
     m_currentCityFull.clear();
+    m_currentLocation = CityResult();
     m_currentWeather = WeatherData();
 
     setStatusMessage("Search cleared. Enter a city name to search.");
@@ -398,16 +961,13 @@ void MainWindow::onClearClicked()
 void MainWindow::clearResults()
 {
     // Clear
-    ui->cityLabel->setText("--");
-    ui->temperatureLabel->setText("--°C");
-    ui->descriptionLabel->setText("--");
-    ui->feelsLikeLabel->setText("--");
-    ui->humidityLabel->setText("--");
-    ui->windLabel->setText("--");
+    m_viewUpdater->clear();
     ui->weatherIconLabel->clear();
 
-    ui->forecastTableWidget->setRowCount(0);
     m_forecastIcons.clear();
+    MemoryAccountant::instance()->releaseAll(m_iconCacheId);
+    m_currentForecast.clear();
+    m_staleLabel->hide();
 
     // Disable favorites button
     ui->addFavoritesPushButton->setEnabled(false);
@@ -415,36 +975,69 @@ void MainWindow::clearResults()
 
 void MainWindow::loadFirstFavorite()
 {
-    QStringList favorites = m_locationManager->getFavorites();
-
-    if (favorites.isEmpty()) {
+    if (m_locationManager->count() == 0) {
         setStatusMessage("Enter a city name to search for weather data");
         return;
     }
 
-    QString firstFavorite = favorites.first();
+    CityResult firstFavorite = m_locationManager->favoriteAt(0);
 
-    QString cityName = firstFavorite.split(",").first().trimmed();
-    m_currentCityFull = firstFavorite;
+    QString cityName = firstFavorite.name;
+    m_currentCityFull = firstFavorite.displayName();
 
-    m_citySearchWidget->setText(firstFavorite);
+    m_citySearchWidget->setText(m_currentCityFull);
     m_currentCity = cityName;
 
     setStatusMessage("Loading weather for " + cityName + "...");
-    m_weatherService->fetchWeather(cityName);
-    m_weatherService->fetchForecast(cityName);
+    fetchLocation(firstFavorite);
+}
+
+void MainWindow::onFavoriteInserted(int index, const CityResult &city)
+{
+    ui->favoritesListWidget->insertItem(index, city.displayName());
+    m_observations.addLocation(city);
+}
+
+void MainWindow::onFavoriteRemoved(int index, const CityResult &city)
+{
+    Q_UNUSED(city);
+
+    delete ui->favoritesListWidget->takeItem(index);
+}
+
+void MainWindow::onFavoriteMoved(int from, int to)
+{
+    // Drag and drop already moved the row in the view
+    if (m_syncingFavorites) {
+        return;
+    }
+
+    QListWidgetItem *item = ui->favoritesListWidget->takeItem(from);
+    if (item) {
+        ui->favoritesListWidget->insertItem(to, item);
+    }
 }
 
-void MainWindow::onFavoritesChanged()
+void MainWindow::onFavoritesReset()
 {
     updateFavoritesList();
+    for (const CityResult &city : m_locationManager->getFavorites()) {
+        m_observations.addLocation(city);
+    }
+    refreshNearby();
 }
 
 void MainWindow::updateFavoritesList()
 {
     ui->favoritesListWidget->clear();
-    QStringList favorites = m_locationManager->getFavorites();
-    ui->favoritesListWidget->addItems(favorites);
+
+    QStringList names;
+    const QList<CityResult> favorites = m_locationManager->getFavorites();
+    names.reserve(favorites.size());
+    for (const CityResult &city : favorites) {
+        names.append(city.displayName());
+    }
+    ui->favoritesListWidget->addItems(names);
 }
 
 void MainWindow::setStatusMessage(const QString &message)
@@ -452,6 +1045,47 @@ void MainWindow::setStatusMessage(const QString &message)
     statusBar()->showMessage(message);
 }
 
+void MainWindow::onDiagnosticsRequested()
+{
+    // Built on first use
+    if (!m_diagnosticsDialog) {
+        m_diagnosticsDialog = new DiagnosticsDialog(this);
+    }
+    m_diagnosticsDialog->show();
+    m_diagnosticsDialog->raise();
+}
+
+void MainWindow::updateSchedulerState()
+{
+    RefreshScheduler::State state = RefreshScheduler::Active;
+    const Qt::ApplicationState appState = QGuiApplication::applicationState();
+    if (!isVisible() || isMinimized() || appState == Qt::ApplicationHidden
+        || appState == Qt::ApplicationSuspended) {
+        state = RefreshScheduler::Hidden;
+    } else if (appState != Qt::ApplicationActive) {
+        state = RefreshScheduler::Inactive;
+    }
+    RefreshScheduler::instance()->setState(state);
+    StallWatchdog::setPaused(state == RefreshScheduler::Hidden);
+}
+
+void MainWindow::onTraceRequested()
+{
+    // Toggles: one press starts recording, the next stops it and saves
+    if (!Tracer::isEnabled()) {
+        Tracer::setEnabled(true);
+        setStatusMessage("Tracing started, press Ctrl+Shift+T again to stop and save the trace");
+        return;
+    }
+    Tracer::setEnabled(false);
+    QString filePath = Tracer::defaultFilePath();
+    if (Tracer::writeTo(filePath)) {
+        setStatusMessage("Tracing stopped, trace saved to " + filePath);
+    } else {
+        setStatusMessage("Tracing stopped. Error: could not save the trace");
+    }
+}
+
 void MainWindow::onAboutClicked()
 {
     QMessageBox::about(this, "About Weather Dashboard",
@@ -480,9 +1114,7 @@ void MainWindow::onAboutClicked()
 
 void MainWindow::onLoadFirstFavoriteClicked()
 {
-    QStringList favorites = m_locationManager->getFavorites();
-
-    if (favorites.isEmpty()) {
+    if (m_locationManager->count() == 0) {
         QMessageBox::information(this, "No Favorites",
                                  "You don't have any favorite cities yet.\n"
                                  "Search for a city and add it to favorites first.");
@@ -493,14 +1125,24 @@ void MainWindow::onLoadFirstFavoriteClicked()
     loadFirstFavorite();
 }
 
-void MainWindow::onFavoritesReordered()
+void MainWindow::onFavoritesReordered(const QModelIndex &parent, int start, int end,
+                                      const QModelIndex &destination, int row)
 {
-    QStringList newOrder;
-    for (int i = 0; i < ui->favoritesListWidget->count(); ++i) {
-        newOrder.append(ui->favoritesListWidget->item(i)->text());
+    Q_UNUSED(parent);
+    Q_UNUSED(destination);
+
+    // rowsMoved reports the destination in pre-move coordinates
+    m_syncingFavorites = true;
+    if (row > end) {
+        for (int i = start; i <= end; ++i) {
+            m_locationManager->moveLocation(start, row - 1);
+        }
+    } else {
+        for (int i = start; i <= end; ++i) {
+            m_locationManager->moveLocation(i, row + (i - start));
+        }
     }
-
-    m_locationManager->reorderLocations(newOrder);
+    m_syncingFavorites = false;
 
     setStatusMessage("Favorites reordered");
 }
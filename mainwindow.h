@@ -5,11 +5,21 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QPixmap>
+#include <QModelIndex>
+#include <QLabel>
+#include <QListWidget>
 #include "weatherservice.h"
 #include "locationmanager.h"
 #include "weatherdata.h"
 #include "forecastdata.h"
 #include "citysearchwidget.h"
+#include "observationstore.h"
+#include "alertengine.h"
+#include "rollingstats.h"
+
+class DiagnosticsDialog;
+class ViewUpdater;
+class TemperatureMapWidget;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -25,20 +35,32 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+protected:
+    bool event(QEvent *event) override;
+
 private slots:
     void onCitySelected(const QString &cityName, double lat, double lon);
     void onWeatherDataReady(const WeatherData &data);
+    void onForecastItemReady(quint64 requestId, int index, const ForecastItem &item);
     void onForecastDataReady(const ForecastData &data);
     void onWeatherError(const QString &error);
     void onAddFavoritesClicked();
     void onLoadFavoriteClicked();
     void onRemoveFavoriteClicked();
-    void onFavoritesChanged();
+    void onFavoriteInserted(int index, const CityResult &city);
+    void onFavoriteRemoved(int index, const CityResult &city);
+    void onFavoriteMoved(int from, int to);
+    void onFavoritesReset();
     void onIconDownloaded(QNetworkReply *reply);
     void onClearClicked();
     void onAboutClicked();
     void onLoadFirstFavoriteClicked();
-    void onFavoritesReordered();
+    void finishStartup();
+    void onDiagnosticsRequested();
+    void onTraceRequested();
+    void onFavoritesReordered(const QModelIndex &parent, int start, int end,
+                              const QModelIndex &destination, int row);
+    void onNearbyActivated(QListWidgetItem *item);
 
 private:
     Ui::MainWindow *ui;
@@ -49,16 +71,54 @@ private:
     WeatherData m_currentWeather;
     QString m_currentCity;
     QString m_currentCityFull;
+    CityResult m_currentLocation;
+    ForecastData m_currentForecast;
     QMap<QString, QPixmap> m_forecastIcons;
+    int m_iconCacheId;
+    ViewUpdater *m_viewUpdater;
+    ObservationStore m_observations;
+    AlertEngine *m_alertEngine;
+    RollingStats m_rollingStats;
+    QLabel *m_statsLabel;
+    quint64 m_weatherRequestId;
+    quint64 m_forecastRequestId;
+    ForecastData m_streamedForecast;
+    quint64 m_repaintFlow;      // flow of the update waiting to be painted
+    int m_refreshTaskId;
+    QListWidget *m_nearbyList;
+    TemperatureMapWidget *m_temperatureMap;
+    QString m_mapCenteredOn;
+    QLabel *m_staleLabel;
+    QLabel *m_errorLabel;
+    DiagnosticsDialog *m_diagnosticsDialog;
+    bool m_syncingFavorites;
+    bool m_snapshotRestored;
+    bool m_startupScheduled;
+    bool m_firstPaintDone;
+    bool m_firstResponseLogged;
 
+    void setupForecastTable();
+    QNetworkAccessManager *iconManager();
     void updateWeatherDisplay(const WeatherData &data);
     void updateForecastDisplay(const ForecastData &data);
     void updateFavoritesList();
     void setStatusMessage(const QString &message);
     void downloadWeatherIcon(const QString &iconCode);
     void downloadForecastIcon(const QString &iconCode, int row);
+    void cacheIcon(const QString &iconCode, const QPixmap &pixmap);
+    QPixmap cachedIcon(const QString &iconCode);
     void clearResults();
     void loadFirstFavorite();
+    void fetchLocation(const CityResult &location);
+    void setupNearbyPanel();
+    void refreshNearby();
+    void refreshMap();
+    void refreshStats();
+    // Follows visibility and focus; see RefreshScheduler
+    void updateSchedulerState();
+    bool showNearbyFallback();
+    bool restoreSnapshot();
+    void saveSnapshot();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,277 @@
+#include "memoryaccountant.h"
+#include "refreshscheduler.h"
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const qint64 DefaultBudgetMb = 32;
+const int PressurePollMs = 10000;
+
+} // namespace
+
+MemoryAccountant *MemoryAccountant::instance()
+{
+    static MemoryAccountant *accountant = new MemoryAccountant();
+    return accountant;
+}
+
+MemoryAccountant::MemoryAccountant(QObject *parent)
+    : QObject(parent)
+    , m_nextCacheId(1)
+    , m_budget(DefaultBudgetMb * 1024 * 1024)
+    , m_usage(0)
+    , m_inflation(0)
+    , m_pressure(false)
+    , m_overBudgetWarned(false)
+    , m_pressureTaskId(0)
+{
+    bool ok = false;
+    qint64 budgetMb = qEnvironmentVariable("WEATHER_MEMORY_BUDGET_MB").toLongLong(&ok);
+    if (ok && budgetMb > 0) {
+        m_budget = budgetMb * 1024 * 1024;
+    }
+
+#ifdef Q_OS_LINUX
+    // No portable low-memory notification, so watch MemAvailable. Caches
+    // hold memory while hidden too, so this only slows down then.
+    m_pressureTaskId = RefreshScheduler::instance()->addTask(
+        "memory.pressure", PressurePollMs, RefreshScheduler::Stretch,
+        [this]() { pollSystemMemory(); });
+#endif
+}
+
+int MemoryAccountant::registerCache(const QString &name, double weight, CostFunction cost, EvictFunction evict)
+{
+    Cache cache;
+    cache.name = name;
+    cache.weight = weight > 0 ? weight : 1.0;
+    cache.cost = std::move(cost);
+    cache.evict = std::move(evict);
+
+    int cacheId = m_nextCacheId++;
+    m_caches.insert(cacheId, cache);
+    return cacheId;
+}
+
+void MemoryAccountant::unregisterCache(int cacheId)
+{
+    auto it = m_caches.find(cacheId);
+    if (it == m_caches.end()) {
+        return;
+    }
+    m_usage -= it->bytes;
+    m_caches.erase(it);
+}
+
+void MemoryAccountant::charge(int cacheId, const QString &key)
+{
+    auto it = m_caches.find(cacheId);
+    if (it == m_caches.end()) {
+        return;
+    }
+    Cache &cache = *it;
+
+    Entry &entry = cache.entries[key];
+    qint64 bytes = qMax<qint64>(0, cache.cost(key));
+    cache.bytes += bytes - entry.bytes;
+    m_usage += bytes - entry.bytes;
+    entry.bytes = bytes;
+    entry.hits++;
+    entry.priority = priority(cache, entry);
+
+    if (m_usage > effectiveBudget()) {
+        // Evict down to 90% so inserts near the limit don't evict one by one
+        enforce(effectiveBudget() - effectiveBudget() / 10, cacheId, key);
+    }
+}
+
+void MemoryAccountant::touch(int cacheId, const QString &key)
+{
+    auto it = m_caches.find(cacheId);
+    if (it == m_caches.end()) {
+        return;
+    }
+    auto entry = it->entries.find(key);
+    if (entry != it->entries.end()) {
+        entry->hits++;
+        entry->priority = priority(*it, *entry);
+    }
+}
+
+void MemoryAccountant::release(int cacheId, const QString &key)
+{
+    auto it = m_caches.find(cacheId);
+    if (it == m_caches.end()) {
+        return;
+    }
+    auto entry = it->entries.find(key);
+    if (entry != it->entries.end()) {
+        it->bytes -= entry->bytes;
+        m_usage -= entry->bytes;
+        it->entries.erase(entry);
+    }
+}
+
+void MemoryAccountant::releaseAll(int cacheId)
+{
+    auto it = m_caches.find(cacheId);
+    if (it == m_caches.end()) {
+        return;
+    }
+    m_usage -= it->bytes;
+    it->bytes = 0;
+    it->entries.clear();
+}
+
+qint64 MemoryAccountant::budget() const
+{
+    return m_budget;
+}
+
+void MemoryAccountant::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    if (m_usage > effectiveBudget()) {
+        enforce(effectiveBudget());
+    }
+}
+
+qint64 MemoryAccountant::usage() const
+{
+    return m_usage;
+}
+
+bool MemoryAccountant::underPressure() const
+{
+    return m_pressure;
+}
+
+QList<MemoryAccountant::CacheStats> MemoryAccountant::stats() const
+{
+    QList<CacheStats> result;
+    for (const Cache &cache : m_caches) {
+        CacheStats stats;
+        stats.name = cache.name;
+        stats.entries = cache.entries.size();
+        stats.bytes = cache.bytes;
+        stats.evictions = cache.evictions;
+        stats.weight = cache.weight;
+        result.append(stats);
+    }
+    std::sort(result.begin(), result.end(), [](const CacheStats &a, const CacheStats &b) {
+        return a.name < b.name;
+    });
+    return result;
+}
+
+void MemoryAccountant::setMemoryPressure(bool low)
+{
+    if (low == m_pressure) {
+        return;
+    }
+    m_pressure = low;
+    qDebug() << "Memory pressure" << (low ? "high, shrinking caches" : "back to normal");
+    if (low && m_usage > effectiveBudget()) {
+        enforce(effectiveBudget());
+    }
+    emit memoryPressureChanged(low);
+}
+
+double MemoryAccountant::priority(const Cache &cache, const Entry &entry) const
+{
+    // Per KiB, so one large entry doesn't outrank many small hot ones
+    double kib = 1.0 + entry.bytes / 1024.0;
+    return m_inflation + cache.weight * entry.hits / kib;
+}
+
+qint64 MemoryAccountant::effectiveBudget() const
+{
+    return m_pressure ? m_budget / 2 : m_budget;
+}
+
+void MemoryAccountant::enforce(qint64 target, int keepCacheId, const QString &keepKey)
+{
+    struct Candidate {
+        double priority;
+        int cacheId;
+        QString key;
+    };
+
+    QList<Candidate> candidates;
+    for (auto cache = m_caches.constBegin(); cache != m_caches.constEnd(); ++cache) {
+        for (auto entry = cache->entries.constBegin(); entry != cache->entries.constEnd(); ++entry) {
+            if (cache.key() == keepCacheId && entry.key() == keepKey) {
+                continue;
+            }
+            candidates.append({entry->priority, cache.key(), entry.key()});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.priority < b.priority;
+    });
+
+    for (const Candidate &candidate : candidates) {
+        if (m_usage <= target) {
+            break;
+        }
+        auto cache = m_caches.find(candidate.cacheId);
+        if (cache == m_caches.end() || !cache->entries.contains(candidate.key)) {
+            continue;
+        }
+
+        // The callback may call release(), so read the size first
+        qint64 bytes = cache->entries.value(candidate.key).bytes;
+        EvictFunction evict = cache->evict;
+        if (!evict(candidate.key)) {
+            continue;
+        }
+
+        cache = m_caches.find(candidate.cacheId);
+        if (cache == m_caches.end()) {
+            continue;
+        }
+        if (cache->entries.remove(candidate.key) > 0) {
+            cache->bytes -= bytes;
+            m_usage -= bytes;
+        }
+        cache->evictions++;
+        m_inflation = candidate.priority;
+    }
+
+    // Warn once per episode rather than on every insert
+    if (m_usage > target && !m_overBudgetWarned) {
+        qWarning() << "Memory budget exceeded by pinned entries:" << m_usage << "of" << target << "bytes";
+    }
+    m_overBudgetWarned = m_usage > target;
+}
+
+void MemoryAccountant::pollSystemMemory()
+{
+    QFile file("/proc/meminfo");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+
+    qint64 totalKb = 0;
+    qint64 availableKb = -1;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        if (line.startsWith("MemTotal:")) {
+            totalKb = line.mid(9).trimmed().split(' ').first().toLongLong();
+        } else if (line.startsWith("MemAvailable:")) {
+            availableKb = line.mid(13).trimmed().split(' ').first().toLongLong();
+        }
+    }
+    if (totalKb <= 0 || availableKb < 0) {
+        return;
+    }
+
+    // Low below 10% available, recovered above 15%
+    if (!m_pressure && availableKb * 10 < totalKb) {
+        setMemoryPressure(true);
+    } else if (m_pressure && availableKb * 100 > totalKb * 15) {
+        setMemoryPressure(false);
+    }
+}
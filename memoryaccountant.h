@@ -0,0 +1,93 @@
+#ifndef MEMORYACCOUNTANT_H
+#define MEMORYACCOUNTANT_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <functional>
+
+// Central byte budget shared by every in-memory cache. Caches register a
+// cost function and an evict callback, report inserts and hits, and the
+// accountant evicts across all of them when the total goes over budget.
+// Victims are chosen GreedyDual-Size-Frequency style: priority grows with
+// hits and cache weight, shrinks with size, and ages by the priority of
+// the last victim so idle entries eventually go too.
+// Used from the GUI thread only.
+class MemoryAccountant : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Returns the entry size in bytes
+    using CostFunction = std::function<qint64(const QString &key)>;
+    // Removes the entry from the cache; false if it can't go right now
+    using EvictFunction = std::function<bool(const QString &key)>;
+
+    struct CacheStats {
+        QString name;
+        int entries = 0;
+        qint64 bytes = 0;
+        quint64 evictions = 0;
+        double weight = 1.0;
+    };
+
+    static MemoryAccountant *instance();
+
+    // Higher weight keeps a cache's entries longer
+    int registerCache(const QString &name, double weight, CostFunction cost, EvictFunction evict);
+    void unregisterCache(int cacheId);
+
+    // Insert or resize; counts as an access
+    void charge(int cacheId, const QString &key);
+    void touch(int cacheId, const QString &key);
+    void release(int cacheId, const QString &key);
+    void releaseAll(int cacheId);
+
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+    qint64 usage() const;
+    bool underPressure() const;
+    QList<CacheStats> stats() const;
+
+public slots:
+    // Shrinks to half the budget while memory is low
+    void setMemoryPressure(bool low);
+
+signals:
+    void memoryPressureChanged(bool low);
+
+private:
+    struct Entry {
+        qint64 bytes = 0;
+        quint32 hits = 0;
+        double priority = 0;
+    };
+
+    struct Cache {
+        QString name;
+        double weight = 1.0;
+        CostFunction cost;
+        EvictFunction evict;
+        QHash<QString, Entry> entries;
+        qint64 bytes = 0;
+        quint64 evictions = 0;
+    };
+
+    explicit MemoryAccountant(QObject *parent = nullptr);
+
+    QHash<int, Cache> m_caches;
+    int m_nextCacheId;
+    qint64 m_budget;
+    qint64 m_usage;
+    double m_inflation;     // priority of the last victim
+    bool m_pressure;
+    bool m_overBudgetWarned;
+    int m_pressureTaskId;
+
+    double priority(const Cache &cache, const Entry &entry) const;
+    qint64 effectiveBudget() const;
+    void enforce(qint64 target, int keepCacheId = 0, const QString &keepKey = QString());
+    void pollSystemMemory();
+};
+
+#endif // MEMORYACCOUNTANT_H
@@ -0,0 +1,257 @@
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "requesthedger.h"
+#include "circuitbreaker.h"
+#include "sharedcache.h"
+#include "refreshscheduler.h"
+#include <QNetworkReply>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDebug>
+
+QMutex Metrics::s_mutex;
+QHash<QString, LatencyHistogram *> Metrics::s_histograms;
+
+LatencyHistogram *Metrics::histogram(const QString &name)
+{
+    // Histograms are never freed, so callers may keep the pointer
+    QMutexLocker locker(&s_mutex);
+    LatencyHistogram *histogram = s_histograms.value(name);
+    if (!histogram) {
+        histogram = new LatencyHistogram();
+        s_histograms.insert(name, histogram);
+    }
+    return histogram;
+}
+
+void Metrics::record(const QString &name, qint64 micros)
+{
+    histogram(name)->record(micros);
+}
+
+QStringList Metrics::names()
+{
+    QMutexLocker locker(&s_mutex);
+    QStringList result = s_histograms.keys();
+    result.sort();
+    return result;
+}
+
+QByteArray Metrics::toJson()
+{
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+
+    QJsonObject histograms;
+    for (const QString &name : names()) {
+        LatencyHistogram *h = histogram(name);
+        QJsonObject entry;
+        entry["count"] = double(h->count());
+        entry["mean_us"] = h->mean();
+        entry["p50_us"] = double(h->percentile(50));
+        entry["p90_us"] = double(h->percentile(90));
+        entry["p99_us"] = double(h->percentile(99));
+        entry["max_us"] = double(h->max());
+        histograms[name] = entry;
+    }
+    root["latency"] = histograms;
+
+    if (StallWatchdog::isActive()) {
+        root["stalls"] = StallWatchdog::toJson();
+    }
+    if (!RequestHedger::secondaryBaseUrl().isEmpty()) {
+        root["hedging"] = RequestHedger::toJson();
+    }
+    QJsonArray circuits = CircuitBreaker::toJson();
+    if (!circuits.isEmpty()) {
+        root["circuits"] = circuits;
+    }
+    if (SharedCache::enabled()) {
+        root["shared_cache"] = SharedCache::toJson();
+    }
+    if (RefreshScheduler::instance()->taskCount() > 0) {
+        root["scheduler"] = RefreshScheduler::instance()->toJson();
+    }
+
+    return QJsonDocument(root).toJson();
+}
+
+QByteArray Metrics::toPrometheus()
+{
+    QByteArray out;
+    out += "# HELP weather_dashboard_latency_seconds Request and render stage latency.\n";
+    out += "# TYPE weather_dashboard_latency_seconds summary\n";
+
+    const double quantiles[] = { 0.5, 0.9, 0.99 };
+    for (const QString &name : names()) {
+        LatencyHistogram *h = histogram(name);
+        QByteArray label = "name=\"" + name.toUtf8() + "\"";
+        for (double q : quantiles) {
+            out += "weather_dashboard_latency_seconds{" + label
+                   + ",quantile=\"" + QByteArray::number(q) + "\"} "
+                   + QByteArray::number(h->percentile(q * 100) / 1e6, 'f', 6) + "\n";
+        }
+        out += "weather_dashboard_latency_seconds_sum{" + label + "} "
+               + QByteArray::number(h->mean() * h->count() / 1e6, 'f', 6) + "\n";
+        out += "weather_dashboard_latency_seconds_count{" + label + "} "
+               + QByteArray::number(h->count()) + "\n";
+    }
+    return out;
+}
+
+ScopedLatency::ScopedLatency(const QString &name)
+    : m_histogram(Metrics::histogram(name))
+{
+    m_timer.start();
+}
+
+ScopedLatency::ScopedLatency(LatencyHistogram *histogram)
+    : m_histogram(histogram)
+{
+    m_timer.start();
+}
+
+ScopedLatency::~ScopedLatency()
+{
+    m_histogram->record(m_timer.nsecsElapsed() / 1000);
+}
+
+void RequestTimer::attach(QNetworkReply *reply, const QString &request)
+{
+    // Owned by the reply, so it goes away with it
+    new RequestTimer(reply, request);
+}
+
+RequestTimer::RequestTimer(QNetworkReply *reply, const QString &request)
+    : QObject(reply)
+    , m_request(request)
+    , m_connectStartUs(-1)
+    , m_sentUs(-1)
+    , m_firstByteUs(-1)
+{
+    m_timer.start();
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    connect(reply, &QNetworkReply::socketStartedConnecting,
+            this, &RequestTimer::onConnecting);
+    connect(reply, &QNetworkReply::requestSent,
+            this, &RequestTimer::onRequestSent);
+#endif
+#if QT_CONFIG(ssl)
+    connect(reply, &QNetworkReply::encrypted,
+            this, &RequestTimer::onEncrypted);
+#endif
+    connect(reply, &QNetworkReply::metaDataChanged,
+            this, &RequestTimer::onMetaData);
+    connect(reply, &QNetworkReply::finished,
+            this, &RequestTimer::onFinished);
+}
+
+void RequestTimer::onConnecting()
+{
+    if (m_connectStartUs < 0) {
+        m_connectStartUs = m_timer.nsecsElapsed() / 1000;
+        Metrics::record(m_request + ".queue_wait", m_connectStartUs);
+    }
+}
+
+void RequestTimer::onEncrypted()
+{
+    if (m_connectStartUs >= 0) {
+        Metrics::record(m_request + ".connect", m_timer.nsecsElapsed() / 1000 - m_connectStartUs);
+    }
+}
+
+void RequestTimer::onRequestSent()
+{
+    m_sentUs = m_timer.nsecsElapsed() / 1000;
+
+    // A reused connection goes straight from the queue to the wire
+    if (m_connectStartUs < 0) {
+        Metrics::record(m_request + ".queue_wait", m_sentUs);
+    }
+}
+
+void RequestTimer::onMetaData()
+{
+    if (m_firstByteUs >= 0) {
+        return;
+    }
+    m_firstByteUs = m_timer.nsecsElapsed() / 1000;
+
+    if (m_sentUs >= 0) {
+        Metrics::record(m_request + ".ttfb", m_firstByteUs - m_sentUs);
+    } else {
+        // Without requestSent (Qt < 6.3) this includes queue and connect
+        Metrics::record(m_request + ".ttfb", m_firstByteUs);
+    }
+}
+
+void RequestTimer::onFinished()
+{
+    qint64 nowUs = m_timer.nsecsElapsed() / 1000;
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(parent());
+
+    if (reply && reply->error() != QNetworkReply::NoError) {
+        Metrics::record(m_request + ".failed", nowUs);
+        return;
+    }
+
+    if (m_firstByteUs >= 0) {
+        Metrics::record(m_request + ".download", nowUs - m_firstByteUs);
+    }
+    Metrics::record(m_request + ".total", nowUs);
+}
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &MetricsExporter::writeNow);
+}
+
+void MetricsExporter::start(const QString &filePath, int intervalMs)
+{
+    m_filePath = filePath;
+    m_timer->start(intervalMs);
+}
+
+void MetricsExporter::startFromEnvironment()
+{
+    // WEATHER_METRICS_FILE=/path/metrics.prom (or .json), WEATHER_METRICS_INTERVAL in seconds
+    QString filePath = QString::fromUtf8(qgetenv("WEATHER_METRICS_FILE"));
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    bool ok = false;
+    int intervalSec = qEnvironmentVariableIntValue("WEATHER_METRICS_INTERVAL", &ok);
+    if (!ok || intervalSec <= 0) {
+        intervalSec = 60;
+    }
+
+    start(filePath, intervalSec * 1000);
+    qDebug() << "Exporting metrics to" << filePath << "every" << intervalSec << "s";
+}
+
+bool MetricsExporter::writeNow()
+{
+    if (m_filePath.isEmpty()) {
+        return false;
+    }
+
+    QByteArray data = m_filePath.endsWith(".json", Qt::CaseInsensitive)
+                          ? Metrics::toJson()
+                          : Metrics::toPrometheus();
+
+    // Scrapers must never see a half-written file
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) == -1 || !file.commit()) {
+        qWarning() << "Failed to write metrics file:" << m_filePath;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "latencyhistogram.h"
+
+class QNetworkReply;
+
+// Process-wide registry of named latency histograms.
+// Names follow "<request>.<stage>", e.g. "weather.ttfb" or "render.forecast".
+class Metrics
+{
+public:
+    static LatencyHistogram *histogram(const QString &name);
+    static void record(const QString &name, qint64 micros);
+    static QStringList names();
+
+    static QByteArray toJson();
+    static QByteArray toPrometheus();
+
+private:
+    static QMutex s_mutex;
+    static QHash<QString, LatencyHistogram *> s_histograms;
+};
+
+// Records the lifetime of a scope into a histogram
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(const QString &name);
+    explicit ScopedLatency(LatencyHistogram *histogram);
+    ~ScopedLatency();
+
+private:
+    LatencyHistogram *m_histogram;
+    QElapsedTimer m_timer;
+};
+
+// Splits a network reply into stages: queue wait, connect (DNS + TCP +
+// TLS), time to first byte, download and total
+class RequestTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static void attach(QNetworkReply *reply, const QString &request);
+
+private:
+    RequestTimer(QNetworkReply *reply, const QString &request);
+
+    QString m_request;
+    QElapsedTimer m_timer;
+    qint64 m_connectStartUs;
+    qint64 m_sentUs;
+    qint64 m_firstByteUs;
+
+    void onConnecting();
+    void onEncrypted();
+    void onRequestSent();
+    void onMetaData();
+    void onFinished();
+};
+
+// Periodically dumps all histograms to a Prometheus text or JSON file
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+
+    void start(const QString &filePath, int intervalMs);
+    void startFromEnvironment();
+    bool writeNow();
+
+private:
+    QTimer *m_timer;
+    QString m_filePath;
+};
+
+#endif // METRICS_H
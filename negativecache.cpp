@@ -0,0 +1,72 @@
+#include "negativecache.h"
+#include <QDateTime>
+#include <QMutexLocker>
+
+QMutex NegativeCache::s_mutex;
+QHash<QString, NegativeCache::Entry> NegativeCache::s_entries;
+
+QString NegativeCache::key(const QString &kind, const QString &query)
+{
+    return kind + ':' + query.simplified().toLower();
+}
+
+bool NegativeCache::lookup(const QString &key, QString *error)
+{
+    QMutexLocker locker(&s_mutex);
+    auto it = s_entries.find(key);
+    if (it == s_entries.end()) {
+        return false;
+    }
+    if (it->expiresAt <= QDateTime::currentSecsSinceEpoch()) {
+        s_entries.erase(it);
+        return false;
+    }
+    if (error) {
+        *error = it->error;
+    }
+    return true;
+}
+
+void NegativeCache::insert(const QString &key, const QString &error, int ttlSecs)
+{
+    QMutexLocker locker(&s_mutex);
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    if (s_entries.size() >= MaxEntries && !s_entries.contains(key)) {
+        pruneUnlocked(now);
+    }
+    s_entries.insert(key, { error, now + ttlSecs });
+}
+
+void NegativeCache::clear()
+{
+    QMutexLocker locker(&s_mutex);
+    s_entries.clear();
+}
+
+int NegativeCache::size()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_entries.size();
+}
+
+void NegativeCache::pruneUnlocked(qint64 now)
+{
+    for (auto it = s_entries.begin(); it != s_entries.end();) {
+        if (it->expiresAt <= now) {
+            it = s_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Still full: drop the entry closest to expiry
+    if (s_entries.size() >= MaxEntries) {
+        auto oldest = s_entries.begin();
+        for (auto it = s_entries.begin(); it != s_entries.end(); ++it) {
+            if (it->expiresAt < oldest->expiresAt) {
+                oldest = it;
+            }
+        }
+        s_entries.erase(oldest);
+    }
+}
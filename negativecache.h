@@ -0,0 +1,38 @@
+#ifndef NEGATIVECACHE_H
+#define NEGATIVECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+// Remembers lookups that failed for a reason retrying will not fix, such
+// as "city not found" or another 4xx, so repeated clicks and autocomplete
+// pauses answer from memory for a short while instead of hitting the API.
+// Keys are normalized, see key().
+class NegativeCache
+{
+public:
+    // Case- and whitespace-insensitive key for a request kind and query
+    static QString key(const QString &kind, const QString &query);
+
+    static bool lookup(const QString &key, QString *error = nullptr);
+    static void insert(const QString &key, const QString &error, int ttlSecs = DefaultTtlSecs);
+    static void clear();
+    static int size();
+
+    static constexpr int DefaultTtlSecs = 300;
+    static constexpr int MaxEntries = 512;
+
+private:
+    struct Entry {
+        QString error;
+        qint64 expiresAt = 0;
+    };
+
+    static QMutex s_mutex;
+    static QHash<QString, Entry> s_entries;
+
+    static void pruneUnlocked(qint64 now);
+};
+
+#endif // NEGATIVECACHE_H
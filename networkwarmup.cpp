@@ -0,0 +1,220 @@
+#include "networkwarmup.h"
+#include "apiendpoints.h"
+#include "metrics.h"
+#include <QCoreApplication>
+#include <QHostInfo>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
+#include <QDebug>
+#if QT_CONFIG(ssl)
+#include <QSslConfiguration>
+#endif
+
+QMutex NetworkWarmup::s_mutex;
+QHash<QString, NetworkWarmup::Session> NetworkWarmup::s_sessions;
+bool NetworkWarmup::s_loaded = false;
+bool NetworkWarmup::s_dirty = false;
+
+namespace {
+
+const int SessionsFormatVersion = 1;
+
+} // namespace
+
+bool NetworkWarmup::isEnabled()
+{
+    return qEnvironmentVariableIntValue("WEATHER_NO_PREWARM") == 0;
+}
+
+QStringList NetworkWarmup::knownHosts()
+{
+    QStringList hosts;
+    for (const QString &baseUrl : {ApiEndpoints::apiBaseUrl(), ApiEndpoints::iconBaseUrl()}) {
+        QUrl url(baseUrl);
+        QString root = url.scheme() + "://" + url.authority();
+        if (!hosts.contains(root)) {
+            hosts.append(root);
+        }
+    }
+    return hosts;
+}
+
+void NetworkWarmup::resolveHosts()
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    for (const QString &baseUrl : knownHosts()) {
+        QString host = QUrl(baseUrl).host();
+        QElapsedTimer timer;
+        timer.start();
+        QHostInfo::lookupHost(host, QCoreApplication::instance(), [timer, host](const QHostInfo &info) {
+            Metrics::record("dns.prewarm", timer.nsecsElapsed() / 1000);
+            if (info.error() != QHostInfo::NoError) {
+                qDebug() << "Prewarm lookup failed for" << host << info.errorString();
+            }
+        });
+    }
+}
+
+void NetworkWarmup::prewarm(QNetworkAccessManager *manager, const QString &baseUrl)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QUrl url(baseUrl);
+    if (url.scheme() == "https") {
+#if QT_CONFIG(ssl)
+        QNetworkRequest request(url);
+        applySession(request);
+        manager->connectToHostEncrypted(url.host(), quint16(url.port(443)), request.sslConfiguration());
+#endif
+    } else {
+        manager->connectToHost(url.host(), quint16(url.port(80)));
+    }
+}
+
+QNetworkReply *NetworkWarmup::get(QNetworkAccessManager *manager, QNetworkRequest request)
+{
+    if (request.url().scheme() != "https") {
+        return manager->get(request);
+    }
+
+    applySession(request);
+    QNetworkReply *reply = manager->get(request);
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply]() {
+        storeTicket(reply);
+    });
+    return reply;
+}
+
+void NetworkWarmup::applySession(QNetworkRequest &request)
+{
+#if QT_CONFIG(ssl)
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    // Needed for sessionTicket() to be filled in
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+    QMutexLocker locker(&s_mutex);
+    loadSessionsUnlocked();
+    Session session = s_sessions.value(request.url().host());
+    if (session.expiresAt > QDateTime::currentSecsSinceEpoch()) {
+        config.setSessionTicket(session.ticket);
+    }
+    request.setSslConfiguration(config);
+#else
+    Q_UNUSED(request);
+#endif
+}
+
+void NetworkWarmup::storeTicket(QNetworkReply *reply)
+{
+#if QT_CONFIG(ssl)
+    // TLS 1.3 tickets arrive after the handshake, so read them at the end
+    QSslConfiguration config = reply->sslConfiguration();
+    QByteArray ticket = config.sessionTicket();
+    if (ticket.isEmpty()) {
+        return;
+    }
+
+    int lifetime = config.sessionTicketLifeTimeHint();
+    Session session;
+    session.ticket = ticket;
+    session.expiresAt = QDateTime::currentSecsSinceEpoch() + (lifetime > 0 ? lifetime : 3600);
+
+    QMutexLocker locker(&s_mutex);
+    QString host = reply->url().host();
+    if (s_sessions.value(host).ticket != ticket) {
+        s_sessions.insert(host, session);
+        s_dirty = true;
+    }
+#else
+    Q_UNUSED(reply);
+#endif
+}
+
+QString NetworkWarmup::sessionsFilePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/tls_sessions.json";
+}
+
+void NetworkWarmup::loadSessions()
+{
+    QMutexLocker locker(&s_mutex);
+    loadSessionsUnlocked();
+}
+
+void NetworkWarmup::loadSessionsUnlocked()
+{
+    if (s_loaded) {
+        return;
+    }
+    s_loaded = true;
+
+    QFile file(sessionsFilePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != SessionsFormatVersion) {
+        return;
+    }
+
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    QJsonObject sessions = root.value("sessions").toObject();
+    for (auto it = sessions.constBegin(); it != sessions.constEnd(); ++it) {
+        QJsonObject json = it.value().toObject();
+        Session session;
+        session.ticket = QByteArray::fromBase64(json.value("ticket").toString().toLatin1());
+        session.expiresAt = qint64(json.value("expires").toDouble());
+        if (!session.ticket.isEmpty() && session.expiresAt > now) {
+            s_sessions.insert(it.key(), session);
+        }
+    }
+}
+
+void NetworkWarmup::saveSessions()
+{
+    QMutexLocker locker(&s_mutex);
+    if (!s_dirty) {
+        return;
+    }
+
+    QJsonObject sessions;
+    for (auto it = s_sessions.constBegin(); it != s_sessions.constEnd(); ++it) {
+        QJsonObject json;
+        json["ticket"] = QString::fromLatin1(it->ticket.toBase64());
+        json["expires"] = double(it->expiresAt);
+        sessions[it.key()] = json;
+    }
+
+    QJsonObject root;
+    root["version"] = SessionsFormatVersion;
+    root["sessions"] = sessions;
+
+    QString filePath = sessionsFilePath();
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not save TLS sessions:" << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    // Tickets allow resuming a session, keep them private
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    if (file.commit()) {
+        s_dirty = false;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef NETWORKWARMUP_H
+#define NETWORKWARMUP_H
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+
+// Takes DNS, TCP and TLS setup off the first request. At startup the known
+// hosts are resolved and each network manager opens its connection early;
+// TLS session tickets are kept on disk so the next launch can resume
+// instead of doing a full handshake.
+// Set WEATHER_NO_PREWARM=1 to compare against a cold start.
+class NetworkWarmup
+{
+public:
+    static bool isEnabled();
+
+    // Base URLs of every host the app talks to
+    static QStringList knownHosts();
+
+    // Fills Qt's host cache in the background
+    static void resolveHosts();
+
+    // Opens a connection to baseUrl's host on this manager's pool
+    static void prewarm(QNetworkAccessManager *manager, const QString &baseUrl);
+
+    // GET with a resumable TLS session; stores the new ticket when done
+    static QNetworkReply *get(QNetworkAccessManager *manager, QNetworkRequest request);
+
+    static void loadSessions();
+    static void saveSessions();
+    static QString sessionsFilePath();
+
+private:
+    struct Session {
+        QByteArray ticket;
+        qint64 expiresAt = 0;   // seconds since epoch
+    };
+
+    static QMutex s_mutex;
+    static QHash<QString, Session> s_sessions;
+    static bool s_loaded;
+    static bool s_dirty;
+
+    static void loadSessionsUnlocked();
+    static void applySession(QNetworkRequest &request);
+    static void storeTicket(QNetworkReply *reply);
+};
+
+#endif // NETWORKWARMUP_H
@@ -0,0 +1,118 @@
+#include "observationstore.h"
+#include "favoriteslist.h"
+
+QString ObservationStore::key(const CityResult &location)
+{
+    return FavoritesList::key(location);
+}
+
+void ObservationStore::addLocation(const CityResult &location)
+{
+    if (!location.isValid() || !location.hasCoordinates()) {
+        return;
+    }
+
+    auto it = m_keys.constFind(key(location));
+    if (it != m_keys.constEnd()) {
+        m_observations[*it].location = location;
+    } else {
+        Observation observation;
+        observation.location = location;
+        m_keys.insert(key(location), m_observations.size());
+        m_observations.append(observation);
+    }
+    m_indexDirty = true;
+}
+
+void ObservationStore::record(const CityResult &location, const WeatherData &weather,
+                              const QDateTime &observedAt)
+{
+    CityResult positioned = location;
+    if (!positioned.hasCoordinates() && !qIsNaN(weather.lat())) {
+        positioned.lat = weather.lat();
+        positioned.lon = weather.lon();
+    }
+    addLocation(positioned);
+
+    auto it = m_keys.constFind(key(positioned));
+    if (it != m_keys.constEnd()) {
+        Observation &observation = m_observations[*it];
+        observation.weather = weather;
+        observation.observedAt = observedAt;
+    }
+}
+
+bool ObservationStore::contains(const CityResult &location) const
+{
+    return m_keys.contains(key(location));
+}
+
+ObservationStore::Observation ObservationStore::observation(const CityResult &location) const
+{
+    auto it = m_keys.constFind(key(location));
+    return it != m_keys.constEnd() ? m_observations.at(*it) : Observation();
+}
+
+const SpatialIndex &ObservationStore::index() const
+{
+    // Rebuilt on the next query after a change; cheap at the sizes we track
+    if (m_indexDirty) {
+        QVector<SpatialIndex::Point> points;
+        points.reserve(m_observations.size());
+        for (int i = 0; i < m_observations.size(); ++i) {
+            const CityResult &location = m_observations.at(i).location;
+            points.append({location.lat, location.lon, i});
+        }
+        m_index.build(points);
+        m_indexDirty = false;
+    }
+    return m_index;
+}
+
+QVector<ObservationStore::Nearby> ObservationStore::nearby(const CityResult &location, int k, double maxKm) const
+{
+    QVector<Nearby> result;
+    if (!location.hasCoordinates() || k <= 0) {
+        return result;
+    }
+
+    // One extra in case the city itself is indexed
+    QString self = key(location);
+    const QVector<SpatialIndex::Neighbor> neighbors = index().nearest(location.lat, location.lon, k + 1, maxKm);
+    for (const SpatialIndex::Neighbor &neighbor : neighbors) {
+        const Observation &observation = m_observations.at(neighbor.id);
+        if (key(observation.location) == self) {
+            continue;
+        }
+        result.append({observation, neighbor.distanceKm});
+        if (result.size() == k) {
+            break;
+        }
+    }
+    return result;
+}
+
+bool ObservationStore::nearestObservation(const CityResult &location, double maxKm, qint64 maxAgeSecs,
+                                          Nearby *result) const
+{
+    if (!location.hasCoordinates()) {
+        return false;
+    }
+
+    QDateTime oldest = QDateTime::currentDateTimeUtc().addSecs(-maxAgeSecs);
+    QString self = key(location);
+    const QVector<SpatialIndex::Neighbor> neighbors = index().withinRadius(location.lat, location.lon, maxKm);
+    for (const SpatialIndex::Neighbor &neighbor : neighbors) {
+        const Observation &observation = m_observations.at(neighbor.id);
+        if (!observation.hasWeather() || observation.observedAt < oldest
+            || key(observation.location) == self) {
+            continue;
+        }
+        if (result) {
+            result->observation = observation;
+            result->distanceKm = neighbor.distanceKm;
+        }
+        return true;
+    }
+    return false;
+}
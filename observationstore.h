@@ -0,0 +1,57 @@
+#ifndef OBSERVATIONSTORE_H
+#define OBSERVATIONSTORE_H
+
+#include <QVector>
+#include <QHash>
+#include <QDateTime>
+#include "cityresult.h"
+#include "weatherdata.h"
+#include "spatialindex.h"
+
+// Every city the app knows a position for (favorites and anything fetched),
+// with the last observed weather where there is one. Answers "what is near
+// here" so the UI can list neighbors and borrow a neighbor's observation
+// when a city's own fetch fails.
+class ObservationStore
+{
+public:
+    struct Observation {
+        CityResult location;
+        WeatherData weather;
+        QDateTime observedAt;   // invalid if never fetched
+
+        bool hasWeather() const { return observedAt.isValid(); }
+    };
+
+    struct Nearby {
+        Observation observation;
+        double distanceKm = 0;
+    };
+
+    // Known position without weather; keeps an existing observation
+    void addLocation(const CityResult &location);
+    void record(const CityResult &location, const WeatherData &weather,
+                const QDateTime &observedAt = QDateTime::currentDateTimeUtc());
+
+    bool contains(const CityResult &location) const;
+    Observation observation(const CityResult &location) const;
+    int size() const { return m_observations.size(); }
+    const QVector<Observation> &observations() const { return m_observations; }
+
+    // Closest cities first, the city itself excluded
+    QVector<Nearby> nearby(const CityResult &location, int k, double maxKm) const;
+    // Freshest usable stand-in for a city without its own data
+    bool nearestObservation(const CityResult &location, double maxKm, qint64 maxAgeSecs,
+                            Nearby *result) const;
+
+private:
+    QVector<Observation> m_observations;
+    QHash<QString, int> m_keys;
+    mutable SpatialIndex m_index;
+    mutable bool m_indexDirty = false;
+
+    static QString key(const CityResult &location);
+    const SpatialIndex &index() const;
+};
+
+#endif // OBSERVATIONSTORE_H
@@ -0,0 +1,465 @@
+#include "proxyserver.h"
+#include "metrics.h"
+#include "memoryaccountant.h"
+#include <QNetworkReply>
+#include <QUrlQuery>
+#include <QJsonDocument>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const int MaxHeaderSize = 16 * 1024;
+// Bodies are skipped, never used, so anything larger is refused
+const qint64 MaxBodySize = 64 * 1024;
+// Time a connection gets to send a complete request, whether new, idle
+// between keep-alive requests, or trickling in a header
+const int IdleTimeoutMs = 5000;
+
+const char *statusText(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+QByteArray errorBody(int status, const QString &message)
+{
+    // Same shape as OpenWeatherMap errors so clients report them as usual
+    QJsonObject json;
+    json["cod"] = QString::number(status);
+    json["message"] = message;
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+} // namespace
+
+ProxyServer::ProxyServer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_server(new QTcpServer(this))
+    , m_service(new WeatherService(this))
+    , m_apiKey(qEnvironmentVariable("OPENWEATHERMAP_API_KEY"))
+    , m_cacheId(0)
+    , m_requests(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_collapsed(0)
+    , m_upstreamRequests(0)
+    , m_upstreamErrors(0)
+    , m_staleServed(0)
+{
+    m_options.maxEntries = qMax(1, m_options.maxEntries);
+    m_service->setBaseUrl(m_options.upstreamUrl);
+    m_clock.start();
+
+    connect(m_server, &QTcpServer::newConnection, this, &ProxyServer::onNewConnection);
+
+    m_cacheId = MemoryAccountant::instance()->registerCache(
+        "proxy.responses", 1.0,
+        [this](const QString &key) {
+            const CachedResponse response = m_cache.value(key);
+            return key.size() * qint64(sizeof(QChar)) + response.head.size() + response.body.size();
+        },
+        [this](const QString &key) {
+            m_cache.remove(key);
+            return true;
+        });
+}
+
+ProxyServer::~ProxyServer()
+{
+    MemoryAccountant::instance()->unregisterCache(m_cacheId);
+}
+
+bool ProxyServer::listen()
+{
+    if (!m_server->listen(m_options.address, m_options.port)) {
+        return false;
+    }
+    qDebug() << "Proxy listening on" << m_server->serverAddress().toString()
+             << m_server->serverPort() << "upstream" << m_service->baseUrl();
+    return true;
+}
+
+quint16 ProxyServer::serverPort() const
+{
+    return m_server->serverPort();
+}
+
+QString ProxyServer::errorString() const
+{
+    return m_server->errorString();
+}
+
+QJsonObject ProxyServer::stats() const
+{
+    qint64 bytes = 0;
+    for (const CachedResponse &response : m_cache) {
+        bytes += response.head.size() + response.body.size();
+    }
+
+    QJsonObject json;
+    json["requests"] = double(m_requests);
+    json["hits"] = double(m_hits);
+    json["misses"] = double(m_misses);
+    json["collapsed"] = double(m_collapsed);
+    json["upstream_requests"] = double(m_upstreamRequests);
+    json["upstream_errors"] = double(m_upstreamErrors);
+    json["stale_served"] = double(m_staleServed);
+    json["connections"] = m_connections.size();
+    json["entries"] = m_cache.size();
+    json["cache_bytes"] = double(bytes);
+    json["in_flight"] = m_waiting.size();
+    return json;
+}
+
+void ProxyServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        // Small responses on a long-lived connection, don't wait for Nagle
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        Connection connection;
+        connection.idleTimer = new QTimer(socket);
+        connection.idleTimer->setSingleShot(true);
+        connection.idleTimer->setInterval(IdleTimeoutMs);
+        connect(connection.idleTimer, &QTimer::timeout, socket, [this, socket]() {
+            // A request waiting on upstream is not idle
+            if (m_connections.contains(socket) && !m_connections[socket].busy) {
+                socket->disconnectFromHost();
+            }
+        });
+        connection.idleTimer->start();
+        m_connections.insert(socket, connection);
+        connect(socket, &QTcpSocket::readyRead, this, &ProxyServer::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &ProxyServer::onDisconnected);
+    }
+}
+
+void ProxyServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket || !m_connections.contains(socket)) {
+        return;
+    }
+    m_connections[socket].buffer.append(socket->readAll());
+    processBuffer(socket);
+}
+
+void ProxyServer::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+    m_connections.remove(socket);
+    socket->deleteLater();
+}
+
+void ProxyServer::processBuffer(QTcpSocket *socket)
+{
+    // One request at a time per connection keeps pipelined responses in order
+    while (m_connections.contains(socket)) {
+        Connection &connection = m_connections[socket];
+        if (connection.busy || connection.closeAfter) {
+            return;
+        }
+
+        int headerEnd = connection.buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (connection.buffer.size() > MaxHeaderSize) {
+                connection.buffer.clear();
+                connection.closeAfter = true;
+                respondError(socket, 431, "request headers too large");
+            }
+            return;
+        }
+
+        QList<QByteArray> lines = connection.buffer.left(headerEnd).split('\n');
+        QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() != 3 || !requestLine[2].startsWith("HTTP/1.")) {
+            connection.buffer.clear();
+            connection.closeAfter = true;
+            respondError(socket, 400, "malformed request line");
+            return;
+        }
+
+        // HTTP/1.1 keeps the connection open unless told otherwise
+        bool keepAlive = requestLine[2] == "HTTP/1.1";
+        qint64 contentLength = -1;
+        bool badLength = false;
+        for (int i = 1; i < lines.size(); ++i) {
+            const QByteArray &line = lines[i];
+            int colon = line.indexOf(':');
+            if (colon <= 0) {
+                continue;
+            }
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed().toLower();
+            if (name == "connection") {
+                keepAlive = value.contains("keep-alive") || (keepAlive && !value.contains("close"));
+            } else if (name == "content-length") {
+                // A bad or conflicting length would desync the request stream
+                bool ok = false;
+                qint64 length = value.toLongLong(&ok);
+                if (!ok || length < 0 || length > MaxBodySize
+                    || (contentLength >= 0 && length != contentLength)) {
+                    badLength = true;
+                }
+                contentLength = length;
+            }
+        }
+        if (badLength) {
+            connection.buffer.clear();
+            connection.closeAfter = true;
+            respondError(socket, 400, "invalid Content-Length");
+            return;
+        }
+        contentLength = qMax<qint64>(0, contentLength);
+
+        // Bodies are not used, but must be skipped before the next request
+        qint64 requestSize = headerEnd + 4 + contentLength;
+        if (connection.buffer.size() < requestSize) {
+            return;
+        }
+        connection.buffer.remove(0, int(requestSize));
+        connection.closeAfter = !keepAlive;
+        connection.timer.start();
+        connection.idleTimer->stop();
+
+        handleRequest(socket, requestLine[0], requestLine[1]);
+    }
+}
+
+void ProxyServer::handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &target)
+{
+    ++m_requests;
+
+    if (method != "GET") {
+        respondError(socket, 405, "only GET is supported");
+        return;
+    }
+
+    QUrl url = QUrl::fromEncoded(target);
+    QString path = url.path();
+    QUrlQuery query(url);
+
+    if (path == "/health" || path == "/stats") {
+        respond(socket, makeResponse(200, "application/json",
+                                     QJsonDocument(stats()).toJson(QJsonDocument::Compact)), "BYPASS");
+        return;
+    }
+
+    int ttl = 0;
+    QString upstreamRoot = m_options.upstreamUrl;
+    if (path == "/data/2.5/weather") {
+        ttl = m_options.weatherTtl;
+    } else if (path == "/data/2.5/forecast") {
+        ttl = m_options.forecastTtl;
+    } else if (path == "/geo/1.0/direct") {
+        ttl = m_options.geocodingTtl;
+    } else if (path.startsWith("/img/wn/") && path.endsWith(".png")) {
+        ttl = m_options.iconTtl;
+        upstreamRoot = m_options.iconUpstreamUrl;
+        query.clear();
+    } else {
+        respondError(socket, 404, "unknown endpoint");
+        return;
+    }
+
+    // Without a proxy key each client's own key is sent upstream, so
+    // clients only share entries and calls made with the same key
+    QString key = cacheKey(path, query, m_apiKey.isEmpty());
+
+    auto cached = m_cache.constFind(key);
+    if (cached != m_cache.constEnd() && cached->expiresAt > m_clock.elapsed()) {
+        ++m_hits;
+        MemoryAccountant::instance()->touch(m_cacheId, key);
+        respond(socket, *cached, "HIT");
+        return;
+    }
+
+    ++m_misses;
+    m_connections[socket].busy = true;
+
+    // Identical misses wait on the call already in flight
+    auto waiting = m_waiting.find(key);
+    if (waiting != m_waiting.end()) {
+        ++m_collapsed;
+        waiting->append(socket);
+        return;
+    }
+    m_waiting.insert(key, {QPointer<QTcpSocket>(socket)});
+
+    // The proxy's own key, when set, replaces whatever the client sent
+    if (!m_apiKey.isEmpty() && upstreamRoot == m_options.upstreamUrl) {
+        query.removeAllQueryItems("appid");
+        query.addQueryItem("appid", m_apiKey);
+    }
+
+    QUrl upstream(upstreamRoot + path);
+    upstream.setQuery(query);
+    fetchUpstream(key, upstream, ttl);
+}
+
+void ProxyServer::fetchUpstream(const QString &key, const QUrl &url, int ttl)
+{
+    ++m_upstreamRequests;
+    QNetworkReply *reply = m_service->forward(url, "proxy.upstream");
+    connect(reply, &QNetworkReply::finished, this, [this, reply, key, ttl]() {
+        onUpstreamFinished(reply, key, ttl);
+    });
+}
+
+void ProxyServer::onUpstreamFinished(QNetworkReply *reply, const QString &key, int ttl)
+{
+    reply->deleteLater();
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    CachedResponse response;
+    const char *cacheState = "MISS";
+
+    if (status == 0) {
+        // No HTTP answer at all; an expired copy beats an error
+        ++m_upstreamErrors;
+        auto stale = m_cache.constFind(key);
+        if (stale != m_cache.constEnd()) {
+            ++m_staleServed;
+            response = *stale;
+            cacheState = "STALE";
+        } else {
+            response = makeResponse(502, "application/json", errorBody(502, reply->errorString()));
+        }
+        qWarning() << "Proxy upstream error:" << reply->errorString();
+    } else {
+        QByteArray contentType = reply->header(QNetworkRequest::ContentTypeHeader).toByteArray();
+        if (contentType.isEmpty()) {
+            contentType = "application/octet-stream";
+        }
+        response = makeResponse(status, contentType, reply->readAll());
+        if (status == 200) {
+            response.storedAt = m_clock.elapsed();
+            response.expiresAt = response.storedAt + qint64(ttl) * 1000;
+            store(key, response);
+        } else {
+            ++m_upstreamErrors;
+        }
+    }
+
+    const QList<QPointer<QTcpSocket>> waiters = m_waiting.take(key);
+    for (const QPointer<QTcpSocket> &socket : waiters) {
+        if (socket && m_connections.contains(socket)) {
+            respond(socket, response, cacheState);
+            // Serve anything pipelined behind the upstream wait
+            processBuffer(socket);
+        }
+    }
+}
+
+void ProxyServer::respond(QTcpSocket *socket, const CachedResponse &response, const char *cacheState)
+{
+    Connection &connection = m_connections[socket];
+
+    QByteArray out;
+    out.reserve(response.head.size() + response.body.size() + 64);
+    out.append(response.head);
+    out.append("X-Cache: ").append(cacheState).append("\r\n");
+    out.append(connection.closeAfter ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n");
+    out.append(response.body);
+    socket->write(out);
+
+    if (qstrcmp(cacheState, "BYPASS") != 0) {
+        Metrics::record(qstrcmp(cacheState, "HIT") == 0 ? "proxy.hit" : "proxy.miss",
+                        connection.timer.nsecsElapsed() / 1000);
+    }
+
+    connection.busy = false;
+    if (connection.closeAfter) {
+        socket->disconnectFromHost();
+    } else {
+        connection.idleTimer->start();
+    }
+}
+
+void ProxyServer::respondError(QTcpSocket *socket, int status, const QString &message)
+{
+    respond(socket, makeResponse(status, "application/json", errorBody(status, message)), "BYPASS");
+}
+
+void ProxyServer::store(const QString &key, const CachedResponse &response)
+{
+    m_cache.insert(key, response);
+    MemoryAccountant::instance()->charge(m_cacheId, key);
+    if (m_cache.size() > m_options.maxEntries) {
+        evict();
+    }
+}
+
+void ProxyServer::evict()
+{
+    // Drop expired entries, then the oldest, down to 90% so this runs rarely
+    qint64 now = m_clock.elapsed();
+    for (auto it = m_cache.begin(); it != m_cache.end();) {
+        if (it->expiresAt <= now) {
+            MemoryAccountant::instance()->release(m_cacheId, it.key());
+            it = m_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    int target = m_options.maxEntries - m_options.maxEntries / 10;
+    if (m_cache.size() <= target) {
+        return;
+    }
+
+    QList<QPair<qint64, QString>> ages;
+    ages.reserve(m_cache.size());
+    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it) {
+        ages.append(qMakePair(it->storedAt, it.key()));
+    }
+    std::sort(ages.begin(), ages.end());
+    for (int i = 0; i < ages.size() && m_cache.size() > target; ++i) {
+        m_cache.remove(ages[i].second);
+        MemoryAccountant::instance()->release(m_cacheId, ages[i].second);
+    }
+}
+
+ProxyServer::CachedResponse ProxyServer::makeResponse(int status, const QByteArray &contentType, const QByteArray &body)
+{
+    CachedResponse response;
+    response.head = "HTTP/1.1 " + QByteArray::number(status) + ' ' + statusText(status) + "\r\n"
+                    + "Content-Type: " + contentType + "\r\n"
+                    + "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response.body = body;
+    return response;
+}
+
+QString ProxyServer::cacheKey(const QString &path, const QUrlQuery &query, bool keepAppId)
+{
+    // appid is normally left out so every client shares the same entries
+    QList<QPair<QString, QString>> items = query.queryItems(QUrl::FullyDecoded);
+    if (!keepAppId) {
+        items.erase(std::remove_if(items.begin(), items.end(), [](const QPair<QString, QString> &item) {
+            return item.first == "appid";
+        }), items.end());
+    }
+    std::sort(items.begin(), items.end());
+
+    QString key = path;
+    for (const QPair<QString, QString> &item : items) {
+        key += '&' + item.first + '=' + item.second;
+    }
+    return key;
+}
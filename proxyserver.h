@@ -0,0 +1,98 @@
+#ifndef PROXYSERVER_H
+#define PROXYSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QPointer>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QJsonObject>
+#include "weatherservice.h"
+
+// LAN caching proxy: speaks enough HTTP/1.1 to serve the OpenWeatherMap
+// endpoints the dashboard uses. Responses are cached pre-serialized,
+// concurrent identical misses share one upstream call, and connections
+// are kept alive and may pipeline.
+class ProxyServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QHostAddress address = QHostAddress::Any;
+        quint16 port = 8080;
+        QString upstreamUrl;         // API root, e.g. https://api.openweathermap.org
+        QString iconUpstreamUrl;     // icon root, e.g. https://openweathermap.org
+        int maxEntries = 10000;
+        int weatherTtl = 600;        // seconds
+        int forecastTtl = 1800;
+        int geocodingTtl = 86400;
+        int iconTtl = 7 * 86400;
+    };
+
+    explicit ProxyServer(const Options &options, QObject *parent = nullptr);
+    ~ProxyServer();
+
+    bool listen();
+    quint16 serverPort() const;
+    QString errorString() const;
+
+    QJsonObject stats() const;
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    struct CachedResponse {
+        QByteArray head;        // status line and fixed headers
+        QByteArray body;
+        qint64 storedAt = 0;    // ms on m_clock
+        qint64 expiresAt = 0;
+    };
+
+    struct Connection {
+        QByteArray buffer;
+        bool busy = false;      // waiting on upstream, later requests stay buffered
+        bool closeAfter = false;
+        QElapsedTimer timer;
+        QTimer *idleTimer = nullptr;    // closes the socket if no full request arrives
+    };
+
+    Options m_options;
+    QTcpServer *m_server;
+    WeatherService *m_service;
+    QElapsedTimer m_clock;
+    QString m_apiKey;
+    int m_cacheId;
+
+    QHash<QTcpSocket *, Connection> m_connections;
+    QHash<QString, CachedResponse> m_cache;
+    QHash<QString, QList<QPointer<QTcpSocket>>> m_waiting;
+
+    quint64 m_requests;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_collapsed;
+    quint64 m_upstreamRequests;
+    quint64 m_upstreamErrors;
+    quint64 m_staleServed;
+
+    void processBuffer(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &target);
+    void fetchUpstream(const QString &key, const QUrl &url, int ttl);
+    void onUpstreamFinished(QNetworkReply *reply, const QString &key, int ttl);
+    void respond(QTcpSocket *socket, const CachedResponse &response, const char *cacheState);
+    void respondError(QTcpSocket *socket, int status, const QString &message);
+    void store(const QString &key, const CachedResponse &response);
+    void evict();
+
+    static CachedResponse makeResponse(int status, const QByteArray &contentType, const QByteArray &body);
+    static QString cacheKey(const QString &path, const QUrlQuery &query, bool keepAppId);
+};
+
+#endif // PROXYSERVER_H
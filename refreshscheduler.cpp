@@ -0,0 +1,253 @@
+#include "refreshscheduler.h"
+#include <QDebug>
+#include <ctime>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Wakeup grid per state; VeryCoarseTimer rounds to whole seconds anyway
+const qint64 ActiveBatchMs = 1000;
+const qint64 InactiveBatchMs = 5000;
+const qint64 HiddenBatchMs = 60000;
+
+} // namespace
+
+RefreshScheduler *RefreshScheduler::instance()
+{
+    static RefreshScheduler *scheduler = new RefreshScheduler();
+    return scheduler;
+}
+
+RefreshScheduler::RefreshScheduler(QObject *parent)
+    : QObject(parent)
+    , m_nextTaskId(1)
+    , m_state(Active)
+    , m_timer(new QTimer(this))
+    , m_accountedMs(0)
+    , m_accountedCpuUs(processCpuUs())
+    , m_accountedSwitches(processContextSwitches())
+{
+    m_clock.start();
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::VeryCoarseTimer);
+    connect(m_timer, &QTimer::timeout, this, [this]() {
+        m_usage[m_state].wakeups++;
+        runDue();
+    });
+}
+
+int RefreshScheduler::addTask(const QString &name, int intervalMs, HiddenPolicy policy,
+                              std::function<void()> callback)
+{
+    Task task;
+    task.name = name;
+    task.intervalMs = qMax(1000, intervalMs);
+    task.policy = policy;
+    task.callback = std::move(callback);
+    task.lastRunMs = m_clock.elapsed();
+
+    int taskId = m_nextTaskId++;
+    m_tasks.insert(taskId, task);
+    reschedule();
+    return taskId;
+}
+
+void RefreshScheduler::removeTask(int taskId)
+{
+    if (m_tasks.remove(taskId) > 0) {
+        reschedule();
+    }
+}
+
+void RefreshScheduler::restartTask(int taskId)
+{
+    auto it = m_tasks.find(taskId);
+    if (it != m_tasks.end()) {
+        it->lastRunMs = m_clock.elapsed();
+        reschedule();
+    }
+}
+
+void RefreshScheduler::setState(State state)
+{
+    if (state == m_state || state == StateCount) {
+        return;
+    }
+    account();
+    const State previous = m_state;
+    m_state = state;
+    qDebug().noquote() << QString("[scheduler] %1 -> %2").arg(stateName(previous), stateName(state));
+    emit stateChanged(state);
+
+    // Coming back into view: whatever fell due meanwhile runs now, together
+    if (state == Active) {
+        runDue();
+    } else {
+        reschedule();
+    }
+}
+
+QString RefreshScheduler::stateName(State state)
+{
+    switch (state) {
+    case Active:
+        return "active";
+    case Inactive:
+        return "inactive";
+    case Hidden:
+        return "hidden";
+    default:
+        return QString();
+    }
+}
+
+qint64 RefreshScheduler::dueAt(const Task &task) const
+{
+    switch (m_state) {
+    case Inactive:
+        return task.lastRunMs + task.intervalMs * InactiveStretch;
+    case Hidden:
+        return task.policy == Pause ? -1 : task.lastRunMs + task.intervalMs * HiddenStretch;
+    default:
+        return task.lastRunMs + task.intervalMs;
+    }
+}
+
+qint64 RefreshScheduler::batchMs() const
+{
+    switch (m_state) {
+    case Inactive:
+        return InactiveBatchMs;
+    case Hidden:
+        return HiddenBatchMs;
+    default:
+        return ActiveBatchMs;
+    }
+}
+
+void RefreshScheduler::runDue()
+{
+    const qint64 now = m_clock.elapsed();
+
+    // Collected first: a callback may add or remove tasks
+    QList<int> due;
+    for (auto it = m_tasks.constBegin(); it != m_tasks.constEnd(); ++it) {
+        const qint64 dueMs = dueAt(*it);
+        if (dueMs >= 0 && dueMs <= now) {
+            due.append(it.key());
+        }
+    }
+    for (int taskId : due) {
+        auto it = m_tasks.find(taskId);
+        if (it == m_tasks.end()) {
+            continue;
+        }
+        it->lastRunMs = now;
+        it->runs++;
+        std::function<void()> callback = it->callback;
+        callback();
+    }
+    reschedule();
+}
+
+void RefreshScheduler::reschedule()
+{
+    qint64 next = -1;
+    for (const Task &task : m_tasks) {
+        const qint64 dueMs = dueAt(task);
+        if (dueMs >= 0 && (next < 0 || dueMs < next)) {
+            next = dueMs;
+        }
+    }
+    if (next < 0) {
+        m_timer->stop();
+        return;
+    }
+
+    // Rounded up to the grid, so tasks due in the same slot wake once
+    const qint64 batch = batchMs();
+    const qint64 wakeAt = (next + batch - 1) / batch * batch;
+    m_timer->start(int(qBound<qint64>(0, wakeAt - m_clock.elapsed(), 24 * 3600 * 1000)));
+}
+
+void RefreshScheduler::account()
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 cpuUs = processCpuUs();
+    const qint64 switches = processContextSwitches();
+
+    Usage &usage = m_usage[m_state];
+    usage.wallMs += now - m_accountedMs;
+    usage.cpuUs += cpuUs - m_accountedCpuUs;
+    if (switches >= 0 && m_accountedSwitches >= 0) {
+        usage.contextSwitches += switches - m_accountedSwitches;
+    } else {
+        usage.contextSwitches = -1;
+    }
+    m_accountedMs = now;
+    m_accountedCpuUs = cpuUs;
+    m_accountedSwitches = switches;
+}
+
+qint64 RefreshScheduler::processCpuUs()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    }
+#endif
+    return qint64(std::clock()) * 1000000 / CLOCKS_PER_SEC;
+}
+
+qint64 RefreshScheduler::processContextSwitches()
+{
+    // Each voluntary switch is the process going to sleep, so it counts
+    // the wakeups of every thread, including Qt's own
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return qint64(usage.ru_nvcsw);
+    }
+#endif
+    return -1;
+}
+
+QJsonObject RefreshScheduler::toJson()
+{
+    account();
+
+    QJsonObject json;
+    json["state"] = stateName(m_state);
+
+    QJsonObject states;
+    for (int i = 0; i < StateCount; ++i) {
+        const Usage &usage = m_usage[i];
+        const double minutes = usage.wallMs / 60000.0;
+        QJsonObject entry;
+        entry["seconds"] = usage.wallMs / 1000.0;
+        entry["cpu_ms"] = usage.cpuUs / 1000.0;
+        entry["cpu_percent"] = usage.wallMs > 0 ? usage.cpuUs / (usage.wallMs * 10.0) : 0.0;
+        entry["scheduler_wakeups"] = double(usage.wakeups);
+        entry["scheduler_wakeups_per_minute"] = minutes > 0 ? usage.wakeups / minutes : 0.0;
+        if (usage.contextSwitches >= 0) {
+            entry["process_wakeups_per_minute"] = minutes > 0 ? usage.contextSwitches / minutes : 0.0;
+        }
+        states[stateName(State(i))] = entry;
+    }
+    json["states"] = states;
+
+    QJsonObject tasks;
+    for (const Task &task : m_tasks) {
+        QJsonObject entry;
+        entry["interval_ms"] = double(task.intervalMs);
+        entry["hidden"] = task.policy == Pause ? "pause" : "stretch";
+        entry["runs"] = double(task.runs);
+        tasks[task.name] = entry;
+    }
+    json["tasks"] = tasks;
+    return json;
+}
@@ -0,0 +1,101 @@
+#ifndef REFRESHSCHEDULER_H
+#define REFRESHSCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <functional>
+
+// Runs the app's periodic work from a single timer, at a pace that
+// follows whether anyone can see the window. Wakeups fall on a coarse
+// grid, so tasks due close together share one wakeup. While the window
+// is hidden, tasks either pause or run at a stretched interval; when it
+// is shown again, everything that fell due runs in one batch.
+// The window reports its state through setState(). Wall time, CPU time
+// and wakeups are accounted per state. Used from the GUI thread only.
+class RefreshScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Active,     // visible and focused
+        Inactive,   // visible, another application has focus
+        Hidden,     // minimized, hidden or suspended
+        StateCount
+    };
+
+    // What a task does while the window is hidden
+    enum HiddenPolicy {
+        Pause,
+        Stretch
+    };
+
+    static RefreshScheduler *instance();
+
+    // callback runs about every intervalMs while active. The first run
+    // is one interval from now.
+    int addTask(const QString &name, int intervalMs, HiddenPolicy policy, std::function<void()> callback);
+    void removeTask(int taskId);
+    // Counts the next interval from now, e.g. after the task's work was
+    // done some other way
+    void restartTask(int taskId);
+    int taskCount() const { return m_tasks.size(); }
+
+    State state() const { return m_state; }
+    void setState(State state);
+
+    static QString stateName(State state);
+    QJsonObject toJson();
+
+    // Intervals are multiplied by these outside the active state
+    static constexpr int InactiveStretch = 2;
+    static constexpr int HiddenStretch = 10;
+
+signals:
+    void stateChanged(RefreshScheduler::State state);
+
+private:
+    struct Task {
+        QString name;
+        qint64 intervalMs = 0;
+        HiddenPolicy policy = Pause;
+        std::function<void()> callback;
+        qint64 lastRunMs = 0;
+        quint64 runs = 0;
+    };
+
+    // Totals charged to a state
+    struct Usage {
+        qint64 wallMs = 0;
+        qint64 cpuUs = 0;
+        quint64 wakeups = 0;            // timer wakeups of the scheduler
+        qint64 contextSwitches = 0;     // voluntary, all threads; -1 if unknown
+    };
+
+    explicit RefreshScheduler(QObject *parent = nullptr);
+
+    QHash<int, Task> m_tasks;
+    int m_nextTaskId;
+    State m_state;
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+
+    Usage m_usage[StateCount];
+    qint64 m_accountedMs;
+    qint64 m_accountedCpuUs;
+    qint64 m_accountedSwitches;
+
+    qint64 dueAt(const Task &task) const;   // -1 while paused
+    qint64 batchMs() const;
+    void runDue();
+    void reschedule();
+    void account();
+
+    static qint64 processCpuUs();
+    static qint64 processContextSwitches();
+};
+
+#endif // REFRESHSCHEDULER_H
@@ -0,0 +1,143 @@
+#include "requesthedger.h"
+#include "metrics.h"
+#include <QMutexLocker>
+
+QMutex RequestHedger::s_mutex;
+bool RequestHedger::s_configured = false;
+double RequestHedger::s_budgetRatio = 0.1;
+double RequestHedger::s_tokens = 1;
+quint64 RequestHedger::s_requests = 0;
+quint64 RequestHedger::s_hedges = 0;
+quint64 RequestHedger::s_hedgeWins = 0;
+quint64 RequestHedger::s_denied = 0;
+QHash<QString, LatencyHistogram *> RequestHedger::s_responses;
+LatencyHistogram RequestHedger::s_savings;
+
+namespace {
+
+// Unused budget carries over, but only for a short burst
+const double MaxTokens = 5;
+
+} // namespace
+
+QString RequestHedger::secondaryBaseUrl()
+{
+    QString url = qEnvironmentVariable("OPENWEATHERMAP_HEDGE_URL");
+    while (url.endsWith('/')) {
+        url.chop(1);
+    }
+    return url;
+}
+
+void RequestHedger::configureUnlocked()
+{
+    if (s_configured) {
+        return;
+    }
+    s_configured = true;
+    bool ok = false;
+    double percent = qEnvironmentVariable("WEATHER_HEDGE_BUDGET").toDouble(&ok);
+    if (ok && percent >= 0) {
+        s_budgetRatio = qMin(percent, 100.0) / 100.0;
+    }
+}
+
+LatencyHistogram *RequestHedger::responsesUnlocked(const QString &requestType)
+{
+    // Never freed, like the Metrics histograms
+    LatencyHistogram *histogram = s_responses.value(requestType);
+    if (!histogram) {
+        histogram = new LatencyHistogram();
+        s_responses.insert(requestType, histogram);
+    }
+    return histogram;
+}
+
+int RequestHedger::delayMs(const QString &requestType)
+{
+    QMutexLocker locker(&s_mutex);
+    const LatencyHistogram *histogram = responsesUnlocked(requestType);
+    if (histogram->count() < quint64(MinSamples)) {
+        return DefaultDelayMs;
+    }
+    return qMax(MinDelayMs, int(histogram->percentile(95) / 1000));
+}
+
+void RequestHedger::requestStarted()
+{
+    QMutexLocker locker(&s_mutex);
+    configureUnlocked();
+    ++s_requests;
+    s_tokens = qMin(MaxTokens, s_tokens + s_budgetRatio);
+}
+
+bool RequestHedger::tryAcquire()
+{
+    QMutexLocker locker(&s_mutex);
+    configureUnlocked();
+    if (s_tokens < 1) {
+        ++s_denied;
+        return false;
+    }
+    s_tokens -= 1;
+    ++s_hedges;
+    return true;
+}
+
+void RequestHedger::recordResponse(const QString &requestType, qint64 micros, bool hedged, bool hedgeWon)
+{
+    {
+        QMutexLocker locker(&s_mutex);
+        responsesUnlocked(requestType)->record(micros);
+        if (hedgeWon) {
+            ++s_hedgeWins;
+        }
+    }
+    // What the user waited for, hedge or not
+    Metrics::record(requestType + ".response", micros);
+    if (hedged) {
+        Metrics::record(requestType + ".hedged", micros);
+    }
+}
+
+bool RequestHedger::sampleLoser()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_hedgeWins % LoserSampleEvery == 1;
+}
+
+void RequestHedger::recordSaving(qint64 micros)
+{
+    s_savings.record(qMax<qint64>(0, micros));
+}
+
+QJsonObject RequestHedger::toJson()
+{
+    QMutexLocker locker(&s_mutex);
+    configureUnlocked();
+
+    QJsonObject json;
+    json["budget_ratio"] = s_budgetRatio;
+    json["requests"] = double(s_requests);
+    json["hedges"] = double(s_hedges);
+    json["hedge_rate"] = s_requests > 0 ? double(s_hedges) / double(s_requests) : 0.0;
+    json["hedge_wins"] = double(s_hedgeWins);
+    json["budget_denied"] = double(s_denied);
+
+    // Measured on sampled wins by letting the primary finish anyway
+    QJsonObject saving;
+    saving["samples"] = double(s_savings.count());
+    saving["p50_ms"] = s_savings.percentile(50) / 1000.0;
+    saving["p90_ms"] = s_savings.percentile(90) / 1000.0;
+    saving["max_ms"] = s_savings.max() / 1000.0;
+    json["saving"] = saving;
+
+    QJsonObject delays;
+    for (auto it = s_responses.constBegin(); it != s_responses.constEnd(); ++it) {
+        delays[it.key()] = it.value()->count() < quint64(MinSamples)
+            ? DefaultDelayMs
+            : qMax(MinDelayMs, int(it.value()->percentile(95) / 1000));
+    }
+    json["delay_ms"] = delays;
+    return json;
+}
@@ -0,0 +1,58 @@
+#ifndef REQUESTHEDGER_H
+#define REQUESTHEDGER_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QJsonObject>
+#include "latencyhistogram.h"
+
+// Policy and bookkeeping for hedged requests. A request that has not
+// completed by the running p95 of its type gets a duplicate sent to the
+// secondary endpoint; whichever succeeds first wins. Hedges draw on a
+// process-wide budget earned by ordinary requests, so they stay under
+// WEATHER_HEDGE_BUDGET percent of traffic (default 10).
+class RequestHedger
+{
+public:
+    // OPENWEATHERMAP_HEDGE_URL, empty when hedging is off
+    static QString secondaryBaseUrl();
+
+    // When to hedge a request of this type
+    static int delayMs(const QString &requestType);
+
+    // Every primary request earns a fraction of a hedge
+    static void requestStarted();
+    // Spends one hedge; false when the budget is used up
+    static bool tryAcquire();
+
+    // Latency the caller saw, from the first send to the winning reply
+    static void recordResponse(const QString &requestType, qint64 micros, bool hedged, bool hedgeWon);
+    // Sampled losers are left running to measure what the hedge saved
+    static bool sampleLoser();
+    static void recordSaving(qint64 micros);
+
+    static QJsonObject toJson();
+
+    static constexpr int DefaultDelayMs = 1000;
+    static constexpr int MinDelayMs = 50;
+    static constexpr int MinSamples = 20;
+    static constexpr int LoserSampleEvery = 10;
+
+private:
+    static QMutex s_mutex;
+    static bool s_configured;
+    static double s_budgetRatio;
+    static double s_tokens;
+    static quint64 s_requests;
+    static quint64 s_hedges;
+    static quint64 s_hedgeWins;
+    static quint64 s_denied;
+    static QHash<QString, LatencyHistogram *> s_responses;
+    static LatencyHistogram s_savings;
+
+    static void configureUnlocked();
+    static LatencyHistogram *responsesUnlocked(const QString &requestType);
+};
+
+#endif // REQUESTHEDGER_H
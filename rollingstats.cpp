@@ -0,0 +1,306 @@
+#include "rollingstats.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDir>
+#include <QDebug>
+#include <limits>
+
+namespace {
+
+QByteArray historyLine(const QString &city, const RollingStats::Sample &sample)
+{
+    QString name = city;
+    name.replace('\n', ' ');
+    return QString("%1\t%2\t%3\t%4\t%5\n")
+        .arg(sample.time)
+        .arg(sample.temperature, 0, 'f', 2)
+        .arg(sample.humidity, 0, 'f', 1)
+        .arg(sample.pressure, 0, 'f', 1)
+        .arg(name)
+        .toUtf8();
+}
+
+} // namespace
+
+RollingWindow::RollingWindow(qint64 spanSecs, qint64 bucketSecs)
+    : m_span(spanSecs)
+    , m_width(qMax<qint64>(1, bucketSecs))
+    , m_latest(std::numeric_limits<qint64>::min())
+    , m_origin(0)
+    , m_count(0)
+    , m_sumT(0)
+    , m_sumV(0)
+    , m_sumTT(0)
+    , m_sumTV(0)
+{
+}
+
+void RollingWindow::add(qint64 time, double value)
+{
+    if (time < m_latest || qIsNaN(value)) {
+        return;
+    }
+    m_latest = time;
+    advance(time);
+
+    const qint64 start = time - time % m_width;
+    if (m_buckets.empty() || m_buckets.back().start != start) {
+        Bucket bucket;
+        bucket.start = start;
+        m_buckets.push_back(bucket);
+    }
+    if (m_count == 0) {
+        m_origin = start;
+    }
+
+    Bucket &bucket = m_buckets.back();
+    const double local = (time - start) / 3600.0;
+    bucket.count++;
+    bucket.sumT += local;
+    bucket.sumV += value;
+    bucket.sumTT += local * local;
+    bucket.sumTV += local * value;
+
+    const double t = (time - m_origin) / 3600.0;
+    m_count++;
+    m_sumT += t;
+    m_sumV += value;
+    m_sumTT += t * t;
+    m_sumTV += t * value;
+
+    // A value that is not better than a newer one can never be the extreme.
+    // One entry per bucket is enough since a bucket expires as a whole.
+    while (!m_mins.empty() && m_mins.back().value >= value) {
+        m_mins.pop_back();
+    }
+    if (m_mins.empty() || m_mins.back().bucket != start) {
+        m_mins.push_back({ start, value });
+    }
+    while (!m_maxes.empty() && m_maxes.back().value <= value) {
+        m_maxes.pop_back();
+    }
+    if (m_maxes.empty() || m_maxes.back().bucket != start) {
+        m_maxes.push_back({ start, value });
+    }
+
+    // Keep the origin close so the squared sums stay well conditioned
+    if (time - m_origin > 2 * m_span) {
+        rebase();
+    }
+}
+
+void RollingWindow::advance(qint64 now)
+{
+    const qint64 cutoff = now - m_span;
+    while (!m_buckets.empty() && m_buckets.front().start + m_width <= cutoff) {
+        addTotals(m_buckets.front(), -1);
+        m_buckets.pop_front();
+    }
+    while (!m_mins.empty() && m_mins.front().bucket + m_width <= cutoff) {
+        m_mins.pop_front();
+    }
+    while (!m_maxes.empty() && m_maxes.front().bucket + m_width <= cutoff) {
+        m_maxes.pop_front();
+    }
+    if (m_buckets.empty()) {
+        // Also clears rounding left over from the subtractions
+        m_count = 0;
+        m_sumT = m_sumV = m_sumTT = m_sumTV = 0;
+    }
+}
+
+void RollingWindow::addTotals(const Bucket &bucket, double sign)
+{
+    // Moves the bucket's sums from its own start to m_origin
+    const double d = (bucket.start - m_origin) / 3600.0;
+    m_count += sign > 0 ? bucket.count : -bucket.count;
+    m_sumT += sign * (bucket.sumT + bucket.count * d);
+    m_sumV += sign * bucket.sumV;
+    m_sumTT += sign * (bucket.sumTT + 2 * d * bucket.sumT + bucket.count * d * d);
+    m_sumTV += sign * (bucket.sumTV + d * bucket.sumV);
+}
+
+void RollingWindow::rebase()
+{
+    // O(buckets), at most once per span
+    m_origin = m_buckets.front().start;
+    m_count = 0;
+    m_sumT = m_sumV = m_sumTT = m_sumTV = 0;
+    for (const Bucket &bucket : m_buckets) {
+        addTotals(bucket, 1);
+    }
+}
+
+double RollingWindow::min() const
+{
+    return m_mins.empty() ? qQNaN() : m_mins.front().value;
+}
+
+double RollingWindow::max() const
+{
+    return m_maxes.empty() ? qQNaN() : m_maxes.front().value;
+}
+
+double RollingWindow::mean() const
+{
+    return m_count > 0 ? m_sumV / m_count : qQNaN();
+}
+
+double RollingWindow::slopePerHour() const
+{
+    if (m_count < 2) {
+        return qQNaN();
+    }
+    const double denominator = m_count * m_sumTT - m_sumT * m_sumT;
+    if (denominator <= 1e-9) {
+        return qQNaN();
+    }
+    return (m_count * m_sumTV - m_sumT * m_sumV) / denominator;
+}
+
+void RollingStats::setHistoryPath(const QString &filePath)
+{
+    m_historyPath = filePath;
+}
+
+QString RollingStats::defaultHistoryPath()
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataPath);
+    return dataPath + "/history.tsv";
+}
+
+void RollingStats::add(const QString &city, const Sample &sample)
+{
+    if (apply(city, sample)) {
+        append(city, sample);
+    }
+}
+
+bool RollingStats::apply(const QString &city, const Sample &sample)
+{
+    auto it = m_cities.find(city);
+    if (it == m_cities.end()) {
+        // Bounded: the city updated longest ago makes room
+        if (m_cities.size() >= MaxCities) {
+            auto oldest = m_cities.begin();
+            for (auto candidate = m_cities.begin(); candidate != m_cities.end(); ++candidate) {
+                if (candidate->lastTime < oldest->lastTime) {
+                    oldest = candidate;
+                }
+            }
+            m_cities.erase(oldest);
+        }
+        it = m_cities.insert(city, CityStats());
+    }
+
+    CityStats &stats = *it;
+    if (sample.time <= stats.lastTime) {
+        return false;
+    }
+    stats.hour.add(sample.time, sample.temperature);
+    stats.day.add(sample.time, sample.temperature);
+    stats.week.add(sample.time, sample.temperature);
+    stats.humidity.add(sample.time, sample.humidity);
+    if (sample.pressure > 0) {
+        stats.pressure.add(sample.time, sample.pressure);
+    }
+
+    // Weighted by elapsed time, so irregular refreshes smooth the same way
+    if (qIsNaN(stats.smoothed)) {
+        stats.smoothed = sample.temperature;
+    } else {
+        const double alpha = 1 - qExp(-double(sample.time - stats.lastTime) / SmoothingSecs);
+        stats.smoothed += alpha * (sample.temperature - stats.smoothed);
+    }
+    stats.lastTime = sample.time;
+    return true;
+}
+
+void RollingStats::append(const QString &city, const Sample &sample)
+{
+    if (m_historyPath.isEmpty()) {
+        return;
+    }
+    QFile file(m_historyPath);
+    if (!file.open(QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "Could not append to" << m_historyPath;
+        return;
+    }
+    file.write(historyLine(city, sample));
+}
+
+RollingStats::Summary RollingStats::summary(const QString &city, qint64 now)
+{
+    Summary summary;
+    auto it = m_cities.find(city);
+    if (it == m_cities.end()) {
+        return summary;
+    }
+
+    CityStats &stats = *it;
+    auto range = [now](RollingWindow &window) {
+        window.advance(now);
+        Range range;
+        range.min = window.min();
+        range.max = window.max();
+        range.mean = window.mean();
+        range.count = window.count();
+        return range;
+    };
+    summary.hour = range(stats.hour);
+    summary.day = range(stats.day);
+    summary.week = range(stats.week);
+
+    stats.pressure.advance(now);
+    stats.humidity.advance(now);
+    summary.pressureTrend = stats.pressure.slopePerHour();
+    summary.humidityTrend = stats.humidity.slopePerHour();
+    summary.smoothed = stats.smoothed;
+    summary.updatedAt = stats.lastTime;
+    return summary;
+}
+
+int RollingStats::load(const QString &filePath, qint64 now)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return 0;
+    }
+
+    const qint64 cutoff = now - HistorySecs;
+    QByteArray kept;
+    int replayed = 0;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        const QList<QByteArray> fields = line.trimmed().split('\t');
+        if (fields.size() < 5) {
+            continue;
+        }
+        bool ok = false;
+        Sample sample;
+        sample.time = fields.at(0).toLongLong(&ok);
+        if (!ok || sample.time < cutoff) {
+            continue;
+        }
+        sample.temperature = fields.at(1).toDouble();
+        sample.humidity = fields.at(2).toDouble();
+        sample.pressure = fields.at(3).toDouble();
+        if (!apply(QString::fromUtf8(fields.mid(4).join('\t')), sample)) {
+            continue;
+        }
+
+        kept += line.endsWith('\n') ? line : line + '\n';
+        ++replayed;
+    }
+    file.close();
+
+    // Only the last week is ever replayed, so that is all that is kept
+    QSaveFile out(filePath);
+    if (out.open(QIODevice::WriteOnly)) {
+        out.write(kept);
+        out.commit();
+    }
+    return replayed;
+}
@@ -0,0 +1,135 @@
+#ifndef ROLLINGSTATS_H
+#define ROLLINGSTATS_H
+
+#include <QString>
+#include <QHash>
+#include <QDateTime>
+#include <QtMath>
+#include <deque>
+
+// Min, max, mean and least-squares slope over a sliding time window.
+// Samples are grouped into fixed-width buckets, so memory is bounded by
+// span / bucket width whatever the sampling rate, and the window moves a
+// bucket at a time. Min and max come from monotonic deques and the rest
+// from running sums, so add() is O(1) amortized.
+class RollingWindow
+{
+public:
+    RollingWindow(qint64 spanSecs, qint64 bucketSecs);
+
+    // Samples older than the newest one so far are ignored
+    void add(qint64 time, double value);
+    // Drops buckets that are entirely older than now - span
+    void advance(qint64 now);
+
+    int count() const { return m_count; }
+    double min() const;     // NaN when empty
+    double max() const;
+    double mean() const;
+    // Change per hour, NaN without at least two distinct times
+    double slopePerHour() const;
+
+private:
+    // Sums with times in hours since the bucket start
+    struct Bucket {
+        qint64 start = 0;
+        int count = 0;
+        double sumT = 0;
+        double sumV = 0;
+        double sumTT = 0;
+        double sumTV = 0;
+    };
+
+    struct Extreme {
+        qint64 bucket;
+        double value;
+    };
+
+    qint64 m_span;
+    qint64 m_width;
+    qint64 m_latest;
+    std::deque<Bucket> m_buckets;
+    std::deque<Extreme> m_mins;     // increasing values, oldest first
+    std::deque<Extreme> m_maxes;    // decreasing values, oldest first
+
+    // Window totals with times in hours since m_origin
+    qint64 m_origin;
+    int m_count;
+    double m_sumT;
+    double m_sumV;
+    double m_sumTT;
+    double m_sumTV;
+
+    void addTotals(const Bucket &bucket, double sign);
+    void rebase();
+};
+
+// Live statistics per city: temperature min/max/mean over the last hour,
+// day and week, a smoothed temperature, and the pressure and humidity
+// trend over the last 3 hours. Every observation is also appended to a
+// history file, which load() replays after a restart.
+class RollingStats
+{
+public:
+    struct Sample {
+        qint64 time = 0;        // seconds since the epoch
+        double temperature = 0;
+        double humidity = 0;
+        double pressure = 0;    // hPa, 0 if unknown
+    };
+
+    struct Range {
+        double min = qQNaN();
+        double max = qQNaN();
+        double mean = qQNaN();
+        int count = 0;
+    };
+
+    struct Summary {
+        Range hour;
+        Range day;
+        Range week;
+        double smoothed = qQNaN();          // EWMA, 1 h time constant
+        double pressureTrend = qQNaN();     // hPa per hour
+        double humidityTrend = qQNaN();     // percentage points per hour
+        qint64 updatedAt = 0;
+
+        bool isValid() const { return updatedAt > 0; }
+    };
+
+    // Appends every add() here when set
+    void setHistoryPath(const QString &filePath);
+    static QString defaultHistoryPath();
+
+    void add(const QString &city, const Sample &sample);
+    Summary summary(const QString &city, qint64 now = QDateTime::currentSecsSinceEpoch());
+    int cityCount() const { return m_cities.size(); }
+
+    // Replays the last week of a history file and compacts it to just
+    // that week; returns the number of samples replayed
+    int load(const QString &filePath, qint64 now = QDateTime::currentSecsSinceEpoch());
+
+    static constexpr int MaxCities = 256;
+    static constexpr qint64 HistorySecs = 7 * 24 * 3600;
+    static constexpr qint64 SmoothingSecs = 3600;
+
+private:
+    struct CityStats {
+        RollingWindow hour { 3600, 60 };
+        RollingWindow day { 24 * 3600, 15 * 60 };
+        RollingWindow week { 7 * 24 * 3600, 3600 };
+        RollingWindow pressure { 3 * 3600, 10 * 60 };
+        RollingWindow humidity { 3 * 3600, 10 * 60 };
+        double smoothed = qQNaN();
+        qint64 lastTime = 0;
+    };
+
+    QHash<QString, CityStats> m_cities;
+    QString m_historyPath;
+
+    // False, and nothing changes, unless sample is newer than the city's last
+    bool apply(const QString &city, const Sample &sample);
+    void append(const QString &city, const Sample &sample);
+};
+
+#endif // ROLLINGSTATS_H
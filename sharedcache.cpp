@@ -0,0 +1,291 @@
+#include "sharedcache.h"
+#include <QSharedMemory>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+
+QSharedMemory *SharedCache::s_memory = nullptr;
+QAtomicInteger<quint64> SharedCache::s_hits;
+QAtomicInteger<quint64> SharedCache::s_misses;
+QAtomicInteger<quint64> SharedCache::s_writes;
+QAtomicInteger<quint64> SharedCache::s_skipped;
+QAtomicInteger<quint64> SharedCache::s_retries;
+QAtomicInteger<quint64> SharedCache::s_takeovers;
+
+namespace {
+
+const quint32 Magic = 0x57434348; // "WCCH"
+const quint32 LayoutVersion = 3;
+
+struct Header {
+    QBasicAtomicInteger<quint32> magic;     // set last by the creator
+    quint32 version;
+    quint32 slotCount;
+    quint32 slotBytes;
+};
+
+struct Slot {
+    QBasicAtomicInteger<quint32> sequence;  // odd while a writer owns the slot
+    quint32 keyHash;
+    quint32 keyLength;
+    quint32 valueLength;
+    qint64 storedAt;                        // ms since the epoch, 0 when empty
+    QBasicAtomicInteger<qint64> claimedAt;  // ms since the epoch of the last write attempt
+    quint32 checksum;                       // of key and value, catches a stalled writer's bytes
+    char key[SharedCache::MaxKeyBytes];
+    // value bytes follow
+};
+
+const int HeaderBytes = 64;
+const int MaxValueBytes = SharedCache::SlotBytes - int(sizeof(Slot));
+const int SegmentBytes = HeaderBytes + SharedCache::SlotCount * SharedCache::SlotBytes;
+
+enum ReadResult { Found, OtherKey, Torn };
+
+// FNV-1a; qHash is seeded per process, so it cannot be used here
+quint32 fnv1a(const char *data, int size, quint32 hash = 2166136261u)
+{
+    for (int i = 0; i < size; ++i) {
+        hash ^= quint8(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+quint32 hashKey(const QByteArray &key)
+{
+    return fnv1a(key.constData(), key.size());
+}
+
+quint32 checksumOf(const QByteArray &key, const char *value, int length)
+{
+    return fnv1a(value, length, fnv1a(key.constData(), key.size(), 0x9e3779b9u));
+}
+
+Slot *slotAt(char *base, quint32 index)
+{
+    return reinterpret_cast<Slot *>(base + HeaderBytes + (index % SharedCache::SlotCount) * SharedCache::SlotBytes);
+}
+
+char *valueOf(Slot *slot)
+{
+    return reinterpret_cast<char *>(slot + 1);
+}
+
+bool hasKey(const Slot *slot, quint32 hash, const QByteArray &key)
+{
+    return slot->keyHash == hash && slot->keyLength == quint32(key.size())
+        && std::memcmp(slot->key, key.constData(), key.size()) == 0;
+}
+
+// Copies the slot if it holds key. Torn when a writer got in the way,
+// including a stalled writer whose bytes landed after the slot was taken
+// over: the sequence is then even and stable, but the checksum is off.
+ReadResult readSlot(Slot *slot, quint32 hash, const QByteArray &key,
+                    QByteArray *value, qint64 *storedAt)
+{
+    const quint32 before = slot->sequence.loadAcquire();
+    if (before & 1) {
+        return Torn;
+    }
+    const bool match = hasKey(slot, hash, key);
+    quint32 checksum = 0;
+    if (match) {
+        // Clamped: the length may be half written
+        const int length = int(qMin<quint32>(slot->valueLength, quint32(MaxValueBytes)));
+        value->resize(length);
+        std::memcpy(value->data(), valueOf(slot), length);
+        *storedAt = slot->storedAt;
+        checksum = slot->checksum;
+    }
+    // The copy only counts if no writer started in the meantime
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.loadAcquire() != before) {
+        return Torn;
+    }
+    if (match && checksum != checksumOf(key, value->constData(), value->size())) {
+        return Torn;
+    }
+    return match ? Found : OtherKey;
+}
+
+QString segmentKey()
+{
+    return "qt-weather-dashboard-cache-" + qEnvironmentVariable("USER", qEnvironmentVariable("USERNAME"));
+}
+
+} // namespace
+
+bool SharedCache::enabled()
+{
+    static const bool on = qEnvironmentVariableIntValue("WEATHER_SHARED_CACHE") != 0;
+    return on;
+}
+
+char *SharedCache::attachSegment()
+{
+    s_memory = new QSharedMemory(segmentKey());
+    if (s_memory->create(SegmentBytes)) {
+        // New segments are zero-filled, so every slot starts out empty
+        Header *header = reinterpret_cast<Header *>(s_memory->data());
+        header->version = LayoutVersion;
+        header->slotCount = SlotCount;
+        header->slotBytes = SlotBytes;
+        header->magic.storeRelease(Magic);
+        qDebug() << "Created shared cache" << s_memory->key();
+    } else if (!s_memory->attach()) {
+        qWarning() << "Shared cache unavailable:" << s_memory->errorString();
+        return nullptr;
+    } else if (s_memory->size() < SegmentBytes) {
+        qWarning() << "Shared cache segment is too small, ignoring it";
+        s_memory->detach();
+        return nullptr;
+    }
+
+    // The last process to detach frees the segment
+    if (QCoreApplication::instance()) {
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &SharedCache::detachSegment);
+    }
+    return static_cast<char *>(s_memory->data());
+}
+
+void SharedCache::detachSegment()
+{
+    if (s_memory && s_memory->isAttached()) {
+        s_memory->detach();
+    }
+}
+
+char *SharedCache::segment()
+{
+    static char *base = enabled() ? attachSegment() : nullptr;
+    if (!base || !s_memory->isAttached()) {
+        return nullptr;
+    }
+    // Not ready while the creator writes the header, and never for a
+    // segment laid out by another version
+    const Header *header = reinterpret_cast<const Header *>(base);
+    if (header->magic.loadAcquire() != Magic || header->version != LayoutVersion
+        || header->slotCount != quint32(SlotCount) || header->slotBytes != quint32(SlotBytes)) {
+        return nullptr;
+    }
+    return base;
+}
+
+bool SharedCache::get(const QString &key, QByteArray *value, qint64 maxAgeSecs)
+{
+    char *base = segment();
+    if (!base) {
+        return false;
+    }
+    const QByteArray keyBytes = key.toUtf8();
+    if (keyBytes.size() > MaxKeyBytes) {
+        return false;
+    }
+    const quint32 hash = hashKey(keyBytes);
+    const qint64 oldest = QDateTime::currentMSecsSinceEpoch() - maxAgeSecs * 1000;
+
+    for (int probe = 0; probe < ProbeLength; ++probe) {
+        Slot *slot = slotAt(base, hash + probe);
+        QByteArray copy;
+        qint64 storedAt = 0;
+        ReadResult result = readSlot(slot, hash, keyBytes, &copy, &storedAt);
+        for (int attempt = 1; attempt < ReadAttempts && result == Torn; ++attempt) {
+            s_retries.fetchAndAddRelaxed(1);
+            result = readSlot(slot, hash, keyBytes, &copy, &storedAt);
+        }
+        if (result == Found) {
+            if (storedAt < oldest) {
+                break;
+            }
+            *value = copy;
+            s_hits.fetchAndAddRelaxed(1);
+            return true;
+        }
+    }
+    s_misses.fetchAndAddRelaxed(1);
+    return false;
+}
+
+void SharedCache::put(const QString &key, const QByteArray &value)
+{
+    char *base = segment();
+    if (!base || key.isEmpty()) {
+        return;
+    }
+    const QByteArray keyBytes = key.toUtf8();
+    if (keyBytes.size() > MaxKeyBytes || value.size() > MaxValueBytes) {
+        s_skipped.fetchAndAddRelaxed(1);
+        return;
+    }
+    const quint32 hash = hashKey(keyBytes);
+
+    // The same key, else an empty slot, else the oldest in the probe window.
+    // These reads race with writers; a wrong pick only costs an entry.
+    Slot *target = nullptr;
+    Slot *empty = nullptr;
+    Slot *oldest = nullptr;
+    for (int probe = 0; probe < ProbeLength && !target; ++probe) {
+        Slot *slot = slotAt(base, hash + probe);
+        if (hasKey(slot, hash, keyBytes)) {
+            target = slot;
+        } else if (slot->storedAt == 0) {
+            empty = empty ? empty : slot;
+        } else if (!oldest || slot->storedAt < oldest->storedAt) {
+            oldest = slot;
+        }
+    }
+    if (!target) {
+        target = empty ? empty : oldest;
+    }
+
+    // Writers never wait: a slot that is being written is skipped, unless
+    // its writer claimed it so long ago that it must have died. The claim
+    // time goes in before the sequence turns odd, so an odd slot never
+    // shows the time of an older write.
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const quint32 sequence = target->sequence.loadAcquire();
+    const bool stale = (sequence & 1) != 0;
+    if (stale && now - target->claimedAt.loadAcquire() < StaleWriteMs) {
+        s_skipped.fetchAndAddRelaxed(1);
+        return;
+    }
+    target->claimedAt.storeRelease(now);
+    // Odd either way: +1 from even, +2 when taking over an odd slot
+    const quint32 owned = sequence + (stale ? 2 : 1);
+    if (!target->sequence.testAndSetOrdered(sequence, owned)) {
+        s_skipped.fetchAndAddRelaxed(1);
+        return;
+    }
+    if (stale) {
+        s_takeovers.fetchAndAddRelaxed(1);
+    }
+    target->keyHash = hash;
+    target->keyLength = quint32(keyBytes.size());
+    std::memcpy(target->key, keyBytes.constData(), keyBytes.size());
+    target->valueLength = quint32(value.size());
+    std::memcpy(valueOf(target), value.constData(), value.size());
+    target->storedAt = QDateTime::currentMSecsSinceEpoch();
+    target->checksum = checksumOf(keyBytes, value.constData(), value.size());
+    // Fails only if this write stalled long enough to be taken over
+    if (!target->sequence.testAndSetOrdered(owned, owned + 1)) {
+        s_skipped.fetchAndAddRelaxed(1);
+        return;
+    }
+    s_writes.fetchAndAddRelaxed(1);
+}
+
+QJsonObject SharedCache::toJson()
+{
+    QJsonObject json;
+    json["attached"] = segment() != nullptr;
+    json["hits"] = double(s_hits.loadAcquire());
+    json["misses"] = double(s_misses.loadAcquire());
+    json["writes"] = double(s_writes.loadAcquire());
+    json["skipped"] = double(s_skipped.loadAcquire());
+    json["read_retries"] = double(s_retries.loadAcquire());
+    json["takeovers"] = double(s_takeovers.loadAcquire());
+    return json;
+}
@@ -0,0 +1,58 @@
+#ifndef SHAREDCACHE_H
+#define SHAREDCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QAtomicInteger>
+#include <QJsonObject>
+
+class QSharedMemory;
+
+// Cache of raw API responses and icons shared by every dashboard process
+// of the same user on this machine, turned on with WEATHER_SHARED_CACHE=1.
+//
+// The segment is a fixed open-addressed table. Each slot is a seqlock:
+// a writer makes the sequence odd, writes, and makes it even again;
+// readers copy the slot and retry if the sequence moved. Nobody takes a
+// lock, so a reader never blocks a writer and a writer that finds a slot
+// busy just skips the write. A slot left odd for StaleWriteMs by a writer
+// that died mid-write is taken over by the next writer; a checksum of
+// key and value makes bytes that a stalled writer lands afterwards read
+// as torn.
+// Used from the main thread; the segment is detached on aboutToQuit.
+class SharedCache
+{
+public:
+    static bool enabled();
+
+    // Value stored under key no more than maxAgeSecs ago
+    static bool get(const QString &key, QByteArray *value, qint64 maxAgeSecs);
+    // Best effort: dropped if the value is too large or the slot is busy
+    static void put(const QString &key, const QByteArray &value);
+
+    static QJsonObject toJson();
+
+    static constexpr int SlotCount = 128;
+    static constexpr int SlotBytes = 32 * 1024;
+    static constexpr int MaxKeyBytes = 120;
+    // Slots looked at for one key before giving up or evicting the oldest
+    static constexpr int ProbeLength = 8;
+    static constexpr int ReadAttempts = 4;
+    // A write takes microseconds; one running this long has died
+    static constexpr qint64 StaleWriteMs = 5000;
+
+private:
+    static QSharedMemory *s_memory;
+    static QAtomicInteger<quint64> s_hits;
+    static QAtomicInteger<quint64> s_misses;
+    static QAtomicInteger<quint64> s_writes;
+    static QAtomicInteger<quint64> s_skipped;
+    static QAtomicInteger<quint64> s_retries;
+    static QAtomicInteger<quint64> s_takeovers;
+
+    static char *segment();
+    static char *attachSegment();
+    static void detachSegment();
+};
+
+#endif // SHAREDCACHE_H
@@ -0,0 +1,211 @@
+#include "spatialindex.h"
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+void SpatialIndex::build(const QVector<Point> &points)
+{
+    m_nodes.clear();
+    m_nodes.reserve(points.size());
+    for (const Point &point : points) {
+        Node node;
+        toUnitVector(point.lat, point.lon, node.xyz);
+        node.id = point.id;
+        node.axis = 0;
+        m_nodes.append(node);
+    }
+    buildRange(0, m_nodes.size());
+}
+
+void SpatialIndex::clear()
+{
+    m_nodes.clear();
+}
+
+void SpatialIndex::buildRange(int lo, int hi)
+{
+    if (hi - lo <= 1) {
+        return;
+    }
+
+    // Split on the axis with the widest spread
+    double minValue[3] = { 2, 2, 2 };
+    double maxValue[3] = { -2, -2, -2 };
+    for (int i = lo; i < hi; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            minValue[axis] = qMin(minValue[axis], m_nodes[i].xyz[axis]);
+            maxValue[axis] = qMax(maxValue[axis], m_nodes[i].xyz[axis]);
+        }
+    }
+    int axis = 0;
+    for (int candidate = 1; candidate < 3; ++candidate) {
+        if (maxValue[candidate] - minValue[candidate] > maxValue[axis] - minValue[axis]) {
+            axis = candidate;
+        }
+    }
+
+    int mid = (lo + hi) / 2;
+    std::nth_element(m_nodes.begin() + lo, m_nodes.begin() + mid, m_nodes.begin() + hi,
+                     [axis](const Node &a, const Node &b) {
+                         return a.xyz[axis] < b.xyz[axis];
+                     });
+    m_nodes[mid].axis = axis;
+
+    buildRange(lo, mid);
+    buildRange(mid + 1, hi);
+}
+
+QVector<SpatialIndex::Neighbor> SpatialIndex::nearest(double lat, double lon, int k, double maxKm) const
+{
+    QVector<Neighbor> result;
+    if (k <= 0 || m_nodes.isEmpty()) {
+        return result;
+    }
+
+    double query[3];
+    toUnitVector(lat, lon, query);
+
+    // Max-heap of (chord², id), worst candidate on top
+    QVector<QPair<double, int>> heap;
+    heap.reserve(k + 1);
+    searchNearest(0, m_nodes.size(), query, k, heap);
+
+    std::sort_heap(heap.begin(), heap.end());
+    double limit = maxKm < 0 ? std::numeric_limits<double>::infinity() : maxKm;
+    for (const auto &candidate : heap) {
+        double km = chord2ToKm(candidate.first);
+        if (km > limit) {
+            break;
+        }
+        result.append({candidate.second, km});
+    }
+    return result;
+}
+
+QVector<SpatialIndex::Neighbor> SpatialIndex::withinRadius(double lat, double lon, double radiusKm) const
+{
+    QVector<Neighbor> result;
+    if (radiusKm < 0 || m_nodes.isEmpty()) {
+        return result;
+    }
+
+    double query[3];
+    toUnitVector(lat, lon, query);
+
+    QVector<QPair<double, int>> found;
+    searchRadius(0, m_nodes.size(), query, kmToChord2(radiusKm), found);
+
+    std::sort(found.begin(), found.end());
+    result.reserve(found.size());
+    for (const auto &candidate : found) {
+        result.append({candidate.second, chord2ToKm(candidate.first)});
+    }
+    return result;
+}
+
+void SpatialIndex::searchNearest(int lo, int hi, const double *query, int k,
+                                 QVector<QPair<double, int>> &heap) const
+{
+    if (lo >= hi) {
+        return;
+    }
+
+    int mid = (lo + hi) / 2;
+    const Node &node = m_nodes[mid];
+
+    double d2 = chord2(query, node.xyz);
+    if (heap.size() < k) {
+        heap.append(qMakePair(d2, node.id));
+        std::push_heap(heap.begin(), heap.end());
+    } else if (d2 < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = qMakePair(d2, node.id);
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    if (hi - lo == 1) {
+        return;
+    }
+
+    // Near side first, far side only if the splitting plane is closer than the worst hit
+    double delta = query[node.axis] - node.xyz[node.axis];
+    bool leftFirst = delta < 0;
+    if (leftFirst) {
+        searchNearest(lo, mid, query, k, heap);
+    } else {
+        searchNearest(mid + 1, hi, query, k, heap);
+    }
+    if (heap.size() < k || delta * delta < heap.front().first) {
+        if (leftFirst) {
+            searchNearest(mid + 1, hi, query, k, heap);
+        } else {
+            searchNearest(lo, mid, query, k, heap);
+        }
+    }
+}
+
+void SpatialIndex::searchRadius(int lo, int hi, const double *query, double maxChord2,
+                                QVector<QPair<double, int>> &found) const
+{
+    if (lo >= hi) {
+        return;
+    }
+
+    int mid = (lo + hi) / 2;
+    const Node &node = m_nodes[mid];
+
+    double d2 = chord2(query, node.xyz);
+    if (d2 <= maxChord2) {
+        found.append(qMakePair(d2, node.id));
+    }
+
+    double delta = query[node.axis] - node.xyz[node.axis];
+    if (delta < 0 || delta * delta <= maxChord2) {
+        searchRadius(lo, mid, query, maxChord2, found);
+    }
+    if (delta >= 0 || delta * delta <= maxChord2) {
+        searchRadius(mid + 1, hi, query, maxChord2, found);
+    }
+}
+
+double SpatialIndex::distanceKm(double lat1, double lon1, double lat2, double lon2)
+{
+    // Haversine
+    double dLat = qDegreesToRadians(lat2 - lat1);
+    double dLon = qDegreesToRadians(lon2 - lon1);
+    double a = qSin(dLat / 2) * qSin(dLat / 2)
+               + qCos(qDegreesToRadians(lat1)) * qCos(qDegreesToRadians(lat2))
+                     * qSin(dLon / 2) * qSin(dLon / 2);
+    return 2 * EarthRadiusKm * qAsin(qMin(1.0, qSqrt(a)));
+}
+
+void SpatialIndex::toUnitVector(double lat, double lon, double *xyz)
+{
+    double phi = qDegreesToRadians(lat);
+    double lambda = qDegreesToRadians(lon);
+    xyz[0] = qCos(phi) * qCos(lambda);
+    xyz[1] = qCos(phi) * qSin(lambda);
+    xyz[2] = qSin(phi);
+}
+
+double SpatialIndex::chord2(const double *a, const double *b)
+{
+    double dx = a[0] - b[0];
+    double dy = a[1] - b[1];
+    double dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+double SpatialIndex::chord2ToKm(double chord2)
+{
+    // Chord c subtends a central angle of 2 asin(c / 2)
+    double chord = qSqrt(chord2);
+    return 2 * EarthRadiusKm * qAsin(qMin(1.0, chord / 2));
+}
+
+double SpatialIndex::kmToChord2(double km)
+{
+    double angle = qMin(M_PI, km / EarthRadiusKm);
+    double chord = 2 * qSin(angle / 2);
+    return chord * chord;
+}
@@ -0,0 +1,59 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QVector>
+
+// Static k-d tree over lat/lon points for nearest and radius queries by
+// great-circle distance. Points are stored as 3D unit vectors, where
+// straight-line (chord) distance orders the same as distance along the
+// surface, so there are no seams at the poles or the date line.
+// Build once, query many times; rebuild to change the point set.
+class SpatialIndex
+{
+public:
+    struct Point {
+        double lat = 0;
+        double lon = 0;
+        int id = 0;         // caller's key, returned by queries
+    };
+
+    struct Neighbor {
+        int id = 0;
+        double distanceKm = 0;
+    };
+
+    static constexpr double EarthRadiusKm = 6371.0088;
+
+    void build(const QVector<Point> &points);
+    void clear();
+    int size() const { return m_nodes.size(); }
+    bool isEmpty() const { return m_nodes.isEmpty(); }
+
+    // Up to k points, closest first; maxKm < 0 means no limit
+    QVector<Neighbor> nearest(double lat, double lon, int k, double maxKm = -1) const;
+    // All points within radiusKm, closest first
+    QVector<Neighbor> withinRadius(double lat, double lon, double radiusKm) const;
+
+    static double distanceKm(double lat1, double lon1, double lat2, double lon2);
+
+private:
+    struct Node {
+        double xyz[3];
+        int id;
+        int axis;
+    };
+
+    // Implicit tree: the median of [lo, hi) sits at (lo + hi) / 2
+    QVector<Node> m_nodes;
+
+    void buildRange(int lo, int hi);
+    void searchNearest(int lo, int hi, const double *query, int k, QVector<QPair<double, int>> &heap) const;
+    void searchRadius(int lo, int hi, const double *query, double maxChord2, QVector<QPair<double, int>> &found) const;
+
+    static void toUnitVector(double lat, double lon, double *xyz);
+    static double chord2(const double *a, const double *b);
+    static double chord2ToKm(double chord2);
+    static double kmToChord2(double km);
+};
+
+#endif // SPATIALINDEX_H
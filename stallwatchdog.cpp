@@ -0,0 +1,236 @@
+#include "stallwatchdog.h"
+#include "metrics.h"
+#include <QCoreApplication>
+#include <QTimer>
+#include <QJsonArray>
+#include <QDebug>
+#include <algorithm>
+
+QThread *StallWatchdog::s_thread = nullptr;
+QTimer *StallWatchdog::s_heartbeat = nullptr;
+int StallWatchdog::s_thresholdMs = 0;
+int StallWatchdog::s_beatMs = 0;
+QAtomicInteger<int> StallWatchdog::s_stopRequested(0);
+QAtomicInteger<int> StallWatchdog::s_paused(0);
+QMutex StallWatchdog::s_pauseMutex;
+QWaitCondition StallWatchdog::s_resumed;
+QElapsedTimer StallWatchdog::s_clock;
+QAtomicInteger<qint64> StallWatchdog::s_lastBeatNs(0);
+QAtomicPointer<const char> StallWatchdog::s_activeScope(nullptr);
+Qt::HANDLE StallWatchdog::s_monitoredThread = nullptr;
+QMutex StallWatchdog::s_mutex;
+QList<StallWatchdog::Stall> StallWatchdog::s_worst;
+quint64 StallWatchdog::s_stallCount = 0;
+
+namespace {
+
+const int DefaultThresholdMs = 250;
+
+} // namespace
+
+void StallWatchdog::start(int thresholdMs)
+{
+    if (s_thread || !QCoreApplication::instance()) {
+        return;
+    }
+
+    if (thresholdMs < 0) {
+        bool ok = false;
+        thresholdMs = qEnvironmentVariable("WEATHER_STALL_MS").toInt(&ok);
+        if (!ok) {
+            thresholdMs = DefaultThresholdMs;
+        }
+    }
+    if (thresholdMs == 0) {
+        return;
+    }
+
+    s_thresholdMs = thresholdMs;
+    s_beatMs = qMax(10, thresholdMs / 2);
+    s_clock.start();
+    s_monitoredThread = QThread::currentThreadId();
+    s_lastBeatNs.storeRelease(s_clock.nsecsElapsed());
+    s_stopRequested.storeRelease(0);
+
+    // The heartbeat runs on the thread being watched
+    s_heartbeat = new QTimer(QCoreApplication::instance());
+    s_heartbeat->setInterval(s_beatMs);
+    QObject::connect(s_heartbeat, &QTimer::timeout, &StallWatchdog::beat);
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &StallWatchdog::stop);
+    s_heartbeat->start();
+
+    s_thread = QThread::create(&StallWatchdog::watch);
+    s_thread->setObjectName("StallWatchdog");
+    s_thread->start(QThread::LowPriority);
+}
+
+void StallWatchdog::stop()
+{
+    if (!s_thread) {
+        return;
+    }
+    {
+        QMutexLocker locker(&s_pauseMutex);
+        s_stopRequested.storeRelease(1);
+        s_resumed.wakeAll();
+    }
+    s_thread->wait();
+    s_paused.storeRelease(0);
+    delete s_thread;
+    s_thread = nullptr;
+
+    delete s_heartbeat;
+    s_heartbeat = nullptr;
+}
+
+bool StallWatchdog::isActive()
+{
+    return s_thread != nullptr;
+}
+
+void StallWatchdog::setPaused(bool paused)
+{
+    if (!s_thread || paused == bool(s_paused.loadAcquire())) {
+        return;
+    }
+    // A fresh beat either way, so the switch is never taken for a stall
+    beat();
+    if (paused) {
+        s_heartbeat->stop();
+        s_paused.storeRelease(1);
+    } else {
+        {
+            QMutexLocker locker(&s_pauseMutex);
+            s_paused.storeRelease(0);
+            s_resumed.wakeAll();
+        }
+        s_heartbeat->start();
+    }
+}
+
+void StallWatchdog::beat()
+{
+    s_lastBeatNs.storeRelease(s_clock.nsecsElapsed());
+}
+
+const char *StallWatchdog::enterScope(const char *name)
+{
+    if (QThread::currentThreadId() != s_monitoredThread) {
+        return nullptr;
+    }
+    return s_activeScope.fetchAndStoreOrdered(name);
+}
+
+void StallWatchdog::leaveScope(const char *previous)
+{
+    if (QThread::currentThreadId() != s_monitoredThread) {
+        return;
+    }
+    s_activeScope.storeRelease(previous);
+}
+
+void StallWatchdog::watch()
+{
+    const qint64 beatNs = qint64(s_beatMs) * 1000000;
+    const qint64 thresholdNs = qint64(s_thresholdMs) * 1000000;
+    // Several samples per threshold so short scopes still get caught
+    const int pollMs = qMax(5, s_thresholdMs / 4);
+
+    bool inStall = false;
+    qint64 stallBeatNs = 0;
+    const char *scope = nullptr;
+
+    while (!s_stopRequested.loadAcquire()) {
+        if (s_paused.loadAcquire()) {
+            // No wakeups at all while paused
+            QMutexLocker locker(&s_pauseMutex);
+            while (s_paused.loadAcquire() && !s_stopRequested.loadAcquire()) {
+                s_resumed.wait(&s_pauseMutex);
+            }
+            continue;
+        }
+        QThread::msleep(pollMs);
+
+        qint64 lastBeat = s_lastBeatNs.loadAcquire();
+        qint64 now = s_clock.nsecsElapsed();
+
+        if (!inStall) {
+            // The next beat is due beatNs after the last one
+            if (now - lastBeat > beatNs + thresholdNs) {
+                inStall = true;
+                stallBeatNs = lastBeat;
+                scope = s_activeScope.loadAcquire();
+            }
+        } else if (lastBeat != stallBeatNs) {
+            recordStall(stallBeatNs + beatNs, lastBeat - stallBeatNs - beatNs, scope);
+            inStall = false;
+            scope = nullptr;
+        } else if (!scope) {
+            // Blame the first scope seen during the stall
+            scope = s_activeScope.loadAcquire();
+        }
+    }
+}
+
+void StallWatchdog::recordStall(qint64 startNs, qint64 durationNs, const char *scope)
+{
+    Stall stall;
+    stall.startedAt = QDateTime::currentDateTimeUtc().addMSecs(-(s_clock.nsecsElapsed() - startNs) / 1000000);
+    stall.durationMs = durationNs / 1000000;
+    stall.scope = scope ? QString::fromLatin1(scope) : QString("unknown");
+
+    Metrics::record("gui.stall", durationNs / 1000);
+    Metrics::record("gui.stall." + stall.scope, durationNs / 1000);
+    qWarning().noquote() << QString("GUI stall: %1 ms in %2").arg(stall.durationMs).arg(stall.scope);
+
+    QMutexLocker locker(&s_mutex);
+    s_stallCount++;
+
+    // Keep the longest ones; replace the shortest once full
+    if (s_worst.size() < WorstStallCapacity) {
+        s_worst.append(stall);
+    } else {
+        auto shortest = std::min_element(s_worst.begin(), s_worst.end(), [](const Stall &a, const Stall &b) {
+            return a.durationMs < b.durationMs;
+        });
+        if (shortest->durationMs < stall.durationMs) {
+            *shortest = stall;
+        }
+    }
+}
+
+quint64 StallWatchdog::stallCount()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_stallCount;
+}
+
+QList<StallWatchdog::Stall> StallWatchdog::worstStalls()
+{
+    QMutexLocker locker(&s_mutex);
+    QList<Stall> stalls = s_worst;
+    locker.unlock();
+
+    std::sort(stalls.begin(), stalls.end(), [](const Stall &a, const Stall &b) {
+        return a.durationMs > b.durationMs;
+    });
+    return stalls;
+}
+
+QJsonObject StallWatchdog::toJson()
+{
+    QJsonArray worst;
+    for (const Stall &stall : worstStalls()) {
+        QJsonObject entry;
+        entry["started_at"] = stall.startedAt.toString(Qt::ISODateWithMs);
+        entry["duration_ms"] = double(stall.durationMs);
+        entry["scope"] = stall.scope;
+        worst.append(entry);
+    }
+
+    QJsonObject json;
+    json["threshold_ms"] = s_thresholdMs;
+    json["count"] = double(stallCount());
+    json["worst"] = worst;
+    return json;
+}
@@ -0,0 +1,87 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QThread>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+
+class QTimer;
+
+// Detects GUI event loop stalls. A timer on the GUI thread heartbeats; a
+// watchdog thread notices when the beats stop for longer than the
+// threshold and blames the StallScope active on the GUI thread at the time.
+// The worst stalls are kept for export.
+// WEATHER_STALL_MS sets the threshold (default 250 ms, 0 disables).
+class StallWatchdog
+{
+public:
+    struct Stall {
+        QDateTime startedAt;
+        qint64 durationMs = 0;
+        QString scope;
+    };
+
+    static const int WorstStallCapacity = 32;
+
+    // Call from the GUI thread after the application object exists
+    static void start(int thresholdMs = -1);
+    static void stop();
+    static bool isActive();
+    // While the window is hidden nobody sees a stall, so the heartbeat
+    // stops and the watchdog thread blocks until resumed
+    static void setPaused(bool paused);
+
+    static quint64 stallCount();
+    static QList<Stall> worstStalls();  // longest first
+    static QJsonObject toJson();
+
+    // Used by StallScope
+    static const char *enterScope(const char *name);
+    static void leaveScope(const char *previous);
+
+private:
+    static QThread *s_thread;
+    static QTimer *s_heartbeat;
+    static int s_thresholdMs;
+    static int s_beatMs;
+    static QAtomicInteger<int> s_stopRequested;
+    static QAtomicInteger<int> s_paused;
+    static QMutex s_pauseMutex;
+    static QWaitCondition s_resumed;
+    static QElapsedTimer s_clock;
+    static QAtomicInteger<qint64> s_lastBeatNs;
+    static QAtomicPointer<const char> s_activeScope;
+    static Qt::HANDLE s_monitoredThread;
+
+    static QMutex s_mutex;
+    static QList<Stall> s_worst;
+    static quint64 s_stallCount;
+
+    static void beat();
+    static void watch();
+    static void recordStall(qint64 startNs, qint64 durationNs, const char *scope);
+};
+
+// Names what the GUI thread is doing, for stall attribution. The name must
+// outlive the scope (use a string literal). No-op on other threads.
+class StallScope
+{
+public:
+    explicit StallScope(const char *name)
+        : m_previous(StallWatchdog::enterScope(name))
+    {
+    }
+    ~StallScope() { StallWatchdog::leaveScope(m_previous); }
+
+private:
+    const char *m_previous;
+    Q_DISABLE_COPY(StallScope)
+};
+
+#endif // STALLWATCHDOG_H
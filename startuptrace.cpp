@@ -0,0 +1,54 @@
+#include "startuptrace.h"
+#include <QDebug>
+#include <QStringList>
+
+QElapsedTimer StartupTrace::s_timer;
+qint64 StartupTrace::s_lastMarkNs = 0;
+bool StartupTrace::s_finished = false;
+QList<QPair<QString, qint64>> StartupTrace::s_phases;
+
+void StartupTrace::begin()
+{
+    s_timer.start();
+    s_lastMarkNs = 0;
+    s_finished = false;
+    s_phases.clear();
+}
+
+void StartupTrace::mark(const QString &phase)
+{
+    if (!s_timer.isValid() || s_finished) {
+        return;
+    }
+
+    qint64 now = s_timer.nsecsElapsed();
+    qint64 phaseNs = now - s_lastMarkNs;
+    s_lastMarkNs = now;
+    s_phases.append(qMakePair(phase, phaseNs));
+
+    qDebug().noquote() << QString("[startup] %1: %2 ms (total %3 ms)")
+                              .arg(phase)
+                              .arg(phaseNs / 1e6, 0, 'f', 2)
+                              .arg(now / 1e6, 0, 'f', 2);
+}
+
+void StartupTrace::finish()
+{
+    if (!s_timer.isValid() || s_finished) {
+        return;
+    }
+    s_finished = true;
+
+    QStringList parts;
+    for (const auto &phase : s_phases) {
+        parts.append(QString("%1=%2").arg(phase.first).arg(phase.second / 1e6, 0, 'f', 2));
+    }
+    qDebug().noquote() << QString("[startup] done in %1 ms: %2")
+                              .arg(s_lastMarkNs / 1e6, 0, 'f', 2)
+                              .arg(parts.join(" "));
+}
+
+qint64 StartupTrace::elapsedMs()
+{
+    return s_timer.isValid() ? s_timer.elapsed() : 0;
+}
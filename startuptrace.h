@@ -0,0 +1,28 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+// Wall time per startup phase, logged as each phase ends.
+// begin() is called first thing in main(); mark() closes the current phase.
+class StartupTrace
+{
+public:
+    static void begin();
+    static void mark(const QString &phase);
+    static void finish();
+
+    static qint64 elapsedMs();
+    static bool isFinished() { return s_finished; }
+
+private:
+    static QElapsedTimer s_timer;
+    static qint64 s_lastMarkNs;
+    static bool s_finished;
+    static QList<QPair<QString, qint64>> s_phases;
+};
+
+#endif // STARTUPTRACE_H
@@ -0,0 +1,355 @@
+#include "temperaturemapwidget.h"
+#include "memoryaccountant.h"
+#include "stallwatchdog.h"
+#include <QPainter>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QRunnable>
+#include <QThread>
+#include <QtMath>
+#include <utility>
+
+namespace {
+
+const double InfluenceKm = 300.0;
+const int MinZoom = 2;
+const int MaxZoom = 12;
+// How many levels up to look for a stand-in while a tile renders
+const int FallbackLevels = 4;
+
+class TileJob : public QRunnable
+{
+public:
+    TileJob(QObject *receiver, quint64 key, int zoom, int x, int y, quint64 generation,
+            const QVector<TemperatureTile::Observation> &observations,
+            const QSharedPointer<QAtomicInteger<int>> &zoomGeneration, int expectedZoomGeneration)
+        : m_receiver(receiver)
+        , m_key(key)
+        , m_zoom(zoom)
+        , m_x(x)
+        , m_y(y)
+        , m_generation(generation)
+        , m_observations(observations)
+        , m_zoomGeneration(zoomGeneration)
+        , m_expectedZoomGeneration(expectedZoomGeneration)
+    {
+    }
+
+    void run() override
+    {
+        // A null result with a stale generation just clears the pending flag
+        QImage image;
+        quint64 generation = 0;
+        if (m_zoomGeneration->loadAcquire() == m_expectedZoomGeneration) {
+            image = TemperatureTile::render(m_zoom, m_x, m_y, m_observations, InfluenceKm);
+            generation = m_generation;
+        }
+        QMetaObject::invokeMethod(m_receiver, "onTileRendered", Qt::QueuedConnection,
+                                  Q_ARG(quint64, m_key), Q_ARG(quint64, generation), Q_ARG(QImage, image));
+    }
+
+private:
+    QObject *m_receiver;
+    quint64 m_key;
+    int m_zoom;
+    int m_x;
+    int m_y;
+    quint64 m_generation;
+    QVector<TemperatureTile::Observation> m_observations;
+    QSharedPointer<QAtomicInteger<int>> m_zoomGeneration;
+    int m_expectedZoomGeneration;
+};
+
+} // namespace
+
+TemperatureMapWidget::TemperatureMapWidget(QWidget *parent)
+    : QWidget(parent)
+    , m_nextGeneration(1)
+    , m_zoom(5)
+    , m_dragging(false)
+    , m_zoomGeneration(new QAtomicInteger<int>(0))
+    , m_cacheId(0)
+{
+    setMouseTracking(false);
+    setCursor(Qt::OpenHandCursor);
+    m_center = TemperatureTile::project(0, 0, m_zoom);
+
+    // Leave a core for the GUI thread
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    m_cacheId = MemoryAccountant::instance()->registerCache(
+        "map.tiles", 1.0,
+        [this](const QString &key) {
+            return qint64(m_tiles.value(key.toULongLong()).image.sizeInBytes());
+        },
+        [this](const QString &key) {
+            m_tiles.remove(key.toULongLong());
+            return true;
+        });
+}
+
+TemperatureMapWidget::~TemperatureMapWidget()
+{
+    // Queued jobs are skipped; running ones finish before we go away
+    m_zoomGeneration->fetchAndAddOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+    MemoryAccountant::instance()->unregisterCache(m_cacheId);
+}
+
+QSize TemperatureMapWidget::sizeHint() const
+{
+    return QSize(400, 300);
+}
+
+void TemperatureMapWidget::setObservations(const QVector<MapPoint> &points)
+{
+    QHash<QString, MapPoint> updated;
+    for (const MapPoint &point : points) {
+        updated.insert(point.key, point);
+
+        // Only tiles within reach of a changed point are redrawn
+        auto old = m_points.constFind(point.key);
+        if (old == m_points.constEnd()) {
+            invalidateAround(point.lat, point.lon);
+        } else if (old->lat != point.lat || old->lon != point.lon || old->temperature != point.temperature) {
+            invalidateAround(old->lat, old->lon);
+            if (old->lat != point.lat || old->lon != point.lon) {
+                invalidateAround(point.lat, point.lon);
+            }
+        }
+    }
+    for (auto old = m_points.constBegin(); old != m_points.constEnd(); ++old) {
+        if (!updated.contains(old.key())) {
+            invalidateAround(old->lat, old->lon);
+        }
+    }
+    m_points = updated;
+
+    m_observations.clear();
+    m_observations.reserve(m_points.size());
+    for (const MapPoint &point : std::as_const(m_points)) {
+        m_observations.append({point.lat, point.lon, point.temperature});
+    }
+
+    update();
+}
+
+void TemperatureMapWidget::centerOn(double lat, double lon)
+{
+    m_center = TemperatureTile::project(lat, lon, m_zoom);
+    update();
+}
+
+void TemperatureMapWidget::setZoom(int zoom)
+{
+    zoom = qBound(MinZoom, zoom, MaxZoom);
+    if (zoom == m_zoom) {
+        return;
+    }
+    m_center *= qPow(2.0, zoom - m_zoom);
+    m_zoom = zoom;
+    m_zoomGeneration->fetchAndAddOrdered(1);
+    update();
+}
+
+void TemperatureMapWidget::invalidateAround(double lat, double lon)
+{
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+        int zoom, x, y;
+        tileFromKey(it.key(), &zoom, &x, &y);
+        if (TemperatureTile::influences(TemperatureTile::bounds(zoom, x, y), lat, lon, InfluenceKm)) {
+            // The old image stays on screen until the new one is ready
+            it->generation = m_nextGeneration++;
+        }
+    }
+}
+
+void TemperatureMapWidget::requestTile(int zoom, int x, int y)
+{
+    quint64 key = tileKey(zoom, x, y);
+    Tile &tile = m_tiles[key];
+    if (tile.generation == 0) {
+        tile.generation = m_nextGeneration++;
+    }
+    if (tile.pending || tile.isReady()) {
+        return;
+    }
+    tile.pending = true;
+
+    m_pool.start(new TileJob(this, key, zoom, x, y, tile.generation, m_observations,
+                             m_zoomGeneration, m_zoomGeneration->loadAcquire()));
+}
+
+void TemperatureMapWidget::onTileRendered(quint64 key, quint64 generation, const QImage &image)
+{
+    auto it = m_tiles.find(key);
+    if (it == m_tiles.end()) {
+        return;
+    }
+    it->pending = false;
+
+    // Skipped or outdated: visible tiles are requested again on the next paint
+    if (generation == 0 || generation != it->generation) {
+        update();
+        return;
+    }
+
+    it->image = image;
+    it->imageGeneration = generation;
+    MemoryAccountant::instance()->charge(m_cacheId, QString::number(key));
+    update();
+}
+
+void TemperatureMapWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    StallScope stallScope("render");
+
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().color(QPalette::Base));
+
+    const int tileCount = 1 << m_zoom;
+    const int tileSize = TemperatureTile::TileSize;
+    const QPointF topLeft = m_center - QPointF(width() / 2.0, height() / 2.0);
+
+    int firstX = qFloor(topLeft.x() / tileSize);
+    int lastX = qFloor((topLeft.x() + width()) / tileSize);
+    int firstY = qMax(0, qFloor(topLeft.y() / tileSize));
+    int lastY = qMin(tileCount - 1, qFloor((topLeft.y() + height()) / tileSize));
+
+    QList<QPoint> missing;
+    for (int ty = firstY; ty <= lastY; ++ty) {
+        for (int tx = firstX; tx <= lastX; ++tx) {
+            int x = ((tx % tileCount) + tileCount) % tileCount;
+            QRectF target(tx * tileSize - topLeft.x(), ty * tileSize - topLeft.y(), tileSize, tileSize);
+
+            auto it = m_tiles.constFind(tileKey(m_zoom, x, ty));
+            bool hasImage = it != m_tiles.constEnd() && it->imageGeneration != 0;
+            if (hasImage) {
+                if (!it->image.isNull()) {
+                    painter.drawImage(target, it->image);
+                    MemoryAccountant::instance()->touch(m_cacheId, QString::number(it.key()));
+                }
+            } else {
+                drawFallback(painter, m_zoom, x, ty, target);
+            }
+
+            if (it == m_tiles.constEnd() || (!it->isReady() && !it->pending)) {
+                missing.append(QPoint(x, ty));
+            }
+        }
+    }
+
+    // Requested after drawing, inserting may rehash m_tiles
+    for (const QPoint &tile : std::as_const(missing)) {
+        requestTile(m_zoom, tile.x(), tile.y());
+    }
+
+    // Observation markers, wrapped to the copy nearest the view
+    const double world = double(tileSize) * tileCount;
+    painter.setRenderHint(QPainter::Antialiasing);
+    for (const MapPoint &point : std::as_const(m_points)) {
+        QPointF position = TemperatureTile::project(point.lat, point.lon, m_zoom) - topLeft;
+        position.rx() -= qRound((position.x() - width() / 2.0) / world) * world;
+
+        painter.setPen(QPen(Qt::black, 1));
+        painter.setBrush(QColor::fromRgba(qUnpremultiply(TemperatureTile::color(point.temperature))));
+        painter.drawEllipse(position, 4, 4);
+        painter.drawText(position + QPointF(7, 4),
+                         QString("%1 %2°").arg(point.label).arg(qRound(point.temperature)));
+    }
+
+    drawLegend(painter);
+}
+
+bool TemperatureMapWidget::drawFallback(QPainter &painter, int zoom, int x, int y, const QRectF &target)
+{
+    // Scale up the closest ready ancestor
+    for (int level = 1; level <= FallbackLevels && zoom - level >= 0; ++level) {
+        auto it = m_tiles.constFind(tileKey(zoom - level, x >> level, y >> level));
+        if (it == m_tiles.constEnd() || it->imageGeneration == 0) {
+            continue;
+        }
+        if (!it->image.isNull()) {
+            double size = double(TemperatureTile::TileSize) / (1 << level);
+            QRectF source((x - ((x >> level) << level)) * size, (y - ((y >> level) << level)) * size, size, size);
+            painter.drawImage(target, it->image, source);
+        }
+        return true;
+    }
+    return false;
+}
+
+void TemperatureMapWidget::drawLegend(QPainter &painter)
+{
+    const QRect bar(10, height() - 26, 150, 8);
+    for (int i = 0; i < bar.width(); ++i) {
+        float temperature = -30.0f + 75.0f * i / (bar.width() - 1);
+        painter.setPen(QColor::fromRgba(qUnpremultiply(TemperatureTile::color(temperature))));
+        painter.drawLine(bar.left() + i, bar.top(), bar.left() + i, bar.bottom());
+    }
+    painter.setPen(palette().color(QPalette::Text));
+    painter.drawText(QPoint(bar.left(), bar.bottom() + 14), "-30°");
+    painter.drawText(QPoint(bar.right() - 22, bar.bottom() + 14), "45°");
+}
+
+void TemperatureMapWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = true;
+        m_dragStart = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void TemperatureMapWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging) {
+        return;
+    }
+    m_center -= event->pos() - m_dragStart;
+    m_dragStart = event->pos();
+
+    double world = double(TemperatureTile::TileSize) * (1 << m_zoom);
+    m_center.setY(qBound(0.0, m_center.y(), world));
+    update();
+}
+
+void TemperatureMapWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = false;
+        setCursor(Qt::OpenHandCursor);
+    }
+}
+
+void TemperatureMapWidget::wheelEvent(QWheelEvent *event)
+{
+    int steps = event->angleDelta().y() / 120;
+    int zoom = qBound(MinZoom, m_zoom + steps, MaxZoom);
+    if (zoom == m_zoom) {
+        return;
+    }
+
+    // Keep the point under the cursor in place
+    QPointF offset = event->position() - QPointF(width() / 2.0, height() / 2.0);
+    QPointF anchor = m_center + offset;
+    anchor *= qPow(2.0, zoom - m_zoom);
+    m_center = anchor - offset;
+    m_zoom = zoom;
+    m_zoomGeneration->fetchAndAddOrdered(1);
+    update();
+}
+
+quint64 TemperatureMapWidget::tileKey(int zoom, int x, int y)
+{
+    return (quint64(zoom) << 48) | (quint64(quint32(x) & 0xFFFFFF) << 24) | quint64(quint32(y) & 0xFFFFFF);
+}
+
+void TemperatureMapWidget::tileFromKey(quint64 key, int *zoom, int *x, int *y)
+{
+    *zoom = int(key >> 48);
+    *x = int((key >> 24) & 0xFFFFFF);
+    *y = int(key & 0xFFFFFF);
+}
@@ -0,0 +1,87 @@
+#ifndef TEMPERATUREMAPWIDGET_H
+#define TEMPERATUREMAPWIDGET_H
+
+#include <QWidget>
+#include <QHash>
+#include <QImage>
+#include <QThreadPool>
+#include <QPointF>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QAtomicInteger>
+#include "temperaturetile.h"
+
+// Slippy map of interpolated temperature over the tracked locations.
+// Tiles render on worker threads and are cached by zoom/x/y; until a tile
+// is ready the parent tile is drawn scaled up, so panning and zooming stay
+// smooth while the view fills in. A changed observation only invalidates
+// the tiles within its influence radius.
+class TemperatureMapWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    struct MapPoint {
+        QString key;
+        QString label;
+        double lat = 0;
+        double lon = 0;
+        float temperature = 0;
+    };
+
+    explicit TemperatureMapWidget(QWidget *parent = nullptr);
+    ~TemperatureMapWidget();
+
+    void setObservations(const QVector<MapPoint> &points);
+    void centerOn(double lat, double lon);
+    void setZoom(int zoom);
+    int zoom() const { return m_zoom; }
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private slots:
+    void onTileRendered(quint64 key, quint64 generation, const QImage &image);
+
+private:
+    struct Tile {
+        QImage image;               // may be from an older generation
+        quint64 generation = 0;     // generation the image should match
+        quint64 imageGeneration = 0;
+        bool pending = false;
+
+        // Null image when ready means nothing to draw
+        bool isReady() const { return imageGeneration == generation; }
+    };
+
+    QHash<quint64, Tile> m_tiles;
+    QHash<QString, MapPoint> m_points;
+    QVector<TemperatureTile::Observation> m_observations;
+    quint64 m_nextGeneration;
+
+    int m_zoom;
+    QPointF m_center;               // world pixels at m_zoom
+    QPoint m_dragStart;
+    bool m_dragging;
+
+    QThreadPool m_pool;
+    // Bumped on zoom so queued jobs for the old level are skipped
+    QSharedPointer<QAtomicInteger<int>> m_zoomGeneration;
+    int m_cacheId;
+
+    void requestTile(int zoom, int x, int y);
+    bool drawFallback(QPainter &painter, int zoom, int x, int y, const QRectF &target);
+    void invalidateAround(double lat, double lon);
+    void drawLegend(QPainter &painter);
+
+    static quint64 tileKey(int zoom, int x, int y);
+    static void tileFromKey(quint64 key, int *zoom, int *x, int *y);
+};
+
+#endif // TEMPERATUREMAPWIDGET_H
@@ -0,0 +1,195 @@
+#include "temperaturetile.h"
+#include <QColor>
+#include <QtMath>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const double KmPerDegree = 111.32;
+
+// Color ramp stops from -30 °C to 45 °C
+const float RampMin = -30.0f;
+const float RampMax = 45.0f;
+const int RampSize = 256;
+
+struct RampStop {
+    float temperature;
+    QRgb color;
+};
+
+const QRgb *colorRamp()
+{
+    static const std::vector<QRgb> ramp = []() {
+        const RampStop stops[] = {
+            { -30.0f, qRgb(94, 40, 153) },
+            { -15.0f, qRgb(49, 99, 206) },
+            { 0.0f, qRgb(99, 190, 230) },
+            { 10.0f, qRgb(120, 200, 120) },
+            { 20.0f, qRgb(245, 220, 80) },
+            { 30.0f, qRgb(240, 130, 40) },
+            { 45.0f, qRgb(190, 30, 40) },
+        };
+        const int stopCount = int(sizeof(stops) / sizeof(stops[0]));
+
+        std::vector<QRgb> colors(RampSize);
+        for (int i = 0; i < RampSize; ++i) {
+            float t = RampMin + (RampMax - RampMin) * i / (RampSize - 1);
+            int upper = 1;
+            while (upper < stopCount - 1 && stops[upper].temperature < t) {
+                upper++;
+            }
+            const RampStop &a = stops[upper - 1];
+            const RampStop &b = stops[upper];
+            float f = qBound(0.0f, (t - a.temperature) / (b.temperature - a.temperature), 1.0f);
+            colors[i] = qRgb(qRound(qRed(a.color) + f * (qRed(b.color) - qRed(a.color))),
+                             qRound(qGreen(a.color) + f * (qGreen(b.color) - qGreen(a.color))),
+                             qRound(qBlue(a.color) + f * (qBlue(b.color) - qBlue(a.color))));
+        }
+        return colors;
+    }();
+    return ramp.data();
+}
+
+} // namespace
+
+QRgb TemperatureTile::color(float temperature, float alpha)
+{
+    int index = qBound(0, int((temperature - RampMin) * (RampSize - 1) / (RampMax - RampMin) + 0.5f), RampSize - 1);
+    QRgb rgb = colorRamp()[index];
+    return qPremultiply(qRgba(qRed(rgb), qGreen(rgb), qBlue(rgb), qBound(0, int(alpha * 255), 255)));
+}
+
+QPointF TemperatureTile::project(double lat, double lon, int zoom)
+{
+    double world = double(TileSize) * (1 << zoom);
+    double phi = qDegreesToRadians(qBound(-MaxLatitude, lat, MaxLatitude));
+    double x = (lon + 180.0) / 360.0 * world;
+    double y = (1.0 - qLn(qTan(phi) + 1.0 / qCos(phi)) / M_PI) / 2.0 * world;
+    return QPointF(x, y);
+}
+
+void TemperatureTile::unproject(double px, double py, int zoom, double *lat, double *lon)
+{
+    double world = double(TileSize) * (1 << zoom);
+    *lon = px / world * 360.0 - 180.0;
+    double n = M_PI - 2.0 * M_PI * py / world;
+    *lat = qRadiansToDegrees(qAtan(std::sinh(n)));
+}
+
+QRectF TemperatureTile::bounds(int zoom, int x, int y)
+{
+    double north, south, west, east;
+    unproject(double(x) * TileSize, double(y) * TileSize, zoom, &north, &west);
+    unproject(double(x + 1) * TileSize, double(y + 1) * TileSize, zoom, &south, &east);
+    return QRectF(west, south, east - west, north - south);
+}
+
+bool TemperatureTile::influences(const QRectF &bounds, double lat, double lon, double influenceKm)
+{
+    double radiusLat = influenceKm / KmPerDegree;
+    double maxAbsLat = qMin(MaxLatitude, qMax(qAbs(bounds.top()), qAbs(bounds.bottom())) + radiusLat);
+    double radiusLon = radiusLat / qMax(0.05, qCos(qDegreesToRadians(maxAbsLat)));
+
+    if (lat < bounds.top() - radiusLat || lat > bounds.bottom() + radiusLat) {
+        return false;
+    }
+    // Also match copies of the point across the antimeridian
+    for (double shift : { -360.0, 0.0, 360.0 }) {
+        double shifted = lon + shift;
+        if (shifted >= bounds.left() - radiusLon && shifted <= bounds.right() + radiusLon) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QImage TemperatureTile::render(int zoom, int x, int y, const QVector<Observation> &observations, double influenceKm)
+{
+    // Only observations that can reach this tile, as flat arrays
+    QRectF box = bounds(zoom, x, y);
+    double radiusLat = influenceKm / KmPerDegree;
+    double maxAbsLat = qMin(MaxLatitude, qMax(qAbs(box.top()), qAbs(box.bottom())) + radiusLat);
+    double radiusLon = radiusLat / qMax(0.05, qCos(qDegreesToRadians(maxAbsLat)));
+
+    std::vector<float> obsLat;
+    std::vector<float> obsLon;
+    std::vector<float> obsTemp;
+    for (const Observation &observation : observations) {
+        if (observation.lat < box.top() - radiusLat || observation.lat > box.bottom() + radiusLat) {
+            continue;
+        }
+        for (double shift : { -360.0, 0.0, 360.0 }) {
+            double lon = observation.lon + shift;
+            if (lon >= box.left() - radiusLon && lon <= box.right() + radiusLon) {
+                obsLat.push_back(float(observation.lat));
+                obsLon.push_back(float(lon));
+                obsTemp.push_back(observation.temperature);
+            }
+        }
+    }
+    if (obsLat.empty()) {
+        return QImage();
+    }
+
+    QImage image(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    // Distances in degrees, longitude scaled by cos(lat) per row
+    const float radius2 = float(radiusLat * radiusLat);
+    const float invRadius2 = 1.0f / radius2;
+    const int count = int(obsLat.size());
+
+    float pixelLon[TileSize];
+    for (int px = 0; px < TileSize; ++px) {
+        double lat, lon;
+        unproject(double(x) * TileSize + px + 0.5, 0, zoom, &lat, &lon);
+        pixelLon[px] = float(lon);
+    }
+
+    float weightSum[TileSize];
+    float weightedTemp[TileSize];
+    float nearest2[TileSize];
+
+    for (int py = 0; py < TileSize; ++py) {
+        double rowLat, rowLon;
+        unproject(0, double(y) * TileSize + py + 0.5, zoom, &rowLat, &rowLon);
+        const float lat = float(rowLat);
+        const float cosLat = float(qCos(qDegreesToRadians(rowLat)));
+
+        std::fill(weightSum, weightSum + TileSize, 0.0f);
+        std::fill(weightedTemp, weightedTemp + TileSize, 0.0f);
+        std::fill(nearest2, nearest2 + TileSize, radius2);
+
+        // Observation outer, pixels inner: the inner loop has no
+        // cross-iteration dependency, so the compiler vectorizes it
+        for (int i = 0; i < count; ++i) {
+            const float dy = lat - obsLat[i];
+            const float dy2 = dy * dy;
+            if (dy2 >= radius2) {
+                continue;
+            }
+            const float oLon = obsLon[i];
+            const float temp = obsTemp[i];
+            for (int px = 0; px < TileSize; ++px) {
+                const float dx = (pixelLon[px] - oLon) * cosLat;
+                const float d2 = dx * dx + dy2 + 1e-6f;
+                const float w = std::max(0.0f, 1.0f / d2 - invRadius2);
+                weightSum[px] += w;
+                weightedTemp[px] += w * temp;
+                nearest2[px] = std::min(nearest2[px], d2);
+            }
+        }
+
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(py));
+        for (int px = 0; px < TileSize; ++px) {
+            if (weightSum[px] > 0.0f) {
+                // Fades out towards the edge of the nearest observation's reach
+                float alpha = 0.75f * (1.0f - nearest2[px] * invRadius2);
+                line[px] = color(weightedTemp[px] / weightSum[px], alpha);
+            }
+        }
+    }
+
+    return image;
+}
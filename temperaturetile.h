@@ -0,0 +1,39 @@
+#ifndef TEMPERATURETILE_H
+#define TEMPERATURETILE_H
+
+#include <QImage>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+// Web Mercator tile math and the temperature field renderer. Tiles are
+// TileSize pixels square; zoom z has 2^z by 2^z tiles.
+class TemperatureTile
+{
+public:
+    struct Observation {
+        double lat = 0;
+        double lon = 0;
+        float temperature = 0;
+    };
+
+    static const int TileSize = 256;
+    static constexpr double MaxLatitude = 85.05112878;
+
+    // Inverse-distance-weighted field over the observations within
+    // influenceKm, transparent where there are none. Returns a null image
+    // if no observation reaches the tile. Thread-safe.
+    static QImage render(int zoom, int x, int y, const QVector<Observation> &observations, double influenceKm);
+
+    // World pixel coordinates at a zoom level
+    static QPointF project(double lat, double lon, int zoom);
+    static void unproject(double px, double py, int zoom, double *lat, double *lon);
+
+    // Lon/lat box: x = west, y = south, width/height in degrees
+    static QRectF bounds(int zoom, int x, int y);
+    static bool influences(const QRectF &bounds, double lat, double lon, double influenceKm);
+
+    static QRgb color(float temperature, float alpha = 1.0f);
+};
+
+#endif // TEMPERATURETILE_H
@@ -0,0 +1,360 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QNetworkReply>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QDir>
+#include <QHash>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+QAtomicInteger<int> Tracer::s_enabled(0);
+
+namespace {
+
+struct Event {
+    const char *name;
+    qint64 startNs;
+    qint64 durationNs;
+    quint64 id;
+    quint64 flow;
+    char phase;     // Chrome phase: X, i, b or e
+};
+
+// Only its own thread writes to a ring. head counts every event ever
+// recorded; the exporter reads behind it.
+struct Ring {
+    Event events[Tracer::RingCapacity];
+    QAtomicInteger<quint64> head;
+    int tid = 0;
+    QString threadName;
+};
+
+QElapsedTimer traceClock;
+// Start of the current recording; older events are left out of exports
+qint64 recordingStartNs = 0;
+QAtomicInteger<quint64> nextFlow(1);
+QMutex ringsMutex;
+// Never freed, so events of threads that have exited can still be exported
+std::vector<Ring *> rings;
+
+thread_local Ring *threadRing = nullptr;
+thread_local bool threadRefused = false;
+thread_local quint64 threadFlow = 0;
+
+Ring *ringForThread()
+{
+    if (threadRing || threadRefused) {
+        return threadRing;
+    }
+
+    // Once per thread
+    QMutexLocker locker(&ringsMutex);
+    if (int(rings.size()) >= Tracer::MaxThreads) {
+        threadRefused = true;
+        return nullptr;
+    }
+    Ring *ring = new Ring;
+    ring->tid = int(rings.size()) + 1;
+    QThread *thread = QThread::currentThread();
+    ring->threadName = thread->objectName();
+    if (ring->threadName.isEmpty()) {
+        const bool isMain = QCoreApplication::instance() && QCoreApplication::instance()->thread() == thread;
+        ring->threadName = isMain ? QString("main") : QString("thread %1").arg(ring->tid);
+    }
+    rings.push_back(ring);
+    threadRing = ring;
+    return ring;
+}
+
+// Events still intact after the copy, oldest first
+std::vector<Event> copyRing(Ring *ring)
+{
+    const quint64 head = ring->head.loadAcquire();
+    const quint64 first = head > quint64(Tracer::RingCapacity) ? head - Tracer::RingCapacity : 0;
+    std::vector<Event> events;
+    events.reserve(head - first);
+    for (quint64 i = first; i < head; ++i) {
+        events.push_back(ring->events[i % Tracer::RingCapacity]);
+    }
+
+    // Slots the writer got to since may be torn; they are dropped
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const quint64 now = ring->head.loadAcquire();
+    const quint64 valid = now + 1 > quint64(Tracer::RingCapacity) ? now + 1 - Tracer::RingCapacity : 0;
+    if (valid > first) {
+        events.erase(events.begin(), events.begin() + qMin<quint64>(valid - first, events.size()));
+    }
+    return events;
+}
+
+QJsonObject traceEvent(const Event &event, qint64 pid, int tid)
+{
+    QJsonObject json;
+    json["name"] = QString::fromUtf8(event.name);
+    json["ph"] = QString(QLatin1Char(event.phase));
+    json["ts"] = event.startNs / 1000.0;
+    json["pid"] = double(pid);
+    json["tid"] = tid;
+    if (event.phase == 'X') {
+        json["cat"] = "app";
+        json["dur"] = event.durationNs / 1000.0;
+    } else if (event.phase == 'i') {
+        json["cat"] = "app";
+        json["s"] = "t";
+    } else {
+        json["cat"] = "net";
+        json["id"] = QString::number(event.id, 16);
+    }
+    if (event.flow != 0) {
+        json["args"] = QJsonObject{{"flow", double(event.flow)}};
+    }
+    return json;
+}
+
+} // namespace
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled && !traceClock.isValid()) {
+        traceClock.start();
+    }
+    if (enabled && !isEnabled()) {
+        recordingStartNs = traceClock.nsecsElapsed();
+    }
+    s_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+void Tracer::enableFromEnvironment()
+{
+    if (qEnvironmentVariableIntValue("WEATHER_TRACE") == 0 || !QCoreApplication::instance()) {
+        return;
+    }
+    setEnabled(true);
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, []() {
+        if (!isEnabled()) {
+            return;
+        }
+        QString filePath = qEnvironmentVariable("WEATHER_TRACE_FILE");
+        if (filePath.isEmpty()) {
+            filePath = defaultFilePath();
+        }
+        if (writeTo(filePath)) {
+            qDebug() << "Trace written to" << filePath;
+        }
+    });
+}
+
+quint64 Tracer::newFlow()
+{
+    return isEnabled() ? nextFlow.fetchAndAddRelaxed(1) : 0;
+}
+
+quint64 Tracer::currentFlow()
+{
+    return threadFlow;
+}
+
+quint64 Tracer::currentOrNewFlow()
+{
+    return threadFlow != 0 ? threadFlow : newFlow();
+}
+
+void Tracer::setCurrentFlow(quint64 flow)
+{
+    threadFlow = flow;
+}
+
+qint64 Tracer::nowNs()
+{
+    return traceClock.isValid() ? traceClock.nsecsElapsed() : 0;
+}
+
+void Tracer::record(char phase, const char *name, qint64 startNs, qint64 durationNs,
+                    quint64 id, quint64 flow)
+{
+    Ring *ring = ringForThread();
+    if (!ring) {
+        return;
+    }
+    const quint64 head = ring->head.loadAcquire();
+    // Keeps the previous head store ahead of this slot's contents, which
+    // is what the exporter's torn-slot check relies on
+    std::atomic_thread_fence(std::memory_order_release);
+    Event &event = ring->events[head % RingCapacity];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    event.id = id;
+    event.flow = flow;
+    event.phase = phase;
+    ring->head.storeRelease(head + 1);
+}
+
+void Tracer::complete(const char *name, qint64 startNs, quint64 flow)
+{
+    if (isEnabled()) {
+        record('X', name, startNs, nowNs() - startNs, 0, flow);
+    }
+}
+
+void Tracer::instant(const char *name, quint64 flow)
+{
+    if (isEnabled()) {
+        record('i', name, nowNs(), 0, 0, flow);
+    }
+}
+
+void Tracer::asyncBegin(const char *name, quint64 id, quint64 flow)
+{
+    if (isEnabled()) {
+        record('b', name, nowNs(), 0, id, flow);
+    }
+}
+
+void Tracer::asyncEnd(const char *name, quint64 id, quint64 flow)
+{
+    if (isEnabled()) {
+        record('e', name, nowNs(), 0, id, flow);
+    }
+}
+
+void Tracer::traceReply(QNetworkReply *reply, const char *name, quint64 flow)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    if (flow == 0) {
+        flow = currentOrNewFlow();
+    }
+    reply->setProperty("traceFlow", flow);
+    reply->setProperty("traceName", qulonglong(quintptr(name)));
+    asyncBegin(name, quintptr(reply), flow);
+
+    // For replies whose handler does not call endReply()
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply]() {
+        endReply(reply);
+    });
+}
+
+quint64 Tracer::endReply(QNetworkReply *reply)
+{
+    if (!isEnabled() || !reply) {
+        return 0;
+    }
+    const quint64 flow = reply->property("traceFlow").toULongLong();
+    const quintptr name = quintptr(reply->property("traceName").toULongLong());
+    if (name != 0) {
+        reply->setProperty("traceName", QVariant());
+        asyncEnd(reinterpret_cast<const char *>(name), quintptr(reply), flow);
+    }
+    return flow;
+}
+
+quint64 Tracer::flowOf(const QObject *object)
+{
+    return isEnabled() && object ? object->property("traceFlow").toULongLong() : 0;
+}
+
+QByteArray Tracer::toJson()
+{
+    std::vector<Ring *> threads;
+    {
+        QMutexLocker locker(&ringsMutex);
+        threads = rings;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    // Spans per flow, to draw arrows between them
+    struct FlowPoint {
+        qint64 startNs;
+        int tid;
+    };
+    QHash<quint64, std::vector<FlowPoint>> flows;
+
+    for (Ring *ring : threads) {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = double(pid);
+        threadName["tid"] = ring->tid;
+        threadName["args"] = QJsonObject{{"name", ring->threadName}};
+        events.append(threadName);
+
+        for (const Event &event : copyRing(ring)) {
+            if (event.startNs < recordingStartNs) {
+                continue;
+            }
+            events.append(traceEvent(event, pid, ring->tid));
+            if (event.phase == 'X' && event.flow != 0) {
+                flows[event.flow].push_back({ event.startNs, ring->tid });
+            }
+        }
+    }
+
+    // Each flow is a chain of arrows from span to span in time order
+    for (auto it = flows.begin(); it != flows.end(); ++it) {
+        std::vector<FlowPoint> &points = it.value();
+        if (points.size() < 2) {
+            continue;
+        }
+        std::sort(points.begin(), points.end(), [](const FlowPoint &a, const FlowPoint &b) {
+            return a.startNs < b.startNs;
+        });
+        for (size_t i = 0; i < points.size(); ++i) {
+            QJsonObject json;
+            json["name"] = "flow";
+            json["cat"] = "flow";
+            json["ph"] = i == 0 ? "s" : (i + 1 == points.size() ? "f" : "t");
+            json["bp"] = "e";
+            json["id"] = double(it.key());
+            json["ts"] = points[i].startNs / 1000.0;
+            json["pid"] = double(pid);
+            json["tid"] = points[i].tid;
+            events.append(json);
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::writeTo(const QString &filePath)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(toJson()) == -1 || !file.commit()) {
+        qWarning() << "Could not write trace to" << filePath;
+        return false;
+    }
+    return true;
+}
+
+QString Tracer::defaultFilePath()
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataPath);
+    return dataPath + "/trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss") + ".json";
+}
+
+void TraceSpan::begin(const char *name)
+{
+    m_name = name;
+    if (m_flow == 0) {
+        m_flow = Tracer::currentFlow();
+    }
+    m_startNs = Tracer::nowNs();
+}
@@ -0,0 +1,129 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QAtomicInteger>
+
+class QObject;
+class QNetworkReply;
+
+// Timeline of what the app did, exported as Chrome trace JSON for
+// chrome://tracing or ui.perfetto.dev. Spans go into a lock-free ring
+// buffer per thread that keeps the last RingCapacity events. A flow ID
+// links the spans of one user action: a city click, its network
+// requests, their parsing and the repaint that shows the result.
+//
+// Off unless WEATHER_TRACE=1 or setEnabled(true); while off, a span
+// costs one branch.
+class Tracer
+{
+public:
+    static bool isEnabled() { return s_enabled.loadAcquire() != 0; }
+    // Call from the main thread. Enabling again starts a new trace;
+    // events from earlier recordings are not exported.
+    static void setEnabled(bool enabled);
+    // WEATHER_TRACE=1 enables tracing and writes the trace on exit, to
+    // WEATHER_TRACE_FILE or defaultFilePath(), unless it was stopped
+    static void enableFromEnvironment();
+
+    // New flow ID, 0 while disabled
+    static quint64 newFlow();
+    // Flow of the work running on this thread, 0 if none
+    static quint64 currentFlow();
+    static quint64 currentOrNewFlow();
+    static void setCurrentFlow(quint64 flow);
+
+    static qint64 nowNs();
+
+    // Names must outlive the trace (use string literals)
+    static void complete(const char *name, qint64 startNs, quint64 flow);
+    static void instant(const char *name, quint64 flow);
+    static void asyncBegin(const char *name, quint64 id, quint64 flow);
+    static void asyncEnd(const char *name, quint64 id, quint64 flow);
+
+    // Traces a reply as an async span in flow (or the current flow, or a
+    // new one). The span ends at endReply(), or when the reply finishes.
+    static void traceReply(QNetworkReply *reply, const char *name, quint64 flow = 0);
+    // Ends the reply's span and returns its flow; for finished() handlers
+    static quint64 endReply(QNetworkReply *reply);
+    // Flow an object was tagged with by traceReply(), 0 if none
+    static quint64 flowOf(const QObject *object);
+
+    static QByteArray toJson();
+    static bool writeTo(const QString &filePath);
+    static QString defaultFilePath();
+
+    static constexpr int RingCapacity = 4096;
+    // Threads beyond this record nothing
+    static constexpr int MaxThreads = 64;
+
+private:
+    static QAtomicInteger<int> s_enabled;
+
+    static void record(char phase, const char *name, qint64 startNs, qint64 durationNs,
+                       quint64 id, quint64 flow);
+};
+
+// Traces the enclosing scope as one span in the current flow, or in the
+// given one. The name must be a string literal.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, quint64 flow = 0)
+        : m_name(nullptr)
+        , m_flow(flow)
+        , m_startNs(0)
+    {
+        if (Tracer::isEnabled()) {
+            begin(name);
+        }
+    }
+    ~TraceSpan() { end(); }
+
+    // Ends the span early, e.g. before emitting results
+    void end()
+    {
+        if (m_name) {
+            Tracer::complete(m_name, m_startNs, m_flow);
+            m_name = nullptr;
+        }
+    }
+
+private:
+    const char *m_name;
+    quint64 m_flow;
+    qint64 m_startNs;
+
+    void begin(const char *name);
+    Q_DISABLE_COPY(TraceSpan)
+};
+
+// Makes flow the current flow of this thread for the enclosing scope,
+// so spans and requests started in it join that flow
+class TraceFlowScope
+{
+public:
+    explicit TraceFlowScope(quint64 flow)
+        : m_active(Tracer::isEnabled())
+        , m_previous(0)
+    {
+        if (m_active) {
+            m_previous = Tracer::currentFlow();
+            Tracer::setCurrentFlow(flow);
+        }
+    }
+    ~TraceFlowScope()
+    {
+        if (m_active) {
+            Tracer::setCurrentFlow(m_previous);
+        }
+    }
+
+private:
+    bool m_active;
+    quint64 m_previous;
+    Q_DISABLE_COPY(TraceFlowScope)
+};
+
+#endif // TRACER_H
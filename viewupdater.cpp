@@ -0,0 +1,189 @@
+#include "viewupdater.h"
+#include "metrics.h"
+#include "stallwatchdog.h"
+#include "tracer.h"
+#include <QGuiApplication>
+#include <QScreen>
+
+namespace {
+
+const int MaxForecastRows = 5;
+const int ForecastRowHeight = 40;
+
+enum WeatherField { City, Temperature, Description, FeelsLike, Humidity, Wind, FieldCount };
+
+QString capitalized(QString text)
+{
+    if (!text.isEmpty()) {
+        text[0] = text[0].toUpper();
+    }
+    return text;
+}
+
+} // namespace
+
+ViewUpdater::ViewUpdater(const WeatherPanel &panel, QTableWidget *forecastTable, QObject *parent)
+    : QObject(parent)
+    , m_panel(panel)
+    , m_forecastTable(forecastTable)
+    , m_frameTimer(new QTimer(this))
+    , m_weatherDirty(false)
+    , m_forecastDirty(false)
+    , m_pendingFlow(0)
+{
+    // One frame at the screen's refresh rate
+    qreal refreshRate = 60.0;
+    if (QScreen *screen = QGuiApplication::primaryScreen()) {
+        refreshRate = qMax<qreal>(1.0, screen->refreshRate());
+    }
+    m_frameTimer->setSingleShot(true);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    m_frameTimer->setInterval(qMax(1, qRound(1000.0 / refreshRate)));
+    connect(m_frameTimer, &QTimer::timeout, this, &ViewUpdater::flush);
+}
+
+void ViewUpdater::setWeather(const WeatherData &data, const QString &displayName)
+{
+    m_pendingWeather = formatWeather(data, displayName);
+    m_weatherDirty = true;
+    m_pendingFlow = Tracer::currentFlow();
+    scheduleFrame();
+}
+
+void ViewUpdater::setForecast(const ForecastData &data)
+{
+    m_pendingForecast = data;
+    m_forecastDirty = true;
+    m_pendingFlow = Tracer::currentFlow();
+    scheduleFrame();
+}
+
+void ViewUpdater::clear()
+{
+    m_frameTimer->stop();
+    m_weatherDirty = false;
+    m_forecastDirty = false;
+    m_pendingForecast.clear();
+
+    applyWeather({"--", "--°C", "--", "--", "--", "--"});
+    m_forecastTable->setRowCount(0);
+}
+
+void ViewUpdater::scheduleFrame()
+{
+    if (!m_frameTimer->isActive()) {
+        m_frameTimer->start();
+    }
+}
+
+void ViewUpdater::flush()
+{
+    m_frameTimer->stop();
+    if (!m_weatherDirty && !m_forecastDirty) {
+        return;
+    }
+    StallScope stallScope("render");
+    // Icon requests for changed rows join the flow too
+    TraceFlowScope flowScope(m_pendingFlow);
+    TraceSpan traceSpan("render");
+
+    if (m_weatherDirty) {
+        static LatencyHistogram *renderHistogram = Metrics::histogram("render.weather");
+        ScopedLatency renderTimer(renderHistogram);
+        m_weatherDirty = false;
+        applyWeather(m_pendingWeather);
+    }
+
+    if (m_forecastDirty) {
+        static LatencyHistogram *renderHistogram = Metrics::histogram("render.forecast");
+        ScopedLatency renderTimer(renderHistogram);
+        m_forecastDirty = false;
+        applyForecast(m_pendingForecast);
+        m_pendingForecast.clear();
+    }
+
+    traceSpan.end();
+    emit rendered(m_pendingFlow);
+    m_pendingFlow = 0;
+}
+
+void ViewUpdater::applyWeather(const QStringList &texts)
+{
+    QLabel *labels[FieldCount] = {
+        m_panel.city, m_panel.temperature, m_panel.description,
+        m_panel.feelsLike, m_panel.humidity, m_panel.wind
+    };
+    for (int i = 0; i < FieldCount && i < texts.size(); ++i) {
+        setLabelText(labels[i], texts[i]);
+    }
+}
+
+void ViewUpdater::applyForecast(const ForecastData &data)
+{
+    int rows = qMin(data.count(), MaxForecastRows);
+    int oldRows = m_forecastTable->rowCount();
+    if (rows != oldRows) {
+        m_forecastTable->setRowCount(rows);
+        for (int row = oldRows; row < rows; ++row) {
+            m_forecastTable->setRowHeight(row, ForecastRowHeight);
+        }
+    }
+
+    for (int row = 0; row < rows; ++row) {
+        const ForecastItem &item = data.items().at(row);
+
+        setCellText(row, 0, item.dateTime().toString("ddd, MMM dd"));
+        setCellText(row, 2, QString("%1° / %2°")
+                                .arg(qRound(item.tempMin()))
+                                .arg(qRound(item.tempMax())));
+        setCellText(row, 3, capitalized(item.description()));
+
+        // Icon cell keeps its code so an unchanged icon isn't refetched
+        QTableWidgetItem *iconItem = m_forecastTable->item(row, 1);
+        if (!iconItem) {
+            iconItem = new QTableWidgetItem();
+            iconItem->setTextAlignment(Qt::AlignCenter);
+            m_forecastTable->setItem(row, 1, iconItem);
+        }
+        if (iconItem->data(Qt::UserRole).toString() != item.iconCode()) {
+            iconItem->setData(Qt::UserRole, item.iconCode());
+            iconItem->setIcon(QIcon());
+            emit forecastIconChanged(row, item.iconCode());
+        }
+    }
+}
+
+void ViewUpdater::setCellText(int row, int column, const QString &text)
+{
+    QTableWidgetItem *item = m_forecastTable->item(row, column);
+    if (!item) {
+        item = new QTableWidgetItem(text);
+        if (column != 3) {
+            item->setTextAlignment(Qt::AlignCenter);
+        }
+        m_forecastTable->setItem(row, column, item);
+    } else if (item->text() != text) {
+        item->setText(text);
+    }
+}
+
+QStringList ViewUpdater::formatWeather(const WeatherData &data, const QString &displayName)
+{
+    QStringList texts;
+    texts.reserve(FieldCount);
+    texts << displayName
+          << QString("%1°C").arg(data.temperature(), 0, 'f', 1)
+          << capitalized(data.description())
+          << QString("%1°C").arg(data.feelsLike(), 0, 'f', 1)
+          << QString("%1%").arg(data.humidity())
+          << QString("%1 km/h").arg(data.windSpeed() * 3.6, 0, 'f', 1);
+    return texts;
+}
+
+void ViewUpdater::setLabelText(QLabel *label, const QString &text)
+{
+    // QLabel relayouts on every setText, even with the same text
+    if (label && label->text() != text) {
+        label->setText(text);
+    }
+}
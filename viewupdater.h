@@ -0,0 +1,67 @@
+#ifndef VIEWUPDATER_H
+#define VIEWUPDATER_H
+
+#include <QObject>
+#include <QLabel>
+#include <QTableWidget>
+#include <QTimer>
+#include <QStringList>
+#include "weatherdata.h"
+#include "forecastdata.h"
+
+// Applies weather and forecast updates to the panels at most once per
+// frame. Updates that arrive within a frame are merged, the formatted
+// values are compared with what is on screen, and only widgets whose text
+// or icon changed are touched, so Qt repaints just those in one pass.
+class ViewUpdater : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct WeatherPanel {
+        QLabel *city = nullptr;
+        QLabel *temperature = nullptr;
+        QLabel *description = nullptr;
+        QLabel *feelsLike = nullptr;
+        QLabel *humidity = nullptr;
+        QLabel *wind = nullptr;
+    };
+
+    ViewUpdater(const WeatherPanel &panel, QTableWidget *forecastTable, QObject *parent = nullptr);
+
+    void setWeather(const WeatherData &data, const QString &displayName);
+    void setForecast(const ForecastData &data);
+    // Placeholders, applied immediately
+    void clear();
+
+public slots:
+    // Applies pending updates now, e.g. for the first frame
+    void flush();
+
+signals:
+    // A forecast row shows a different icon and needs the pixmap
+    void forecastIconChanged(int row, const QString &iconCode);
+    // Pending updates were applied; flow is the trace flow they came from
+    void rendered(quint64 flow);
+
+private:
+    WeatherPanel m_panel;
+    QTableWidget *m_forecastTable;
+    QTimer *m_frameTimer;
+
+    QStringList m_pendingWeather;
+    ForecastData m_pendingForecast;
+    bool m_weatherDirty;
+    bool m_forecastDirty;
+    quint64 m_pendingFlow;
+
+    void scheduleFrame();
+    void applyWeather(const QStringList &texts);
+    void applyForecast(const ForecastData &data);
+    void setCellText(int row, int column, const QString &text);
+
+    static QStringList formatWeather(const WeatherData &data, const QString &displayName);
+    static void setLabelText(QLabel *label, const QString &text);
+};
+
+#endif // VIEWUPDATER_H
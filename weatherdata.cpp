@@ -1,9 +1,15 @@
 #include "weatherdata.h"
+#include <QtMath>
 
 WeatherData::WeatherData()
     : m_temperature(0.0)
     , m_feelsLike(0.0)
     , m_humidity(0)
+    , m_pressure(0)
     , m_windSpeed(0.0)
+    , m_cityId(0)
+    , m_lat(qQNaN())
+    , m_lon(qQNaN())
+    , m_observedAt(0)
 {
 }
@@ -14,8 +14,13 @@ public:
     double feelsLike() const { return m_feelsLike; }
     QString description() const { return m_description; }
     int humidity() const { return m_humidity; }
+    int pressure() const { return m_pressure; }  // hPa, 0 if unknown
     double windSpeed() const { return m_windSpeed; }
     QString iconCode() const { return m_iconCode; }
+    int cityId() const { return m_cityId; }
+    double lat() const { return m_lat; }
+    double lon() const { return m_lon; }
+    qint64 observedAt() const { return m_observedAt; }  // seconds since the epoch, 0 if unknown
 
     void setCityName(const QString &name) { m_cityName = name; }
     void setCountry(const QString &country) { m_country = country; }
@@ -23,8 +28,12 @@ public:
     void setFeelsLike(double feels) { m_feelsLike = feels; }
     void setDescription(const QString &desc) { m_description = desc; }
     void setHumidity(int humidity) { m_humidity = humidity; }
+    void setPressure(int pressure) { m_pressure = pressure; }
     void setWindSpeed(double speed) { m_windSpeed = speed; }
     void setIconCode(const QString &code) { m_iconCode = code; }
+    void setCityId(int id) { m_cityId = id; }
+    void setCoordinates(double lat, double lon) { m_lat = lat; m_lon = lon; }
+    void setObservedAt(qint64 secs) { m_observedAt = secs; }
 
     bool isValid() const { return !m_cityName.isEmpty(); }
 
@@ -35,8 +44,13 @@ private:
     double m_feelsLike;
     QString m_description;
     int m_humidity;
+    int m_pressure;
     double m_windSpeed;
     QString m_iconCode;
+    int m_cityId;
+    double m_lat;
+    double m_lon;
+    qint64 m_observedAt;
 };
 
 #endif // WEATHERDATA_H
@@ -0,0 +1,13 @@
+#include "weatherfutures.h"
+
+WeatherError::WeatherError(const QString &message, Kind kind)
+    : m_message(message)
+    , m_what(message.toLocal8Bit())
+    , m_kind(kind)
+{
+}
+
+const char *WeatherError::what() const noexcept
+{
+    return m_what.constData();
+}
@@ -0,0 +1,382 @@
+#ifndef WEATHERFUTURES_H
+#define WEATHERFUTURES_H
+
+#include <QException>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QList>
+#include <QPair>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+// Failure carried by futures from WeatherService. result() and
+// waitForFinished() rethrow it; Futures::takeResult() turns it back into
+// a message.
+class WeatherError : public QException
+{
+public:
+    enum Kind {
+        Failed,
+        Canceled
+    };
+
+    explicit WeatherError(const QString &message, Kind kind = Failed);
+
+    QString message() const { return m_message; }
+    Kind kind() const { return m_kind; }
+    bool isCanceled() const { return m_kind == Canceled; }
+    const char *what() const noexcept override;
+
+    void raise() const override { throw *this; }
+    WeatherError *clone() const override { return new WeatherError(*this); }
+
+private:
+    QString m_message;
+    QByteArray m_what;
+    Kind m_kind;
+};
+
+namespace FuturesDetail {
+
+// T of a QFuture<T>, for deducing what a continuation returns
+template<typename F>
+struct FutureValue;
+
+template<typename T>
+struct FutureValue<QFuture<T>> {
+    using type = T;
+};
+
+} // namespace FuturesDetail
+
+// Combinators for QFuture that work on Qt 5 and Qt 6. Callbacks run on
+// the calling thread's event loop, so call these from a thread that has
+// one (normally the GUI thread).
+class Futures
+{
+public:
+    template<typename T>
+    static QFuture<T> ready(const T &value)
+    {
+        QFutureInterface<T> promise;
+        promise.reportStarted();
+        promise.reportResult(value);
+        promise.reportFinished();
+        return promise.future();
+    }
+
+    template<typename T>
+    static QFuture<T> failed(const QString &message)
+    {
+        QFutureInterface<T> promise;
+        promise.reportStarted();
+        promise.reportException(WeatherError(message));
+        promise.reportFinished();
+        return promise.future();
+    }
+
+    // Value of a finished future. False with the error when it failed or
+    // was canceled; check error->isCanceled() to tell the two apart.
+    template<typename T>
+    static bool takeResult(QFuture<T> future, T *value, WeatherError *error)
+    {
+        try {
+            future.waitForFinished();
+            if (future.resultCount() > 0) {
+                *value = future.result();
+                return true;
+            }
+            *error = WeatherError("Canceled", WeatherError::Canceled);
+        } catch (const WeatherError &e) {
+            *error = e;
+        } catch (const QException &e) {
+            *error = WeatherError(QString::fromLocal8Bit(e.what()));
+        }
+        return false;
+    }
+
+    // Same, with just the message
+    template<typename T>
+    static bool takeResult(QFuture<T> future, T *value, QString *error = nullptr)
+    {
+        WeatherError failure(QString{});
+        if (takeResult(future, value, &failure)) {
+            return true;
+        }
+        if (error) {
+            *error = failure.message();
+        }
+        return false;
+    }
+
+    // Calls fn(future) once it has finished
+    template<typename T, typename Fn>
+    static void onFinished(const QFuture<T> &future, Fn fn)
+    {
+        auto *watcher = new QFutureWatcher<T>();
+        QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [watcher, fn]() mutable {
+            fn(watcher->future());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(future);
+    }
+
+    // Calls fn() if the future is canceled before it finishes
+    template<typename T, typename Fn>
+    static void onCanceled(const QFuture<T> &future, Fn fn)
+    {
+        auto *watcher = new QFutureWatcher<T>();
+        QObject::connect(watcher, &QFutureWatcherBase::canceled, watcher, fn);
+        QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, &QObject::deleteLater);
+        watcher->setFuture(future);
+    }
+
+    // Fails with "Request timed out" and cancels the input if it has not
+    // finished within timeoutMs
+    template<typename T>
+    static QFuture<T> withTimeout(QFuture<T> future, int timeoutMs)
+    {
+        if (timeoutMs <= 0 || future.isFinished()) {
+            return future;
+        }
+        auto promise = std::make_shared<QFutureInterface<T>>();
+        promise->reportStarted();
+
+        auto *timer = new QTimer();
+        timer->setSingleShot(true);
+        QObject::connect(timer, &QTimer::timeout, timer, [promise, future, timer]() mutable {
+            if (!promise->isFinished()) {
+                future.cancel();
+                promise->reportException(WeatherError("Request timed out"));
+                promise->reportFinished();
+            }
+            timer->deleteLater();
+        });
+        timer->start(timeoutMs);
+
+        QPointer<QTimer> guard(timer);
+        onFinished(future, [promise, guard](QFuture<T> finished) {
+            if (guard) {
+                guard->deleteLater();
+            }
+            forward(promise.get(), finished);
+        });
+        onCanceled(promise->future(), [future]() mutable {
+            future.cancel();
+        });
+        return promise->future();
+    }
+
+    // Runs next(value) after future succeeds and follows the future it
+    // returns, so dependent requests chain without blocking. next is any
+    // callable taking const A & and returning a QFuture.
+    template<typename A, typename Fn,
+             typename B = typename FuturesDetail::FutureValue<std::invoke_result_t<Fn, const A &>>::type>
+    static QFuture<B> chain(QFuture<A> future, Fn next)
+    {
+        auto promise = std::make_shared<QFutureInterface<B>>();
+        auto current = std::make_shared<std::function<void()>>([future]() mutable { future.cancel(); });
+        promise->reportStarted();
+
+        onFinished(future, [promise, current, next](QFuture<A> finished) mutable {
+            A value;
+            WeatherError error(QString{});
+            if (promise->isFinished()) {
+                return;
+            }
+            if (!takeResult(finished, &value, &error)) {
+                fail(promise.get(), error);
+                return;
+            }
+            QFuture<B> step = next(value);
+            *current = [step]() mutable { step.cancel(); };
+            onFinished(step, [promise](QFuture<B> done) {
+                forward(promise.get(), done);
+            });
+        });
+        onCanceled(promise->future(), [current]() {
+            (*current)();
+        });
+        return promise->future();
+    }
+
+    // All values in input order; fails on the first error and cancels
+    // the rest
+    template<typename T>
+    static QFuture<QList<T>> whenAll(const QList<QFuture<T>> &futures)
+    {
+        if (futures.isEmpty()) {
+            return ready(QList<T>());
+        }
+
+        struct State {
+            QFutureInterface<QList<T>> promise;
+            QList<QFuture<T>> inputs;
+            QVector<T> values;
+            int remaining = 0;
+        };
+        auto state = std::make_shared<State>();
+        state->inputs = futures;
+        state->values.resize(futures.size());
+        state->remaining = futures.size();
+        state->promise.reportStarted();
+
+        for (int i = 0; i < futures.size(); ++i) {
+            onFinished(futures.at(i), [state, i](QFuture<T> finished) {
+                if (state->promise.isFinished()) {
+                    return;
+                }
+                WeatherError error(QString{});
+                if (!takeResult(finished, &state->values[i], &error)) {
+                    cancelAll(state->inputs);
+                    fail(&state->promise, error);
+                    return;
+                }
+                if (--state->remaining == 0) {
+                    state->promise.reportResult(QList<T>(state->values.begin(), state->values.end()));
+                    state->promise.reportFinished();
+                }
+            });
+        }
+        onCanceled(state->promise.future(), [state]() {
+            cancelAll(state->inputs);
+        });
+        return state->promise.future();
+    }
+
+    // Both values, e.g. weather and forecast for the same city
+    template<typename A, typename B>
+    static QFuture<QPair<A, B>> whenBoth(QFuture<A> first, QFuture<B> second)
+    {
+        struct State {
+            QFutureInterface<QPair<A, B>> promise;
+            QPair<A, B> values;
+            int remaining = 2;
+        };
+        auto state = std::make_shared<State>();
+        state->promise.reportStarted();
+
+        auto failBoth = [state, first, second](const WeatherError &error) mutable {
+            first.cancel();
+            second.cancel();
+            fail(&state->promise, error);
+        };
+        auto arrived = [state]() {
+            if (--state->remaining == 0) {
+                state->promise.reportResult(state->values);
+                state->promise.reportFinished();
+            }
+        };
+        onFinished(first, [state, failBoth, arrived](QFuture<A> finished) mutable {
+            WeatherError error(QString{});
+            if (state->promise.isFinished()) {
+                return;
+            }
+            if (takeResult(finished, &state->values.first, &error)) {
+                arrived();
+            } else {
+                failBoth(error);
+            }
+        });
+        onFinished(second, [state, failBoth, arrived](QFuture<B> finished) mutable {
+            WeatherError error(QString{});
+            if (state->promise.isFinished()) {
+                return;
+            }
+            if (takeResult(finished, &state->values.second, &error)) {
+                arrived();
+            } else {
+                failBoth(error);
+            }
+        });
+        onCanceled(state->promise.future(), [first, second]() mutable {
+            first.cancel();
+            second.cancel();
+        });
+        return state->promise.future();
+    }
+
+    // First successful value; the others are canceled. Fails with the
+    // last error only when every input failed.
+    template<typename T>
+    static QFuture<T> whenAny(const QList<QFuture<T>> &futures)
+    {
+        if (futures.isEmpty()) {
+            return failed<T>("No requests");
+        }
+
+        struct State {
+            QFutureInterface<T> promise;
+            QList<QFuture<T>> inputs;
+            int remaining = 0;
+        };
+        auto state = std::make_shared<State>();
+        state->inputs = futures;
+        state->remaining = futures.size();
+        state->promise.reportStarted();
+
+        for (const QFuture<T> &future : futures) {
+            onFinished(future, [state](QFuture<T> finished) {
+                if (state->promise.isFinished()) {
+                    return;
+                }
+                T value;
+                WeatherError error(QString{});
+                if (takeResult(finished, &value, &error)) {
+                    state->promise.reportResult(value);
+                    state->promise.reportFinished();
+                    cancelAll(state->inputs);
+                } else if (--state->remaining == 0) {
+                    fail(&state->promise, error);
+                }
+            });
+        }
+        onCanceled(state->promise.future(), [state]() {
+            cancelAll(state->inputs);
+        });
+        return state->promise.future();
+    }
+
+private:
+    template<typename T>
+    static void fail(QFutureInterface<T> *promise, const WeatherError &error)
+    {
+        if (error.isCanceled()) {
+            promise->cancel();
+        } else {
+            promise->reportException(error);
+        }
+        promise->reportFinished();
+    }
+
+    template<typename T>
+    static void forward(QFutureInterface<T> *promise, QFuture<T> finished)
+    {
+        if (promise->isFinished()) {
+            return;
+        }
+        T value;
+        WeatherError error(QString{});
+        if (takeResult(finished, &value, &error)) {
+            promise->reportResult(value);
+            promise->reportFinished();
+        } else {
+            fail(promise, error);
+        }
+    }
+
+    template<typename T>
+    static void cancelAll(QList<QFuture<T>> futures)
+    {
+        for (QFuture<T> &future : futures) {
+            future.cancel();
+        }
+    }
+};
+
+#endif // WEATHERFUTURES_H
@@ -0,0 +1,207 @@
+#include "weatherparser.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QSet>
+
+QString WeatherParser::apiError(const QJsonObject &json)
+{
+    // Handle both string and numeric cod values
+    if (!json.contains("cod")) {
+        return QString();
+    }
+
+    int codValue = 0;
+
+    // API returns cod as number (200) for current weather
+    if (json["cod"].isDouble()) {
+        codValue = json["cod"].toInt();
+    }
+    // API returns cod as string ("200") for forecast
+    else if (json["cod"].isString()) {
+        codValue = json["cod"].toString().toInt();
+    }
+
+    if (codValue == 200) {
+        return QString();
+    }
+
+    QString message = json["message"].toString();
+    if (message.isEmpty()) {
+        message = QString("API returned error code %1").arg(codValue);
+    }
+    return message;
+}
+
+WeatherData WeatherParser::parseWeatherData(const QByteArray &jsonData)
+{
+    return parseWeatherObject(QJsonDocument::fromJson(jsonData).object());
+}
+
+WeatherData WeatherParser::parseWeatherObject(const QJsonObject &json)
+{
+    WeatherData data;
+
+    // City name and ID
+    data.setCityName(json["name"].toString());
+    data.setCityId(json["id"].toInt());
+    data.setObservedAt(json["dt"].toVariant().toLongLong());
+
+    // Coordinates
+    if (json.contains("coord") && json["coord"].isObject()) {
+        QJsonObject coord = json["coord"].toObject();
+        data.setCoordinates(coord["lat"].toDouble(), coord["lon"].toDouble());
+    }
+
+    // Country
+    if (json.contains("sys") && json["sys"].isObject()) {
+        QJsonObject sys = json["sys"].toObject();
+        data.setCountry(sys["country"].toString());
+    }
+
+    // Temperature, feels like, humidity, pressure
+    if (json.contains("main") && json["main"].isObject()) {
+        QJsonObject main = json["main"].toObject();
+        data.setTemperature(main["temp"].toDouble());
+        data.setFeelsLike(main["feels_like"].toDouble());
+        data.setHumidity(main["humidity"].toInt());
+        data.setPressure(main["pressure"].toInt());
+    }
+
+    // Wind speed
+    if (json.contains("wind") && json["wind"].isObject()) {
+        QJsonObject wind = json["wind"].toObject();
+        data.setWindSpeed(wind["speed"].toDouble());
+    }
+
+    // Weather description and icon
+    if (json.contains("weather") && json["weather"].isArray()) {
+        QJsonArray weatherArray = json["weather"].toArray();
+        if (!weatherArray.isEmpty()) {
+            QJsonObject weather = weatherArray[0].toObject();
+            data.setDescription(weather["description"].toString());
+            data.setIconCode(weather["icon"].toString());
+        }
+    }
+
+    return data;
+}
+
+ForecastData WeatherParser::parseForecastData(const QByteArray &jsonData)
+{
+    return parseForecastObject(QJsonDocument::fromJson(jsonData).object());
+}
+
+ForecastData WeatherParser::parseForecastObject(const QJsonObject &json)
+{
+    ForecastData data;
+
+    if (!json.contains("list") || !json["list"].isArray()) {
+        return data;
+    }
+
+    QJsonArray list = json["list"].toArray();
+
+    // Process daily data
+    QSet<QString> processedDates;
+
+    for (const QJsonValue &value : list) {
+        if (!value.isObject()) continue;
+
+        ForecastItem forecastItem;
+        if (parseForecastItem(value.toObject(), &processedDates, &forecastItem)) {
+            data.addItem(forecastItem);
+        }
+
+        // Limit to 5 days
+        if (data.count() >= MaxForecastDays) {
+            break;
+        }
+    }
+
+    return data;
+}
+
+bool WeatherParser::parseForecastItem(const QJsonObject &item, QSet<QString> *processedDates,
+                                      ForecastItem *forecastItem)
+{
+    // Get date/time
+    qint64 timestamp = item["dt"].toVariant().toLongLong();
+    QDateTime dateTime = QDateTime::fromSecsSinceEpoch(timestamp);
+    QString dateKey = dateTime.date().toString("yyyy-MM-dd");
+
+    // Only take one forecast per day
+    if (processedDates->contains(dateKey)) {
+        return false;
+    }
+
+    int hour = dateTime.time().hour();
+    if ((hour < 11) || (hour > 14)) {
+        return false;
+    }
+
+    processedDates->insert(dateKey);
+
+    forecastItem->setDateTime(dateTime);
+
+    // Temperature
+    if (item.contains("main") && item["main"].isObject()) {
+        QJsonObject main = item["main"].toObject();
+        double temp = main["temp"].toDouble();
+        double tempMin = main["temp_min"].toDouble();
+        double tempMax = main["temp_max"].toDouble();
+
+        // Use actual min/max (if available); otherwise approximate
+        if (tempMin > 0 && tempMax > 0) {
+            forecastItem->setTempMin(tempMin);
+            forecastItem->setTempMax(tempMax);
+        } else {
+            forecastItem->setTempMin(temp - 3);
+            forecastItem->setTempMax(temp + 3);
+        }
+    }
+
+    // Weather description and icon
+    if (item.contains("weather") && item["weather"].isArray()) {
+        QJsonArray weatherArray = item["weather"].toArray();
+        if (!weatherArray.isEmpty()) {
+            QJsonObject weather = weatherArray[0].toObject();
+            forecastItem->setDescription(weather["description"].toString());
+            forecastItem->setIconCode(weather["icon"].toString());
+        }
+    }
+
+    return true;
+}
+
+QList<CityResult> WeatherParser::parseGeocodingResults(const QByteArray &jsonData, bool *ok)
+{
+    QList<CityResult> results;
+    QJsonDocument doc = QJsonDocument::fromJson(jsonData);
+
+    if (ok) {
+        *ok = doc.isArray();
+    }
+    if (!doc.isArray()) {
+        return results;
+    }
+
+    QJsonArray array = doc.array();
+    results.reserve(array.size());
+
+    for (const QJsonValue &value : array) {
+        if (!value.isObject()) continue;
+
+        QJsonObject obj = value.toObject();
+        CityResult result;
+        result.name = obj["name"].toString();
+        result.state = obj["state"].toString();
+        result.country = obj["country"].toString();
+        result.lat = obj["lat"].toDouble();
+        result.lon = obj["lon"].toDouble();
+
+        results.append(result);
+    }
+
+    return results;
+}
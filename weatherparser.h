@@ -0,0 +1,34 @@
+#ifndef WEATHERPARSER_H
+#define WEATHERPARSER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QSet>
+#include "weatherdata.h"
+#include "forecastdata.h"
+#include "cityresult.h"
+
+// Stateless parsers for OpenWeatherMap responses
+class WeatherParser
+{
+public:
+    // Empty when the response carries no error code
+    static QString apiError(const QJsonObject &json);
+
+    static WeatherData parseWeatherData(const QByteArray &jsonData);
+    static WeatherData parseWeatherObject(const QJsonObject &json);
+
+    static ForecastData parseForecastData(const QByteArray &jsonData);
+    static ForecastData parseForecastObject(const QJsonObject &json);
+    // One entry of the forecast "list"; false unless it is the midday
+    // reading of a day not in processedDates
+    static bool parseForecastItem(const QJsonObject &item, QSet<QString> *processedDates,
+                                  ForecastItem *forecastItem);
+
+    static QList<CityResult> parseGeocodingResults(const QByteArray &jsonData, bool *ok = nullptr);
+
+    static const int MaxForecastDays = 5;
+};
+
+#endif // WEATHERPARSER_H
@@ -1,4 +1,16 @@
 #include "weatherservice.h"
+#include "apiendpoints.h"
+#include "networkwarmup.h"
+#include "stallwatchdog.h"
+#include "metrics.h"
+#include "weatherparser.h"
+#include "weatherfutures.h"
+#include "requesthedger.h"
+#include "circuitbreaker.h"
+#include "negativecache.h"
+#include "sharedcache.h"
+#include "forecaststream.h"
+#include "tracer.h"
 #include <QNetworkRequest>
 #include <QUrlQuery>
 #include <QJsonDocument>
@@ -7,6 +19,93 @@
 #include <QDateTime>
 #include <QDebug>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+
+namespace {
+
+// Carries the request ID through the reply
+const QNetworkRequest::Attribute RequestIdAttribute =
+    QNetworkRequest::Attribute(QNetworkRequest::User + 1);
+// Set on the duplicate sent to the hedge endpoint
+const QNetworkRequest::Attribute HedgeAttribute =
+    QNetworkRequest::Attribute(QNetworkRequest::User + 2);
+
+// Settles a future from a forwarded reply. parse() returns an error
+// message, or fills in the value and returns an empty string.
+template<typename T, typename Parse>
+QFuture<T> replyFuture(QNetworkReply *reply, Parse parse)
+{
+    QFutureInterface<T> promise;
+    promise.reportStarted();
+
+    QPointer<QNetworkReply> guard(reply);
+    Futures::onCanceled(promise.future(), [guard]() {
+        if (guard && guard->isRunning()) {
+            guard->abort();
+        }
+    });
+
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply, promise, parse]() mutable {
+        TraceFlowScope flowScope(Tracer::endReply(reply));
+        if (!promise.isCanceled()) {
+            T value;
+            QByteArray data;
+            QString error = WeatherService::networkError(reply);
+            WeatherService::recordOutcome(reply, error);
+            if (error.isEmpty()) {
+                StallScope stallScope("parse");
+                TraceSpan traceSpan("parse");
+                data = reply->readAll();
+                error = parse(data, &value);
+            }
+            if (error.isEmpty()) {
+                SharedCache::put(reply->property("lookupKey").toString(), data);
+                promise.reportResult(value);
+            } else {
+                promise.reportException(WeatherError(error));
+            }
+        }
+        promise.reportFinished();
+        reply->deleteLater();
+    });
+    return promise.future();
+}
+
+// Cache key of a weather or forecast query, without the API key
+QString lookupKey(const QString &requestType, QUrlQuery query)
+{
+    query.removeAllQueryItems("appid");
+    return NegativeCache::key(requestType, query.toString(QUrl::FullyDecoded));
+}
+
+// Settles from the shared cache when another process already has the response
+template<typename T, typename Parse>
+bool sharedFuture(const QString &key, Parse parse, QFuture<T> *future)
+{
+    QByteArray data;
+    if (!SharedCache::get(key, &data, WeatherService::SharedMaxAgeSecs)) {
+        return false;
+    }
+    T value;
+    QString error = parse(data, &value);
+    *future = error.isEmpty() ? Futures::ready(value) : Futures::failed<T>(error);
+    return true;
+}
+
+QString parseObject(const QByteArray &data, QJsonObject *json)
+{
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if (!doc.isObject()) {
+        return "Invalid JSON response from API";
+    }
+    *json = doc.object();
+    QString apiError = WeatherParser::apiError(*json);
+    return apiError.isEmpty() ? QString() : "API Error: " + apiError;
+}
+
+} // namespace
 
 QString WeatherService::apiKey() const
 {
@@ -15,244 +114,599 @@ QString WeatherService::apiKey() const
 
 WeatherService::WeatherService(QObject *parent)
     : QObject(parent)
-    , m_networkManager(new QNetworkAccessManager(this))
+    , m_networkManager(nullptr)
+    , m_nextRequestId(1)
+    , m_baseUrl(ApiEndpoints::apiBaseUrl())
+    , m_hedgeUrl(RequestHedger::secondaryBaseUrl())
+{
+}
+
+QString WeatherService::baseUrl() const
+{
+    return m_baseUrl;
+}
+
+void WeatherService::setBaseUrl(const QString &baseUrl)
 {
-    connect(m_networkManager, &QNetworkAccessManager::finished,
-            this, &WeatherService::onReplyFinished);
+    m_baseUrl = baseUrl;
+    while (m_baseUrl.endsWith('/')) {
+        m_baseUrl.chop(1);
+    }
+}
+
+QString WeatherService::hedgeUrl() const
+{
+    return m_hedgeUrl;
+}
+
+void WeatherService::setHedgeUrl(const QString &hedgeUrl)
+{
+    m_hedgeUrl = hedgeUrl;
+    while (m_hedgeUrl.endsWith('/')) {
+        m_hedgeUrl.chop(1);
+    }
+}
+
+QNetworkAccessManager *WeatherService::networkManager()
+{
+    // Created by prewarm() or on the first request
+    if (!m_networkManager) {
+        m_networkManager = new QNetworkAccessManager(this);
+        connect(m_networkManager, &QNetworkAccessManager::finished,
+                this, &WeatherService::onReplyFinished);
+    }
+    return m_networkManager;
 }
 
 void WeatherService::fetchWeather(const QString &city)
 {
-    if (city.trimmed().isEmpty()) {
-        emit errorOccurred("City name cannot be empty");
-        return;
+    CityResult location;
+    location.name = city.trimmed();
+    fetchWeather(location);
+}
+
+void WeatherService::fetchForecast(const QString &city)
+{
+    CityResult location;
+    location.name = city.trimmed();
+    fetchForecast(location);
+}
+
+QString WeatherService::checkLocation(const CityResult &location) const
+{
+    QUrlQuery query;
+    return buildQuery(location, query);
+}
+
+quint64 WeatherService::fetchWeather(const CityResult &location)
+{
+    QUrlQuery query;
+    QString error = buildQuery(location, query);
+    if (!error.isEmpty()) {
+        emit errorOccurred(error);
+        return 0;
+    }
+    return sendRequest("weather", query);
+}
+
+quint64 WeatherService::fetchForecast(const CityResult &location)
+{
+    QUrlQuery query;
+    QString error = buildQuery(location, query);
+    if (!error.isEmpty()) {
+        emit errorOccurred(error);
+        return 0;
+    }
+    return sendRequest("forecast", query);
+}
+
+QString WeatherService::buildQuery(const CityResult &location, QUrlQuery &query) const
+{
+    if (location.cityId <= 0 && !location.hasCoordinates() && location.name.trimmed().isEmpty()) {
+        return "City name cannot be empty";
     }
     QString key = apiKey();
     if (key.isEmpty()) {
-        emit errorOccurred("OPENWEATHERMAP_API_KEY environment variable is not set. See README.");
-        return;
+        return "OPENWEATHERMAP_API_KEY environment variable is not set. See README.";
     }
 
-    QUrl url(WEATHER_URL);
-    QUrlQuery query;
-    query.addQueryItem("q", city);
+    // Prefer the resolved ID or coordinates; a bare name is geocoded by the server
+    if (location.cityId > 0) {
+        query.addQueryItem("id", QString::number(location.cityId));
+    } else if (location.hasCoordinates()) {
+        query.addQueryItem("lat", QString::number(location.lat, 'f', 4));
+        query.addQueryItem("lon", QString::number(location.lon, 'f', 4));
+    } else {
+        QString q = location.name.trimmed();
+        if (!location.country.isEmpty()) {
+            q += "," + location.country;
+        }
+        query.addQueryItem("q", q);
+    }
     query.addQueryItem("appid", key);
     query.addQueryItem("units", "metric");
     query.addQueryItem("lang", "en");
-    url.setQuery(query);
+    return QString();
+}
 
-    QNetworkRequest request(url);
-    request.setAttribute(QNetworkRequest::User, "weather");
-    m_networkManager->get(request);
+QString WeatherService::endpointUrl(const QString &requestType, const QString &baseUrl)
+{
+    return requestType == "forecast" ? ApiEndpoints::forecastUrl(baseUrl) : ApiEndpoints::weatherUrl(baseUrl);
 }
 
-void WeatherService::fetchForecast(const QString &city)
+QString WeatherService::preflight(const QUrl &url, const QString &negativeKey)
+{
+    QString error;
+    if (NegativeCache::lookup(negativeKey, &error)) {
+        return error;
+    }
+    qint64 retryInMs = 0;
+    if (!CircuitBreaker::allow(CircuitBreaker::endpointKey(url), &retryInMs)) {
+        return QString("Weather service unavailable, retrying in %1 s").arg((retryInMs + 999) / 1000);
+    }
+    return QString();
+}
+
+void WeatherService::recordOutcome(QNetworkReply *reply, const QString &error)
 {
-    if (city.trimmed().isEmpty()) {
-        emit errorOccurred("City name cannot be empty");
+    if (reply->error() == QNetworkReply::OperationCanceledError) {
         return;
     }
-    QString key = apiKey();
-    if (key.isEmpty()) {
-        emit errorOccurred("OPENWEATHERMAP_API_KEY environment variable is not set. See README.");
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QString endpoint = CircuitBreaker::endpointKey(reply->url());
+    if (CircuitBreaker::isEndpointFailure(reply->error(), status)) {
+        CircuitBreaker::recordFailure(endpoint);
         return;
     }
+    CircuitBreaker::recordSuccess(endpoint);
 
-    QUrl url(FORECAST_URL);
-    QUrlQuery query;
-    query.addQueryItem("q", city);
-    query.addQueryItem("appid", key);
-    query.addQueryItem("units", "metric");
-    query.addQueryItem("lang", "en");
+    // Client errors such as "city not found" are not worth retrying soon
+    const QString key = reply->property("lookupKey").toString();
+    if (status >= 400 && status < 500 && !key.isEmpty()) {
+        NegativeCache::insert(key, error);
+    }
+}
+
+quint64 WeatherService::sendRequest(const QString &requestType, const QUrlQuery &query)
+{
+    QUrl url(endpointUrl(requestType, m_baseUrl));
     url.setQuery(query);
 
+    quint64 requestId = m_nextRequestId++;
+    const QString key = lookupKey(requestType, query);
+    const quint64 traceFlow = Tracer::currentOrNewFlow();
+
+    // Another dashboard on this machine may have fetched it already
+    QByteArray cached;
+    if (SharedCache::get(key, &cached, SharedMaxAgeSecs)) {
+        QMetaObject::invokeMethod(this, [this, requestId, requestType, cached, traceFlow]() {
+            TraceFlowScope flowScope(traceFlow);
+            deliver(requestId, requestType, cached);
+        }, Qt::QueuedConnection);
+        return requestId;
+    }
+
+    // Known-bad queries and open circuits fail without touching the network
+    const QString error = preflight(url, key);
+    if (!error.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, requestId, error, traceFlow]() {
+            TraceFlowScope flowScope(traceFlow);
+            emit requestRejected(requestId, error);
+            failRequest(requestId, error);
+        }, Qt::QueuedConnection);
+        return requestId;
+    }
+
     QNetworkRequest request(url);
-    request.setAttribute(QNetworkRequest::User, "forecast");
-    m_networkManager->get(request);
+    request.setAttribute(QNetworkRequest::User, requestType);
+    request.setAttribute(RequestIdAttribute, requestId);
+    QNetworkReply *reply = NetworkWarmup::get(networkManager(), request);
+    reply->setProperty("lookupKey", key);
+    RequestTimer::attach(reply, requestType);
+    Tracer::traceReply(reply, requestType == "forecast" ? "forecast request" : "weather request", traceFlow);
+    if (requestType == "forecast") {
+        watchStream(reply);
+    }
+
+    // Duplicate to the hedge endpoint if this is still running at p95
+    if (!m_hedgeUrl.isEmpty() && m_hedgeUrl != m_baseUrl) {
+        InFlight &inFlight = m_inFlight[requestId];
+        inFlight.primary = reply;
+        inFlight.timer.start();
+        RequestHedger::requestStarted();
+        QTimer::singleShot(RequestHedger::delayMs(requestType), reply, [this, requestId]() {
+            sendHedge(requestId);
+        });
+    }
+    return requestId;
 }
 
-void WeatherService::onReplyFinished(QNetworkReply *reply)
+void WeatherService::sendHedge(quint64 requestId)
 {
-    QString requestType = reply->request().attribute(QNetworkRequest::User).toString();
-
-    if (reply->error() == QNetworkReply::NoError) {
-        QByteArray data = reply->readAll();
+    auto it = m_inFlight.find(requestId);
+    if (it == m_inFlight.end() || !it->primary || !it->primary->isRunning() || it->hedged) {
+        return;
+    }
 
-        QJsonDocument doc = QJsonDocument::fromJson(data);
-        if (doc.isNull() || !doc.isObject()) {
-            emit errorOccurred("Invalid JSON response from API");
-            reply->deleteLater();
-            return;
-        }
+    QNetworkRequest request = it->primary->request();
+    const QString requestType = request.attribute(QNetworkRequest::User).toString();
+    QUrl url(endpointUrl(requestType, m_hedgeUrl));
+    url.setQuery(request.url().query());
+    if (!CircuitBreaker::allow(CircuitBreaker::endpointKey(url)) || !RequestHedger::tryAcquire()) {
+        return;
+    }
+    request.setUrl(url);
+    request.setAttribute(HedgeAttribute, true);
+
+    it->hedge = NetworkWarmup::get(networkManager(), request);
+    it->hedge->setProperty("lookupKey", it->primary->property("lookupKey"));
+    it->hedged = true;
+    RequestTimer::attach(it->hedge, requestType + ".hedge");
+    Tracer::traceReply(it->hedge, requestType == "forecast" ? "forecast hedge" : "weather hedge",
+                       Tracer::flowOf(it->primary));
+    if (requestType == "forecast") {
+        watchStream(it->hedge);
+    }
+}
 
-        QJsonObject json = doc.object();
+void WeatherService::watchStream(QNetworkReply *reply)
+{
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        readStream(reply);
+    });
+}
 
-        // Handle both string and numeric cod values
-        if (json.contains("cod")) {
-            int codValue = 0;
+void WeatherService::readStream(QNetworkReply *reply)
+{
+    // Error bodies are left for networkError(), losers for finishLoser()
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status >= 300 || reply->property("hedgeLoser").toBool()) {
+        return;
+    }
 
-            // API returns cod as number (200) for current weather
-            if (json["cod"].isDouble()) {
-                codValue = json["cod"].toInt();
-            }
-            // API returns cod as string ("200") for forecast
-            else if (json["cod"].isString()) {
-                codValue = json["cod"].toString().toInt();
-            }
+    auto it = m_streams.find(reply);
+    if (it == m_streams.end()) {
+        it = m_streams.insert(reply, ForecastStream());
+        it->setKeepBody(SharedCache::enabled());
+    }
+    {
+        StallScope stallScope("parse");
+        TraceSpan traceSpan("parse chunk", Tracer::flowOf(reply));
+        it->feed(reply->readAll());
+    }
 
-            if (codValue != 200) {
-                QString message = json["message"].toString();
-                if (message.isEmpty()) {
-                    message = QString("API returned error code %1").arg(codValue);
-                }
-                emit errorOccurred("API Error: " + message);
-                reply->deleteLater();
-                return;
-            }
+    // A hedge copy carries on from the days the other copy already sent
+    const quint64 requestId = reply->request().attribute(RequestIdAttribute).toULongLong();
+    const QList<ForecastItem> items = it->forecast().items();
+    const int sent = m_streamedItems.value(requestId);
+    if (items.size() > sent) {
+        m_streamedItems[requestId] = items.size();
+        for (int i = sent; i < items.size(); ++i) {
+            emit forecastItemReady(requestId, i, items.at(i));
         }
+    }
+}
 
-        if (requestType == "weather") {
-            WeatherData weatherData = parseWeatherData(data);
-            if (weatherData.isValid()) {
-                emit weatherDataReady(weatherData);
-            } else {
-                emit errorOccurred("Failed to parse weather data");
-            }
-        } else if (requestType == "forecast") {
-            ForecastData forecastData = parseForecastData(data);
-            emit forecastDataReady(forecastData);
-        }
-    } else {
-        QString errorMsg = reply->errorString();
+bool WeatherService::finishStream(quint64 requestId, QNetworkReply *reply, ForecastStream &stream)
+{
+    {
+        StallScope stallScope("parse");
+        TraceSpan traceSpan("parse forecast");
+        stream.feed(reply->readAll());
+    }
+    Metrics::record("forecast.parse", stream.parseMicros());
 
-        if (reply->error() == QNetworkReply::HostNotFoundError) {
-            errorMsg = "No internet connection or server not found";
-        } else if (reply->error() == QNetworkReply::TimeoutError) {
-            errorMsg = "Request timeout. Please try again";
-        }
+    if (!stream.isComplete()) {
+        failRequest(requestId, stream.hasError() ? stream.error() : QString("Invalid JSON response from API"));
+        return false;
+    }
+    QString apiError = WeatherParser::apiError(stream.envelope());
+    if (!apiError.isEmpty()) {
+        failRequest(requestId, "API Error: " + apiError);
+        return false;
+    }
+    emit forecastDataReady(stream.forecast());
+    emit forecastReplyReady(requestId, stream.forecast());
+    return true;
+}
 
-        emit errorOccurred(errorMsg);
+bool WeatherService::settleHedged(QNetworkReply *reply, quint64 requestId)
+{
+    InFlight &inFlight = m_inFlight[requestId];
+    const bool isHedge = reply->request().attribute(HedgeAttribute).toBool();
+    QNetworkReply *other = isHedge ? inFlight.primary.data() : inFlight.hedge.data();
+    const bool otherRunning = other && other->isRunning();
+
+    // A failure is not final while the other copy can still succeed
+    if (reply->error() != QNetworkReply::NoError && otherRunning) {
+        (isHedge ? inFlight.hedge : inFlight.primary) = nullptr;
+        reply->deleteLater();
+        return false;
+    }
+
+    const InFlight settled = m_inFlight.take(requestId);
+    const qint64 elapsedUs = settled.timer.nsecsElapsed() / 1000;
+    const QString requestType = reply->request().attribute(QNetworkRequest::User).toString();
+    RequestHedger::recordResponse(requestType, elapsedUs, settled.hedged, isHedge);
+
+    if (otherRunning) {
+        other->setProperty("hedgeLoser", true);
+        if (isHedge && RequestHedger::sampleLoser()) {
+            SampledLoser &loser = m_sampledLosers[other];
+            loser.timer = settled.timer;
+            loser.wonAtUs = elapsedUs;
+        } else {
+            other->abort();
+        }
     }
+    return true;
+}
 
+void WeatherService::finishLoser(QNetworkReply *reply)
+{
+    auto it = m_sampledLosers.find(reply);
+    if (it != m_sampledLosers.end()) {
+        if (reply->error() == QNetworkReply::NoError) {
+            RequestHedger::recordSaving(it->timer.nsecsElapsed() / 1000 - it->wonAtUs);
+        }
+        m_sampledLosers.erase(it);
+    }
     reply->deleteLater();
 }
 
-WeatherData WeatherService::parseWeatherData(const QByteArray &jsonData)
+void WeatherService::prewarm()
 {
-    WeatherData data;
-    QJsonDocument doc = QJsonDocument::fromJson(jsonData);
-    QJsonObject json = doc.object();
+    NetworkWarmup::prewarm(networkManager(), m_baseUrl);
+}
 
-    // City name
-    data.setCityName(json["name"].toString());
+QNetworkReply *WeatherService::forward(const QUrl &url, const QString &timingPrefix)
+{
+    QNetworkRequest request(url);
+    request.setAttribute(QNetworkRequest::User, QString("raw"));
+    QNetworkReply *reply = NetworkWarmup::get(networkManager(), request);
+    RequestTimer::attach(reply, timingPrefix);
+    return reply;
+}
 
-    // Country
-    if (json.contains("sys") && json["sys"].isObject()) {
-        QJsonObject sys = json["sys"].toObject();
-        data.setCountry(sys["country"].toString());
+QNetworkReply *WeatherService::lookup(const QUrl &url, const QString &timingPrefix,
+                                      const QString &key, QString *error)
+{
+    *error = preflight(url, key);
+    if (!error->isEmpty()) {
+        return nullptr;
     }
+    QNetworkReply *reply = forward(url, timingPrefix);
+    reply->setProperty("lookupKey", key);
+    return reply;
+}
 
-    // Temperature, feels like, humidity
-    if (json.contains("main") && json["main"].isObject()) {
-        QJsonObject main = json["main"].toObject();
-        data.setTemperature(main["temp"].toDouble());
-        data.setFeelsLike(main["feels_like"].toDouble());
-        data.setHumidity(main["humidity"].toInt());
+QFuture<WeatherData> WeatherService::weather(const CityResult &location, int timeoutMs)
+{
+    QUrlQuery query;
+    QString error = buildQuery(location, query);
+    if (!error.isEmpty()) {
+        return Futures::failed<WeatherData>(error);
     }
-
-    // Wind speed
-    if (json.contains("wind") && json["wind"].isObject()) {
-        QJsonObject wind = json["wind"].toObject();
-        data.setWindSpeed(wind["speed"].toDouble());
+    auto parse = [](const QByteArray &data, WeatherData *weatherData) {
+        ScopedLatency parseTimer("weather.parse");
+        QJsonObject json;
+        QString error = parseObject(data, &json);
+        if (!error.isEmpty()) {
+            return error;
+        }
+        *weatherData = WeatherParser::parseWeatherObject(json);
+        return weatherData->isValid() ? QString() : QString("Failed to parse weather data");
+    };
+
+    const QString key = lookupKey("weather", query);
+    QFuture<WeatherData> future;
+    if (sharedFuture(key, parse, &future)) {
+        return future;
+    }
+    QUrl url(ApiEndpoints::weatherUrl(m_baseUrl));
+    url.setQuery(query);
+    QNetworkReply *reply = lookup(url, "weather", key, &error);
+    if (!reply) {
+        return Futures::failed<WeatherData>(error);
     }
+    future = replyFuture<WeatherData>(reply, parse);
+    return Futures::withTimeout(future, timeoutMs);
+}
 
-    // Weather description and icon
-    if (json.contains("weather") && json["weather"].isArray()) {
-        QJsonArray weatherArray = json["weather"].toArray();
-        if (!weatherArray.isEmpty()) {
-            QJsonObject weather = weatherArray[0].toObject();
-            data.setDescription(weather["description"].toString());
-            data.setIconCode(weather["icon"].toString());
-        }
+QFuture<ForecastData> WeatherService::forecast(const CityResult &location, int timeoutMs)
+{
+    QUrlQuery query;
+    QString error = buildQuery(location, query);
+    if (!error.isEmpty()) {
+        return Futures::failed<ForecastData>(error);
     }
+    auto parse = [](const QByteArray &data, ForecastData *forecastData) {
+        ScopedLatency parseTimer("forecast.parse");
+        QJsonObject json;
+        QString error = parseObject(data, &json);
+        if (error.isEmpty()) {
+            *forecastData = WeatherParser::parseForecastObject(json);
+        }
+        return error;
+    };
 
-    return data;
+    const QString key = lookupKey("forecast", query);
+    QFuture<ForecastData> future;
+    if (sharedFuture(key, parse, &future)) {
+        return future;
+    }
+    QUrl url(ApiEndpoints::forecastUrl(m_baseUrl));
+    url.setQuery(query);
+    QNetworkReply *reply = lookup(url, "forecast", key, &error);
+    if (!reply) {
+        return Futures::failed<ForecastData>(error);
+    }
+    future = replyFuture<ForecastData>(reply, parse);
+    return Futures::withTimeout(future, timeoutMs);
 }
 
-ForecastData WeatherService::parseForecastData(const QByteArray &jsonData)
+QFuture<QList<CityResult>> WeatherService::geocode(const QString &query, int limit, int timeoutMs)
 {
-    ForecastData data;
-    QJsonDocument doc = QJsonDocument::fromJson(jsonData);
-    QJsonObject json = doc.object();
+    QString key = apiKey();
+    if (query.trimmed().isEmpty()) {
+        return Futures::failed<QList<CityResult>>("City name cannot be empty");
+    }
+    if (key.isEmpty()) {
+        return Futures::failed<QList<CityResult>>("OPENWEATHERMAP_API_KEY environment variable is not set. See README.");
+    }
+    const QString cacheKey = NegativeCache::key("geocode", query) + ':' + QString::number(limit);
+    auto parse = [cacheKey](const QByteArray &data, QList<CityResult> *results) {
+        ScopedLatency parseTimer("geocode.parse");
+        bool ok = false;
+        *results = WeatherParser::parseGeocodingResults(data, &ok);
+        if (ok && results->isEmpty()) {
+            // Typing the same name again costs no request for a while
+            NegativeCache::insert(cacheKey, "City not found");
+        }
+        return ok ? QString() : QString("Invalid JSON response from API");
+    };
 
-    if (!json.contains("list") || !json["list"].isArray()) {
-        return data;
+    QFuture<QList<CityResult>> future;
+    if (sharedFuture(cacheKey, parse, &future)) {
+        return future;
+    }
+    QUrl url(ApiEndpoints::geocodingUrl(m_baseUrl));
+    QUrlQuery urlQuery;
+    urlQuery.addQueryItem("q", query.trimmed());
+    urlQuery.addQueryItem("limit", QString::number(limit));
+    urlQuery.addQueryItem("appid", key);
+    url.setQuery(urlQuery);
+    QString error;
+    QNetworkReply *reply = lookup(url, "geocode", cacheKey, &error);
+    if (!reply) {
+        return Futures::failed<QList<CityResult>>(error);
     }
+    Tracer::traceReply(reply, "geocode request");
+    future = replyFuture<QList<CityResult>>(reply, parse);
+    return Futures::withTimeout(future, timeoutMs);
+}
 
-    QJsonArray list = json["list"].toArray();
+QFuture<QByteArray> WeatherService::icon(const QString &iconCode, int timeoutMs)
+{
+    if (iconCode.isEmpty()) {
+        return Futures::failed<QByteArray>("No icon code");
+    }
+    QFuture<QByteArray> future = replyFuture<QByteArray>(forward(QUrl(ApiEndpoints::iconUrl(iconCode)), "icon"),
+        [](const QByteArray &data, QByteArray *png) {
+            *png = data;
+            return data.isEmpty() ? QString("Empty icon response") : QString();
+        });
+    return Futures::withTimeout(future, timeoutMs);
+}
 
-    // Process daily data
-    QSet<QString> processedDates;
+QString WeatherService::networkError(QNetworkReply *reply)
+{
+    switch (reply->error()) {
+    case QNetworkReply::NoError:
+        return QString();
+    case QNetworkReply::HostNotFoundError:
+        return "No internet connection or server not found";
+    case QNetworkReply::TimeoutError:
+        return "Request timeout. Please try again";
+    default: {
+        // The API explains client errors in the body, e.g. "city not found"
+        QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
+        QString apiError = doc.isObject() ? WeatherParser::apiError(doc.object()) : QString();
+        return apiError.isEmpty() ? reply->errorString() : "API Error: " + apiError;
+    }
+    }
+}
 
-    for (const QJsonValue &value : list) {
-        if (!value.isObject()) continue;
+void WeatherService::failRequest(quint64 requestId, const QString &error)
+{
+    emit errorOccurred(error);
+    emit requestFailed(requestId, error);
+}
 
-        QJsonObject item = value.toObject();
+void WeatherService::onReplyFinished(QNetworkReply *reply)
+{
+    QString requestType = reply->request().attribute(QNetworkRequest::User).toString();
+    quint64 requestId = reply->request().attribute(RequestIdAttribute).toULongLong();
 
-        // Get date/time
-        qint64 timestamp = item["dt"].toVariant().toLongLong();
-        QDateTime dateTime = QDateTime::fromSecsSinceEpoch(timestamp);
-        QString dateKey = dateTime.date().toString("yyyy-MM-dd");
+    // Forwarded replies belong to the caller
+    if (requestType == "raw") {
+        return;
+    }
+    // Everything done for the reply joins the flow that sent it
+    TraceFlowScope flowScope(Tracer::endReply(reply));
 
-        // Only take one forecast per day
-        if (processedDates.contains(dateKey)) {
-            continue;
-        }
+    // Forecasts that streamed have been parsed as they arrived
+    const bool streamed = m_streams.contains(reply);
+    ForecastStream stream = m_streams.take(reply);
 
-        int hour = dateTime.time().hour();
-        if ((hour < 11) || (hour > 14)) {
-            continue;
-        }
+    // Every copy, hedged or not, counts towards its endpoint's breaker
+    const QString error = networkError(reply);
+    recordOutcome(reply, error);
 
-        processedDates.insert(dateKey);
+    // Of a hedged pair only the first good reply is processed
+    if (reply->property("hedgeLoser").toBool()) {
+        finishLoser(reply);
+        return;
+    }
+    if (m_inFlight.contains(requestId) && !settleHedged(reply, requestId)) {
+        return;
+    }
 
-        ForecastItem forecastItem;
-        forecastItem.setDateTime(dateTime);
+    // Only responses that parsed are shared with other processes
+    if (reply->error() != QNetworkReply::NoError) {
+        failRequest(requestId, error);
+    } else if (streamed) {
+        if (finishStream(requestId, reply, stream)) {
+            SharedCache::put(reply->property("lookupKey").toString(), stream.body());
+        }
+    } else {
+        const QByteArray data = reply->readAll();
+        if (deliver(requestId, requestType, data)) {
+            SharedCache::put(reply->property("lookupKey").toString(), data);
+        }
+    }
 
-        // Temperature
-        if (item.contains("main") && item["main"].isObject()) {
-            QJsonObject main = item["main"].toObject();
-            double temp = main["temp"].toDouble();
-            double tempMin = main["temp_min"].toDouble();
-            double tempMax = main["temp_max"].toDouble();
+    m_streamedItems.remove(requestId);
+    reply->deleteLater();
+}
 
-            // Use actual min/max (if available); otherwise approximate
-            if (tempMin > 0 && tempMax > 0) {
-                forecastItem.setTempMin(tempMin);
-                forecastItem.setTempMax(tempMax);
-            } else {
-                forecastItem.setTempMin(temp - 3);
-                forecastItem.setTempMax(temp + 3);
-            }
-        }
+bool WeatherService::deliver(quint64 requestId, const QString &requestType, const QByteArray &data)
+{
+    StallScope stallScope("parse");
+    TraceSpan traceSpan("parse");
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if (doc.isNull() || !doc.isObject()) {
+        failRequest(requestId, "Invalid JSON response from API");
+        return false;
+    }
 
-        // Weather description and icon
-        if (item.contains("weather") && item["weather"].isArray()) {
-            QJsonArray weatherArray = item["weather"].toArray();
-            if (!weatherArray.isEmpty()) {
-                QJsonObject weather = weatherArray[0].toObject();
-                forecastItem.setDescription(weather["description"].toString());
-                forecastItem.setIconCode(weather["icon"].toString());
-            }
-        }
+    QJsonObject json = doc.object();
 
-        data.addItem(forecastItem);
+    QString apiError = WeatherParser::apiError(json);
+    if (!apiError.isEmpty()) {
+        failRequest(requestId, "API Error: " + apiError);
+        return false;
+    }
 
-        // Limit to 5 days
-        if (data.count() >= 5) {
-            break;
+    if (requestType == "weather") {
+        WeatherData weatherData = WeatherParser::parseWeatherObject(json);
+        Metrics::record("weather.parse", parseTimer.nsecsElapsed() / 1000);
+        traceSpan.end();
+        if (!weatherData.isValid()) {
+            failRequest(requestId, "Failed to parse weather data");
+            return false;
         }
+        emit weatherDataReady(weatherData);
+        emit weatherReplyReady(requestId, weatherData);
+    } else if (requestType == "forecast") {
+        ForecastData forecastData = WeatherParser::parseForecastObject(json);
+        Metrics::record("forecast.parse", parseTimer.nsecsElapsed() / 1000);
+        traceSpan.end();
+        emit forecastDataReady(forecastData);
+        emit forecastReplyReady(requestId, forecastData);
     }
-
-    return data;
+    return true;
 }
@@ -4,8 +4,15 @@
 #include <QObject>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QUrlQuery>
+#include <QFuture>
+#include <QHash>
+#include <QPointer>
+#include <QElapsedTimer>
 #include "weatherdata.h"
 #include "forecastdata.h"
+#include "cityresult.h"
+#include "forecaststream.h"
 
 class WeatherService : public QObject
 {
@@ -15,23 +22,118 @@ public:
     explicit WeatherService(QObject *parent = nullptr);
     void fetchWeather(const QString &city);
     void fetchForecast(const QString &city);
+    // Return a request ID echoed by the tagged signals, 0 if nothing was sent
+    quint64 fetchWeather(const CityResult &location);
+    quint64 fetchForecast(const CityResult &location);
+    // Why fetchWeather/fetchForecast would send nothing for location,
+    // empty if they would
+    QString checkLocation(const CityResult &location) const;
+
+    // API root used for requests, ApiEndpoints::apiBaseUrl() by default
+    QString baseUrl() const;
+    void setBaseUrl(const QString &baseUrl);
+
+    // Slow requests are duplicated here, see RequestHedger. Defaults to
+    // OPENWEATHERMAP_HEDGE_URL; empty turns hedging off.
+    QString hedgeUrl() const;
+    void setHedgeUrl(const QString &hedgeUrl);
+
+    // Plain GET through the shared connection pool. Nothing is parsed or
+    // emitted; the caller owns the reply.
+    QNetworkReply *forward(const QUrl &url, const QString &timingPrefix = "upstream");
+
+    // Opens the API connection ahead of the first request
+    void prewarm();
+
+    // Future-based requests. Results go only to the returned future, not
+    // to the signals below, and cancel() aborts the reply. Failures carry
+    // a WeatherError; compose with the helpers in weatherfutures.h.
+    QFuture<WeatherData> weather(const CityResult &location, int timeoutMs = DefaultTimeoutMs);
+    QFuture<ForecastData> forecast(const CityResult &location, int timeoutMs = DefaultTimeoutMs);
+    QFuture<QList<CityResult>> geocode(const QString &query, int limit = 5, int timeoutMs = DefaultTimeoutMs);
+    // Raw PNG bytes
+    QFuture<QByteArray> icon(const QString &iconCode, int timeoutMs = DefaultTimeoutMs);
+
+    static const int DefaultTimeoutMs = 15000;
+    // Responses in the SharedCache are used for this long; the API
+    // updates about every 10 minutes
+    static constexpr int SharedMaxAgeSecs = 600;
+
+    // User-facing message for a failed reply, empty if it succeeded.
+    // Reads the body of failed replies.
+    static QString networkError(QNetworkReply *reply);
+
+    // Feeds a finished reply to its endpoint's CircuitBreaker and, for
+    // 4xx, remembers the error under the reply's "lookupKey" property
+    // in the NegativeCache
+    static void recordOutcome(QNetworkReply *reply, const QString &error);
 
 signals:
     void weatherDataReady(const WeatherData &data);
     void forecastDataReady(const ForecastData &data);
     void errorOccurred(const QString &error);
 
+    // Same results tagged with the ID returned by fetchWeather/fetchForecast
+    void weatherReplyReady(quint64 requestId, const WeatherData &data);
+    void forecastReplyReady(quint64 requestId, const ForecastData &data);
+    void requestFailed(quint64 requestId, const QString &error);
+    // Emitted just before requestFailed when the request never reached the
+    // network: a negative-cache hit or an open circuit
+    void requestRejected(quint64 requestId, const QString &error);
+
+    // Forecast days as they are parsed, ahead of forecastReplyReady;
+    // index is the day's position in the final forecast
+    void forecastItemReady(quint64 requestId, int index, const ForecastItem &item);
+
 private slots:
     void onReplyFinished(QNetworkReply *reply);
 
 private:
     QNetworkAccessManager *m_networkManager;
-    WeatherData parseWeatherData(const QByteArray &jsonData);
-    ForecastData parseForecastData(const QByteArray &jsonData);
+    quint64 m_nextRequestId;
+    QString m_baseUrl;
+    QString m_hedgeUrl;
+
+    // Requests that may be hedged, by request ID
+    struct InFlight {
+        QPointer<QNetworkReply> primary;
+        QPointer<QNetworkReply> hedge;
+        QElapsedTimer timer;
+        bool hedged = false;
+    };
+    QHash<quint64, InFlight> m_inFlight;
+
+    // Losing primaries left running to measure the hedge's saving
+    struct SampledLoser {
+        QElapsedTimer timer;
+        qint64 wonAtUs = 0;
+    };
+    QHash<QNetworkReply *, SampledLoser> m_sampledLosers;
+
+    // Forecast replies parsed as their bytes arrive
+    QHash<QNetworkReply *, ForecastStream> m_streams;
+    QHash<quint64, int> m_streamedItems;    // items sent per request ID
+    QNetworkAccessManager *networkManager();
 
     QString apiKey() const;
-    const QString WEATHER_URL = "https://api.openweathermap.org/data/2.5/weather";
-    const QString FORECAST_URL = "https://api.openweathermap.org/data/2.5/forecast";
+    // Empty on success, otherwise why no request can be sent
+    QString buildQuery(const CityResult &location, QUrlQuery &query) const;
+    quint64 sendRequest(const QString &requestType, const QUrlQuery &query);
+    // Why a request should not be sent right now, empty if it can be
+    static QString preflight(const QUrl &url, const QString &negativeKey);
+    // Forwarded reply for the future API, or nullptr with the preflight error
+    QNetworkReply *lookup(const QUrl &url, const QString &timingPrefix,
+                          const QString &key, QString *error);
+    static QString endpointUrl(const QString &requestType, const QString &baseUrl);
+    void sendHedge(quint64 requestId);
+    bool settleHedged(QNetworkReply *reply, quint64 requestId);
+    void finishLoser(QNetworkReply *reply);
+    void watchStream(QNetworkReply *reply);
+    void readStream(QNetworkReply *reply);
+    bool finishStream(quint64 requestId, QNetworkReply *reply, ForecastStream &stream);
+    void failRequest(quint64 requestId, const QString &error);
+    // Parses a response body and emits the result; false if it failed
+    bool deliver(quint64 requestId, const QString &requestType, const QByteArray &data);
 };
 
 #endif // WEATHERSERVICE_H
@@ -0,0 +1,184 @@
+#include "weathersnapshot.h"
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDir>
+#include <QDebug>
+
+namespace {
+
+const quint32 SnapshotMagic = 0x57534e50; // "WSNP"
+// 2 added pressure and observation time; version 1 files still load
+const quint16 SnapshotVersion = 2;
+// Every Qt 5 the build accepts can read and write this
+const QDataStream::Version StreamVersion = QDataStream::Qt_5_2;
+
+void writeWeather(QDataStream &out, const WeatherData &data)
+{
+    out << data.cityName() << data.country() << data.temperature()
+        << data.feelsLike() << data.description() << qint32(data.humidity())
+        << data.windSpeed() << data.iconCode() << qint32(data.cityId())
+        << data.lat() << data.lon() << qint32(data.pressure()) << data.observedAt();
+}
+
+WeatherData readWeather(QDataStream &in, quint16 version)
+{
+    QString cityName, country, description, iconCode;
+    double temperature, feelsLike, windSpeed, lat, lon;
+    qint32 humidity, cityId;
+    qint32 pressure = 0;
+    qint64 observedAt = 0;
+
+    in >> cityName >> country >> temperature >> feelsLike >> description
+       >> humidity >> windSpeed >> iconCode >> cityId >> lat >> lon;
+    if (version >= 2) {
+        in >> pressure >> observedAt;
+    }
+
+    WeatherData data;
+    data.setCityName(cityName);
+    data.setCountry(country);
+    data.setTemperature(temperature);
+    data.setFeelsLike(feelsLike);
+    data.setDescription(description);
+    data.setHumidity(humidity);
+    data.setWindSpeed(windSpeed);
+    data.setIconCode(iconCode);
+    data.setCityId(cityId);
+    data.setCoordinates(lat, lon);
+    data.setPressure(pressure);
+    data.setObservedAt(observedAt);
+    return data;
+}
+
+void writeLocation(QDataStream &out, const CityResult &location)
+{
+    out << location.name << location.state << location.country
+        << location.lat << location.lon << qint32(location.cityId);
+}
+
+CityResult readLocation(QDataStream &in)
+{
+    CityResult location;
+    qint32 cityId;
+    in >> location.name >> location.state >> location.country
+       >> location.lat >> location.lon >> cityId;
+    location.cityId = cityId;
+    return location;
+}
+
+} // namespace
+
+WeatherSnapshot::WeatherSnapshot()
+{
+}
+
+qint64 WeatherSnapshot::ageSeconds() const
+{
+    return qMax<qint64>(0, savedAt.secsTo(QDateTime::currentDateTimeUtc()));
+}
+
+QString WeatherSnapshot::defaultFilePath()
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataPath);
+    return dataPath + "/snapshot.dat";
+}
+
+QString WeatherSnapshot::formatAge(qint64 seconds)
+{
+    if (seconds < 60) {
+        return "just now";
+    }
+    if (seconds < 3600) {
+        return QString("%1 min ago").arg(seconds / 60);
+    }
+    if (seconds < 86400) {
+        return QString("%1 h ago").arg(seconds / 3600);
+    }
+    return QString("%1 d ago").arg(seconds / 86400);
+}
+
+bool WeatherSnapshot::save(const QString &filePath) const
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open snapshot for writing:" << file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(StreamVersion);
+    out << SnapshotMagic << SnapshotVersion;
+    out << savedAt;
+    writeLocation(out, location);
+    out << displayName;
+    writeWeather(out, weather);
+
+    const QList<ForecastItem> items = forecast.items();
+    out << qint32(items.size());
+    for (const ForecastItem &item : items) {
+        out << item.dateTime() << item.tempMin() << item.tempMax()
+            << item.description() << item.iconCode();
+    }
+
+    out << icons;
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "Failed to write snapshot:" << filePath;
+        return false;
+    }
+    return true;
+}
+
+bool WeatherSnapshot::load(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(StreamVersion);
+
+    quint32 magic;
+    quint16 version;
+    in >> magic >> version;
+    if (magic != SnapshotMagic || version < 1 || version > SnapshotVersion) {
+        qWarning() << "Ignoring snapshot with unknown format:" << filePath;
+        return false;
+    }
+
+    in >> savedAt;
+    location = readLocation(in);
+    in >> displayName;
+    weather = readWeather(in, version);
+
+    qint32 itemCount;
+    in >> itemCount;
+    forecast.clear();
+    for (qint32 i = 0; i < itemCount && in.status() == QDataStream::Ok; ++i) {
+        QDateTime dateTime;
+        double tempMin, tempMax;
+        QString description, iconCode;
+        in >> dateTime >> tempMin >> tempMax >> description >> iconCode;
+
+        ForecastItem item;
+        item.setDateTime(dateTime);
+        item.setTempMin(tempMin);
+        item.setTempMax(tempMax);
+        item.setDescription(description);
+        item.setIconCode(iconCode);
+        forecast.addItem(item);
+    }
+
+    in >> icons;
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Corrupt snapshot:" << filePath;
+        *this = WeatherSnapshot();
+        return false;
+    }
+    return true;
+}
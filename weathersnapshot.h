@@ -0,0 +1,36 @@
+#ifndef WEATHERSNAPSHOT_H
+#define WEATHERSNAPSHOT_H
+
+#include <QString>
+#include <QDateTime>
+#include <QMap>
+#include <QByteArray>
+#include "weatherdata.h"
+#include "forecastdata.h"
+#include "cityresult.h"
+
+// Last rendered state, saved on exit and painted in the first frame
+// of the next launch while fresh data is fetched.
+class WeatherSnapshot
+{
+public:
+    WeatherSnapshot();
+
+    CityResult location;
+    QString displayName;
+    WeatherData weather;
+    ForecastData forecast;
+    QMap<QString, QByteArray> icons; // icon code -> PNG bytes
+    QDateTime savedAt;
+
+    bool isValid() const { return weather.isValid() && savedAt.isValid(); }
+    qint64 ageSeconds() const;
+
+    bool save(const QString &filePath) const;
+    bool load(const QString &filePath);
+
+    static QString defaultFilePath();
+    static QString formatAge(qint64 seconds);
+};
+
+#endif // WEATHERSNAPSHOT_H